@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "util.h"
+#include "parallel.h"
+#include "audit.h"
+
+// Audit of a corpus of puzzles, one per line: is each puzzle unique,
+// and is it minimal, i.e. does removing any hint make it
+// non-unique. The puzzles are read up front and checked in parallel,
+// each thread with its own checker graph, and the results are written
+// in the order of the input.
+
+// Puzzles handed to a worker at a time
+#define CHUNK_SIZE 64
+
+typedef struct {
+  sudoku puzzle;
+  bool parsed;
+  bool valid;
+  sudoku_audit audit;
+} audit_entry;
+
+typedef struct {
+  const audit_options *opts;
+  audit_entry *entries;
+  size_t count;
+  parallel_counter next[PARALLEL_MAX_NODES]; // Chunks handed out to each node
+} audit_ctx;
+
+static void audit_worker(int id, void *arg);
+static size_t read_corpus(FILE *in, audit_entry **entries);
+static void print_entry(FILE *out, size_t line, audit_entry *e, bool minimality);
+
+// Audit the puzzles read from opts->in, writing a line for each to
+// opts->out
+void audit_corpus(const audit_options *opts, audit_stats *stats)
+{
+  assert(opts);
+  assert(stats);
+
+  audit_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.opts = opts;
+  ctx.count = read_corpus(opts->in, &ctx.entries);
+
+  double start = get_time();
+  parallel_run(opts->threads, audit_worker, &ctx);
+
+  memset(stats, 0, sizeof(*stats));
+  stats->seconds = get_time() - start;
+  for (size_t i = 0; i < ctx.count; i++) {
+    audit_entry *e = &ctx.entries[i];
+    print_entry(opts->out, i+1, e, opts->minimality);
+    if (!e->parsed) {
+      stats->malformed++;
+      continue;
+    }
+    stats->puzzles++;
+    if (!e->valid || e->audit.solutions == 0) {
+      stats->invalid++;
+    } else if (e->audit.solutions > 1) {
+      stats->multiple++;
+    } else {
+      stats->unique++;
+      stats->minimal += e->audit.nredundant == 0;
+    }
+  }
+
+  free(ctx.entries);
+}
+
+static void audit_worker(int id, void *arg)
+{
+  audit_ctx *ctx = arg;
+  sudoku_checker *checker = sudoku_checker_create();
+
+  for (;;) {
+    size_t first = parallel_next_chunk(ctx->next, id, ctx->opts->threads) * CHUNK_SIZE;
+    if (first >= ctx->count) {
+      break;
+    }
+    size_t last = first + CHUNK_SIZE < ctx->count ? first + CHUNK_SIZE : ctx->count;
+    for (size_t i = first; i < last; i++) {
+      audit_entry *e = &ctx->entries[i];
+      if (e->parsed) {
+        e->valid = sudoku_checker_audit(checker, &e->puzzle, ctx->opts->minimality,
+                                        &e->audit);
+      }
+    }
+  }
+
+  sudoku_checker_destroy(checker);
+}
+
+// Read every line of the corpus. Return the number of lines, and store
+// an array of entries for them in entries, which the caller should
+// free.
+static size_t read_corpus(FILE *in, audit_entry **entries)
+{
+  size_t count = 0, capacity = 1024;
+  audit_entry *e = malloc(capacity * sizeof(audit_entry));
+  char line[256];
+
+  if (e == NULL) {
+    fatal("failed to allocate memory for corpus");
+  }
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (count == capacity) {
+      capacity *= 2;
+      if ((e = realloc(e, capacity * sizeof(audit_entry))) == NULL) {
+        fatal("failed to allocate memory for corpus");
+      }
+    }
+    e[count].parsed = sudoku_parse(line, &e[count].puzzle);
+    count++;
+  }
+
+  *entries = e;
+  return count;
+}
+
+// Write the result for one puzzle: its line number and hint count,
+// whether it is unique, and for unique puzzles either "minimal" or the
+// hints that can be removed as rNcM with 1-based row and column
+static void print_entry(FILE *out, size_t line, audit_entry *e, bool minimality)
+{
+  if (!e->parsed) {
+    fprintf(out, "%zu malformed\n", line);
+    return;
+  }
+
+  fprintf(out, "%zu %d ", line, e->audit.hints);
+  if (!e->valid || e->audit.solutions == 0) {
+    fprintf(out, "invalid");
+  } else if (e->audit.solutions > 1) {
+    fprintf(out, "multiple");
+  } else {
+    fprintf(out, "unique");
+    if (minimality && e->audit.nredundant == 0) {
+      fprintf(out, " minimal");
+    } else if (minimality) {
+      fprintf(out, " redundant");
+      for (int i = 0; i < e->audit.nredundant; i++) {
+        int idx = e->audit.redundant[i];
+        fprintf(out, " r%dc%d", idx / SUDOKU_SIZE + 1, idx % SUDOKU_SIZE + 1);
+      }
+    }
+  }
+  fprintf(out, "\n");
+}
@@ -0,0 +1,27 @@
+#ifndef __AUDIT_H__
+#define __AUDIT_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "sudoku.h"
+
+typedef struct {
+  bool minimality; // Also find redundant hints of unique puzzles
+  int threads;
+  FILE *in;
+  FILE *out;
+} audit_options;
+
+typedef struct {
+  size_t puzzles;
+  size_t unique;
+  size_t minimal;
+  size_t multiple;  // Puzzles with more than one solution
+  size_t invalid;   // Puzzles with no solution
+  size_t malformed; // Lines that aren't puzzles
+  double seconds;
+} audit_stats;
+
+void audit_corpus(const audit_options *opts, audit_stats *stats);
+
+#endif
@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include "util.h"
+#include "parallel.h"
+#include "perf.h"
+#include "trace.h"
+#include "metrics.h"
+#include "slowlog.h"
+#include "batch.h"
+
+// Generation of many puzzles at once. Puzzle i is generated from the
+// seed opts->seed + i, so it is the same puzzle that a single
+// generation with that seed gives, no matter how many threads are
+// used. Workers take chunks of puzzles from their NUMA node's counter
+// (see parallel.c), and write their chunks out in order.
+//
+// Each worker records the time each puzzle takes, and its phases, in
+// histograms of its own. The first worker prints a summary of all of
+// them when the process gets SIGUSR1, while the others carry on.
+
+// Puzzles handed to a worker at a time
+#define CHUNK_SIZE 16
+#define LINE_SIZE (GRID_SIZE+2)
+
+typedef struct {
+  const batch_options *opts;
+  parallel_counter next[PARALLEL_MAX_NODES]; // Chunks handed out to each node
+  size_t written;  // Puzzles written out so far
+  pthread_mutex_t lock;
+  pthread_cond_t turn;
+  sudoku_stats *stats; // One per worker
+  histogram (*timings)[BATCH_TIMINGS]; // One set per worker
+} batch_ctx;
+
+// Set by the SIGUSR1 handler to ask for the timings so far
+static volatile sig_atomic_t report_requested = 0;
+
+static void batch_worker(int id, void *arg);
+static void report_timings(batch_ctx *ctx);
+static void request_report(int sig);
+
+// Generate opts->count puzzles on opts->threads threads, writing them
+// to opts->out one per line
+void batch_generate(const batch_options *opts, batch_stats *stats)
+{
+  assert(opts);
+  assert(opts->out);
+
+  batch_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.opts = opts;
+  pthread_mutex_init(&ctx.lock, NULL);
+  pthread_cond_init(&ctx.turn, NULL);
+  ctx.stats = calloc(opts->threads, sizeof(sudoku_stats));
+  ctx.timings = calloc(opts->threads, sizeof(*ctx.timings));
+  if (ctx.stats == NULL || ctx.timings == NULL) {
+    fatal("failed to allocate memory for batch stats");
+  }
+
+  struct sigaction action, old_action;
+  if (opts->timings) {
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_report;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, &old_action);
+  }
+
+  double start = get_time();
+  metrics_set_gauge(METRIC_QUEUED, opts->count);
+  parallel_run(opts->threads, batch_worker, &ctx);
+
+  if (opts->timings) {
+    sigaction(SIGUSR1, &old_action, NULL);
+  }
+  if (stats != NULL) {
+    memset(stats, 0, sizeof(*stats));
+    stats->puzzles = opts->count;
+    stats->seconds = get_time() - start;
+    for (int i = 0; i < opts->threads; i++) {
+      sudoku_stats_add(&stats->gen, &ctx.stats[i]);
+      for (int j = 0; j < BATCH_TIMINGS; j++) {
+        histogram_merge(&stats->timings[j], &ctx.timings[i][j]);
+      }
+    }
+  }
+
+  pthread_cond_destroy(&ctx.turn);
+  pthread_mutex_destroy(&ctx.lock);
+  free(ctx.stats);
+  free(ctx.timings);
+}
+
+// Record the phase timings of a puzzle's stats, and the total time it
+// took, in a set of BATCH_TIMINGS histograms
+void batch_record_timings(histogram *timings, const sudoku_stats *stats, uint64_t total_ns)
+{
+  assert(timings);
+  assert(stats);
+
+  for (int i = 0; i < SUDOKU_PHASES; i++) {
+    histogram_record(&timings[i], stats->phase_ns[i]);
+  }
+  histogram_record(&timings[SUDOKU_PHASES], total_ns);
+}
+
+// Print the percentiles of a set of BATCH_TIMINGS histograms
+void batch_print_timings(const histogram *timings, FILE *fp)
+{
+  assert(timings);
+  assert(fp);
+
+  histogram_print_header(fp);
+  for (int i = 0; i < SUDOKU_PHASES; i++) {
+    histogram_print(&timings[i], sudoku_phase_name(i), fp);
+  }
+  histogram_print(&timings[SUDOKU_PHASES], "total", fp);
+}
+
+static void batch_worker(int id, void *arg)
+{
+  batch_ctx *ctx = arg;
+  const batch_options *opts = ctx->opts;
+  char lines[CHUNK_SIZE*LINE_SIZE];
+  sudoku puzzle, solution;
+  sudoku_stats stats;
+  metrics_shard *metrics = metrics_get_shard(id);
+
+  for (;;) {
+    size_t first = parallel_next_chunk(ctx->next, id, opts->threads) * CHUNK_SIZE;
+    if (first >= opts->count) {
+      break;
+    }
+    size_t n = opts->count - first < CHUNK_SIZE ? opts->count - first : CHUNK_SIZE;
+    metrics_set_gauge(METRIC_QUEUED, opts->count - first - n);
+
+    char *line = lines;
+    for (size_t i = 0; i < n; i++) {
+      rng_seed(opts->seed + first + i);
+      uint64_t start = get_time_ns();
+      trace_begin("puzzle", first + i);
+      if (!sudoku_generate(&puzzle, &solution, &opts->gen, &stats)) {
+        warn("seed %u: no puzzle in the difficulty range after %zu attempts",
+             opts->seed + (unsigned int) (first + i), stats.attempts);
+      }
+      trace_end();
+      uint64_t elapsed = get_time_ns() - start;
+      batch_record_timings(ctx->timings[id], &stats, elapsed);
+      if (metrics != NULL) {
+        metrics_record_generate(metrics, &stats, elapsed);
+      }
+      slowlog_generate(&opts->gen, opts->seed + first + i, &solution, &puzzle, &stats,
+                       elapsed);
+      sudoku_stats_add(&ctx->stats[id], &stats);
+      sudoku_format_line(opts->solutions ? &solution : &puzzle, line);
+      line += GRID_SIZE+1;
+    }
+
+    // Wait for the chunks before this one to be written
+    trace_begin("wait", first);
+    metrics_add_gauge(METRIC_WAITING, 1);
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->written != first) {
+      pthread_cond_wait(&ctx->turn, &ctx->lock);
+    }
+    metrics_add_gauge(METRIC_WAITING, -1);
+    trace_end();
+    fwrite(lines, 1, line - lines, opts->out);
+    ctx->written += n;
+    pthread_cond_broadcast(&ctx->turn);
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (id == 0 && report_requested) {
+      report_requested = 0;
+      report_timings(ctx);
+    }
+  }
+  perf_thread_done();
+}
+
+// Print the timings of every worker so far, while they keep recording
+static void report_timings(batch_ctx *ctx)
+{
+  histogram *totals = calloc(BATCH_TIMINGS, sizeof(histogram));
+  if (totals == NULL) {
+    fatal("failed to allocate memory for timings");
+  }
+  for (int i = 0; i < ctx->opts->threads; i++) {
+    for (int j = 0; j < BATCH_TIMINGS; j++) {
+      histogram_merge(&totals[j], &ctx->timings[i][j]);
+    }
+  }
+  fprintf(stderr, "timings after %zu puzzles:\n", totals[SUDOKU_PHASES].count);
+  batch_print_timings(totals, stderr);
+  free(totals);
+}
+
+static void request_report(int sig)
+{
+  report_requested = 1;
+}
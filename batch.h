@@ -0,0 +1,34 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "sudoku.h"
+#include "histogram.h"
+
+// Timings are kept for each phase of generation, and for the whole of
+// each puzzle
+#define BATCH_TIMINGS (SUDOKU_PHASES+1)
+
+typedef struct {
+  sudoku_options gen;
+  unsigned int seed; // Puzzle i is generated from seed + i
+  size_t count;
+  int threads;
+  bool solutions;    // Print the solutions rather than the puzzles
+  bool timings;      // Print the timings to stderr on SIGUSR1
+  FILE *out;
+} batch_options;
+
+typedef struct {
+  size_t puzzles;
+  double seconds;
+  sudoku_stats gen; // Totals over all puzzles
+  histogram timings[BATCH_TIMINGS]; // Nanoseconds per puzzle
+} batch_stats;
+
+void batch_generate(const batch_options *opts, batch_stats *stats);
+void batch_record_timings(histogram *timings, const sudoku_stats *stats, uint64_t total_ns);
+void batch_print_timings(const histogram *timings, FILE *fp);
+
+#endif
@@ -0,0 +1,771 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <assert.h>
+#include "sudoku.h"
+#include "solver.h"
+#include "cover.h"
+#include "histogram.h"
+#include "util.h"
+
+// Benchmarks of the generator and the solvers on fixed workloads, to
+// measure changes to solver.c and sudoku.c.
+//
+// The puzzles are made at the start from fixed seeds, so every run
+// works on the same data without reading any files. Each workload is
+// run a number of times to warm up, then a number of times that are
+// timed. The throughput is the median over the timed repetitions, and
+// the latencies are percentiles over every operation they ran.
+//
+// The results are written as JSON, one workload per line. Given the
+// results of an earlier run as a baseline, the workloads whose
+// throughput dropped by more than a tolerance are reported, and the
+// exit status is 1.
+//
+// With --micro, the steps that solver.c and sudoku.c build a search
+// out of are timed on their own instead: building the masks, the DLX
+// cells and the graph of a puzzle, choosing a column, covering and
+// uncovering columns, and shuffling the rows of a column. They run on
+// the graphs of the puzzles that generation runs pass through as they
+// take hints out, and are reported per operation and per link or cell
+// that the operation touches, so changes to the node layout and the
+// traversals can be measured without the noise of the rest.
+
+// Values for options that only have a long form
+enum {
+  OPT_REPS = 256,
+  OPT_WARMUP,
+  OPT_OUT,
+  OPT_BASELINE,
+  OPT_TOLERANCE,
+  OPT_MICRO,
+};
+
+// Puzzles generated for the corpora
+#define CORPUS_SIZE 32
+// Hints added to the minimal puzzles to make the easy ones
+#define EASY_HINTS 20
+// Hints taken out of the minimal puzzles to make ones to count
+#define COUNT_REMOVED 4
+// Solutions counted at most for each of them
+#define COUNT_LIMIT 100000
+// Times the quick workloads go through their corpus in a repetition,
+// for repetitions long enough to time steadily
+#define PASSES 32
+#define MAX_WORKLOADS 16
+
+// Generation runs that the microbenchmark graphs are taken from
+#define MICRO_RUNS 16
+// Puzzles taken from each run, from the minimal puzzle to the one with
+// 3/4 of the hints it took out put back
+#define MICRO_STAGES 4
+#define MICRO_STATES (MICRO_RUNS*MICRO_STAGES)
+// Times a microbenchmark repeats its step on each graph in a repetition
+#define MICRO_PASSES 16
+#define MICRO_MAX_STEPS GRID_SIZE
+
+typedef struct {
+  const char *name;
+  size_t ops;              // Operations in one repetition
+  void (*run)(size_t op);  // Run one operation
+} workload;
+
+typedef struct {
+  char name[32];
+  double ops_per_sec;
+} baseline_entry;
+
+// A puzzle and the DLX graph of it that the microbenchmarks run on
+typedef struct {
+  sudoku puzzle;
+  sudoku_state st;
+  bool *cells;
+  size_t count, ncols, nrows;
+  solver *slvr;
+  int branch[MICRO_MAX_STEPS]; // The column a search branches on at each step
+  int order[MICRO_MAX_STEPS];  // The row it takes there, toward the solution
+  int nsteps;
+} micro_state;
+
+// Totals of a microbenchmark repetition
+typedef struct {
+  uint64_t ns;
+  size_t ops;
+  size_t links; // Links, cells or rows the operations touched
+} micro_count;
+
+typedef struct {
+  const char *name;
+  void (*run)(micro_state *m, micro_count *c); // Time the step on a graph
+} micro;
+
+// Well known puzzles that are hard for a solver that guesses
+static const char *hard_puzzles[] = {
+  "8..........36......7..9.2...5...7.......457.....1...3...1....68..85...1..9....4..",
+  "1....7.9..3..2...8..96..5....53..9...1..8...26....4...3......1..4......7..7...3..",
+  "1.......2.9.4...5...6...7...5.9.3.......7.......85..4.7.....6...3...9.8...2.....1",
+  "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......",
+  "12.3....435....1....4........54..2..6...7.........8.9...31..5.......9.7.....6...8",
+  "..............3.85..1.2.......5.7.....4...1...9.......5......73..2.1........4...9",
+};
+#define HARD_PUZZLES (sizeof(hard_puzzles) / sizeof(hard_puzzles[0]))
+
+static sudoku minimal[CORPUS_SIZE], solutions[CORPUS_SIZE];
+static sudoku easy[CORPUS_SIZE], hard[HARD_PUZZLES], multiple[CORPUS_SIZE];
+static cover_matrix counted[CORPUS_SIZE];
+static sudoku_checker *checker;
+static micro_state micro_states[MICRO_STATES];
+
+static void make_corpora(void);
+static void make_cover_matrix(const sudoku *s, cover_matrix *m);
+static void run_generate(size_t op);
+static void run_complete(size_t op);
+static void run_probe(size_t op);
+static void run_solve_easy(size_t op);
+static void run_solve_minimal(size_t op);
+static void run_solve_hard(size_t op);
+static void run_count(size_t op);
+static void run_workload(const workload *w, int warmup, int reps, FILE *out, bool first);
+static void make_micro_states(void);
+static void free_micro_states(void);
+static void micro_masks(micro_state *m, micro_count *c);
+static void micro_dlx_cells(micro_state *m, micro_count *c);
+static void micro_init_graph(micro_state *m, micro_count *c);
+static void micro_choose(micro_state *m, micro_count *c);
+static void micro_cover(micro_state *m, micro_count *c);
+static void micro_uncover(micro_state *m, micro_count *c);
+static void micro_shuffle(micro_state *m, micro_count *c);
+static void run_micro(const micro *mb, int warmup, int reps, FILE *out, bool first);
+static void time_covers(micro_state *m, micro_count *cover, micro_count *uncover);
+static int compare(const char *path, const char *results, double tolerance);
+static int compare_doubles(const void *a, const void *b);
+
+static const workload workloads[] = {
+  { "generate",      16,                   run_generate      },
+  { "complete",      256,                  run_complete      },
+  { "probe",         PASSES*2*CORPUS_SIZE, run_probe         },
+  { "solve-easy",    PASSES*CORPUS_SIZE,   run_solve_easy    },
+  { "solve-minimal", PASSES*CORPUS_SIZE,   run_solve_minimal },
+  { "solve-hard",    PASSES*HARD_PUZZLES,  run_solve_hard    },
+  { "count",         CORPUS_SIZE/4,        run_count         },
+};
+#define WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static const micro micros[] = {
+  { "masks",      micro_masks      },
+  { "dlx-cells",  micro_dlx_cells  },
+  { "init-graph", micro_init_graph },
+  { "choose",     micro_choose     },
+  { "cover",      micro_cover      },
+  { "uncover",    micro_uncover    },
+  { "shuffle",    micro_shuffle    },
+};
+#define MICROS (sizeof(micros) / sizeof(micros[0]))
+
+static void usage(void)
+{
+  printf("Usage: gensudoku-bench [options] [WORKLOAD...]\n\n"
+         "Run the benchmark workloads, or the ones named, and write the\n"
+         "results as JSON. The workloads are generate, complete (solving an\n"
+         "empty grid), probe (uniqueness checks), solve-easy, solve-minimal,\n"
+         "solve-hard and count (counting the solutions of puzzles with many).\n\n"
+         "With --micro, run the microbenchmarks of the search steps instead:\n"
+         "masks, dlx-cells and init-graph (setting up a puzzle), choose\n"
+         "(picking the column to branch on), cover and uncover (taking a row\n"
+         "at each step of a search, and undoing it) and shuffle (the rows of\n"
+         "a column). They report the time per operation and per link,\n"
+         "or per cell for masks and dlx-cells and per row for shuffle.\n\n"
+         "Options:\n"
+         "  --reps=NUM                Timed repetitions of each workload (default 5)\n"
+         "  --warmup=NUM              Untimed repetitions first (default 1)\n"
+         "  --out=FILE                Write the results to FILE, not stdout\n"
+         "  --baseline=FILE           Compare the throughput with the results in\n"
+         "                            FILE, and exit with 1 if any workload got\n"
+         "                            slower by more than the tolerance\n"
+         "  --tolerance=PCT           Slowdown allowed by --baseline (default 10)\n"
+         "  --micro                   Run the microbenchmarks\n");
+}
+
+static long parse_number(const char *name, const char *arg, long min)
+{
+  char *end;
+  errno = 0;
+  long val = strtol(arg, &end, 0);
+  if (*end != '\0' || errno == ERANGE || val < min) {
+    fatal("invalid value for %s: %s", name, arg);
+  }
+  return val;
+}
+
+int main(int argc, char **argv)
+{
+  int c, reps = 5, warmup = 1;
+  double tolerance = 10;
+  bool micro_mode = false;
+  const char *out_path = NULL, *baseline = NULL;
+
+  const struct option long_options[] = {
+    { "reps",      required_argument, 0, OPT_REPS      },
+    { "warmup",    required_argument, 0, OPT_WARMUP    },
+    { "out",       required_argument, 0, OPT_OUT       },
+    { "baseline",  required_argument, 0, OPT_BASELINE  },
+    { "tolerance", required_argument, 0, OPT_TOLERANCE },
+    { "micro",     no_argument,       0, OPT_MICRO     },
+    { 0,           0,                 0, 0             },
+  };
+
+  while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+    switch (c) {
+    case OPT_REPS:
+      reps = parse_number("reps", optarg, 1);
+      break;
+    case OPT_WARMUP:
+      warmup = parse_number("warmup", optarg, 0);
+      break;
+    case OPT_OUT:
+      out_path = optarg;
+      break;
+    case OPT_BASELINE:
+      baseline = optarg;
+      break;
+    case OPT_TOLERANCE:
+      tolerance = parse_number("tolerance", optarg, 0);
+      break;
+    case OPT_MICRO:
+      micro_mode = true;
+      break;
+    default:
+      usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // The indices of the workloads, or microbenchmarks, to run
+  size_t available = micro_mode ? MICROS : WORKLOADS;
+  size_t selected[MAX_WORKLOADS];
+  size_t nselected = 0;
+  if (optind == argc) {
+    for (size_t i = 0; i < available; i++) {
+      selected[nselected++] = i;
+    }
+  }
+  for (int i = optind; i < argc; i++) {
+    size_t j = 0;
+    while (j < available &&
+           strcmp(argv[i], micro_mode ? micros[j].name : workloads[j].name) != 0) {
+      j++;
+    }
+    if (j == available) {
+      warn("unknown %s: %s", micro_mode ? "microbenchmark" : "workload", argv[i]);
+      usage();
+      exit(EXIT_FAILURE);
+    }
+    if (nselected < MAX_WORKLOADS) {
+      selected[nselected++] = j;
+    }
+  }
+
+  make_corpora();
+  if (micro_mode) {
+    make_micro_states();
+  }
+
+  // The results are kept in memory to be compared with the baseline
+  char *results;
+  size_t results_size;
+  FILE *out = open_memstream(&results, &results_size);
+  if (out == NULL) {
+    fatal("failed to allocate memory for results");
+  }
+  fprintf(out, "{\"reps\":%d,\"warmup\":%d,\"workloads\":[\n", reps, warmup);
+  if (micro_mode) {
+    warn("%-14s %12s %9s %9s %9s", "micro", "ops/s", "ns/op", "links/op", "ns/link");
+  } else {
+    warn("%-14s %10s %9s %9s %9s %9s", "workload", "ops/s", "mean", "p50", "p99", "max");
+  }
+  for (size_t i = 0; i < nselected; i++) {
+    if (micro_mode) {
+      run_micro(&micros[selected[i]], warmup, reps, out, i == 0);
+    } else {
+      run_workload(&workloads[selected[i]], warmup, reps, out, i == 0);
+    }
+  }
+  fprintf(out, "\n]}\n");
+  fclose(out);
+
+  FILE *fp = out_path != NULL ? fopen(out_path, "w") : stdout;
+  if (fp == NULL) {
+    fatal("unable to write %s: %s", out_path, strerror(errno));
+  }
+  fputs(results, fp);
+  if (fp != stdout) {
+    fclose(fp);
+  }
+
+  int status = baseline != NULL ? compare(baseline, results, tolerance) : 0;
+  free(results);
+  for (int i = 0; i < CORPUS_SIZE; i++) {
+    cover_free(&counted[i]);
+  }
+  sudoku_checker_destroy(checker);
+  if (micro_mode) {
+    free_micro_states();
+  }
+  return status;
+}
+
+// Make the puzzles the workloads run on: minimal puzzles generated from
+// the seeds 1 to CORPUS_SIZE, easy ones with hints of the solution added
+// back, ones with many solutions with hints taken out, and the hard
+// puzzles above
+static void make_corpora(void)
+{
+  sudoku_options opts = { 0, SYMMETRY_NONE };
+  for (int i = 0; i < CORPUS_SIZE; i++) {
+    rng_seed(i + 1);
+    sudoku_generate(&minimal[i], &solutions[i], &opts, NULL);
+
+    int cells[GRID_SIZE];
+    for (int j = 0; j < GRID_SIZE; j++) {
+      cells[j] = j;
+    }
+    shuffle(cells, GRID_SIZE);
+    easy[i] = minimal[i];
+    for (int j = 0, added = 0; j < GRID_SIZE && added < EASY_HINTS; j++) {
+      if (easy[i].grid[cells[j]] == 0) {
+        easy[i].grid[cells[j]] = solutions[i].grid[cells[j]];
+        added++;
+      }
+    }
+
+    multiple[i] = minimal[i];
+    for (int j = 0, removed = 0; j < GRID_SIZE && removed < COUNT_REMOVED; j++) {
+      if (multiple[i].grid[cells[j]] != 0) {
+        multiple[i].grid[cells[j]] = 0;
+        removed++;
+      }
+    }
+    make_cover_matrix(&multiple[i], &counted[i]);
+  }
+
+  for (int i = 0; i < HARD_PUZZLES; i++) {
+    if (!sudoku_parse(hard_puzzles[i], &hard[i])) {
+      fatal("invalid hard puzzle: %s", hard_puzzles[i]);
+    }
+  }
+  checker = sudoku_checker_create();
+}
+
+// Make the exact cover matrix of a puzzle, with a row for each value
+// that a cell can take without clashing with the hints, and a column
+// for each cell, and each value in each row, column and box
+static void make_cover_matrix(const sudoku *s, cover_matrix *m)
+{
+  m->ncols = m->nprimary = 4*GRID_SIZE;
+  m->starts = malloc((GRID_SIZE*SUDOKU_SIZE + 1)*sizeof(size_t));
+  m->cols = malloc(4*GRID_SIZE*SUDOKU_SIZE*sizeof(int));
+  if (m->starts == NULL || m->cols == NULL) {
+    fatal("failed to allocate memory for cover matrix");
+  }
+
+  m->nrows = 0;
+  m->starts[0] = 0;
+  for (int idx = 0; idx < GRID_SIZE; idx++) {
+    int x = idx % SUDOKU_SIZE, y = idx / SUDOKU_SIZE;
+    int box = (y / 3)*3 + x / 3;
+    for (int v = 1; v <= SUDOKU_SIZE; v++) {
+      bool allowed = s->grid[idx] == 0 || s->grid[idx] == v;
+      for (int j = 0; allowed && j < GRID_SIZE; j++) {
+        int jx = j % SUDOKU_SIZE, jy = j / SUDOKU_SIZE;
+        allowed = j == idx || s->grid[j] != v ||
+          (jx != x && jy != y && (jy / 3)*3 + jx / 3 != box);
+      }
+      if (allowed) {
+        int *cols = &m->cols[4*m->nrows];
+        cols[0] = idx;
+        cols[1] = GRID_SIZE + y*SUDOKU_SIZE + v-1;
+        cols[2] = 2*GRID_SIZE + x*SUDOKU_SIZE + v-1;
+        cols[3] = 3*GRID_SIZE + box*SUDOKU_SIZE + v-1;
+        m->nrows++;
+        m->starts[m->nrows] = 4*m->nrows;
+      }
+    }
+  }
+}
+
+static void run_generate(size_t op)
+{
+  sudoku_options opts = { 0, SYMMETRY_NONE };
+  sudoku puzzle, solution;
+  rng_seed(op + 1);
+  sudoku_generate(&puzzle, &solution, &opts, NULL);
+}
+
+static void run_complete(size_t op)
+{
+  sudoku grid;
+  memset(&grid, 0, sizeof(grid));
+  rng_seed(op + 1);
+  sudoku_solve(&grid);
+}
+
+// Check a minimal puzzle, which is unique, or one with hints taken out,
+// which isn't
+static void run_probe(size_t op)
+{
+  op %= 2*CORPUS_SIZE;
+  sudoku s = op % 2 == 0 ? minimal[op / 2] : multiple[op / 2];
+  sudoku_checker_unique(checker, &s);
+}
+
+// The solver tries rows in random order, so each solve is seeded by
+// its operation, and searches the same way whatever ran before it
+static void run_solve_easy(size_t op)
+{
+  sudoku s = easy[op % CORPUS_SIZE];
+  rng_seed(op + 1);
+  sudoku_checker_solve(checker, &s);
+}
+
+static void run_solve_minimal(size_t op)
+{
+  sudoku s = minimal[op % CORPUS_SIZE];
+  rng_seed(op + 1);
+  sudoku_checker_solve(checker, &s);
+}
+
+static void run_solve_hard(size_t op)
+{
+  sudoku s = hard[op % HARD_PUZZLES];
+  rng_seed(op + 1);
+  sudoku_checker_solve(checker, &s);
+}
+
+static void run_count(size_t op)
+{
+  cover_options opts = { COVER_COUNT, COUNT_LIMIT, 1, 0, NULL };
+  cover_stats stats;
+  cover_solve(&counted[op], &opts, &stats);
+}
+
+// Run a workload, print a summary line to stderr and write its results
+// to out
+static void run_workload(const workload *w, int warmup, int reps, FILE *out, bool first)
+{
+  for (int r = 0; r < warmup; r++) {
+    for (size_t op = 0; op < w->ops; op++) {
+      w->run(op);
+    }
+  }
+
+  histogram *h = calloc(1, sizeof(histogram));
+  double *throughput = malloc(reps*sizeof(double));
+  if (h == NULL || throughput == NULL) {
+    fatal("failed to allocate memory for timings");
+  }
+  for (int r = 0; r < reps; r++) {
+    uint64_t rep_start = get_time_ns();
+    for (size_t op = 0; op < w->ops; op++) {
+      uint64_t start = get_time_ns();
+      w->run(op);
+      histogram_record(h, get_time_ns() - start);
+    }
+    throughput[r] = w->ops / ((get_time_ns() - rep_start) / 1e9);
+  }
+  qsort(throughput, reps, sizeof(double), compare_doubles);
+  double ops_per_sec = throughput[reps / 2];
+
+  double mean = h->sum / 1e3 / h->count, p50 = histogram_percentile(h, 0.5) / 1e3,
+    p90 = histogram_percentile(h, 0.9) / 1e3, p99 = histogram_percentile(h, 0.99) / 1e3,
+    max = h->max / 1e3;
+  warn("%-14s %10.1f %9.1f %9.1f %9.1f %9.1f", w->name, ops_per_sec, mean, p50, p99, max);
+  fprintf(out, "%s{\"name\":\"%s\",\"ops\":%zu,\"ops_per_sec\":%.3f,\"mean_us\":%.3f,"
+          "\"p50_us\":%.3f,\"p90_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f}",
+          first ? "" : ",\n", w->name, w->ops, ops_per_sec, mean, p50, p90, p99, max);
+
+  free(throughput);
+  free(h);
+}
+
+// Set up the graphs of the microbenchmarks. They are those of the
+// minimal puzzles of the first MICRO_RUNS seeds, and of the puzzles
+// with some of the hints their generation took out put back, the way
+// they were earlier in the run.
+static void make_micro_states(void)
+{
+  for (int i = 0; i < MICRO_RUNS; i++) {
+    int removed = GRID_SIZE - sudoku_count_hints(&minimal[i]);
+    int cells[GRID_SIZE], ncells = 0;
+    for (int j = 0; j < GRID_SIZE; j++) {
+      if (minimal[i].grid[j] == 0) {
+        cells[ncells++] = j;
+      }
+    }
+    rng_seed(i + 1);
+    shuffle(cells, ncells);
+
+    for (int stage = 0; stage < MICRO_STAGES; stage++) {
+      micro_state *m = &micro_states[i*MICRO_STAGES + stage];
+      m->puzzle = minimal[i];
+      for (int j = 0; j < stage*removed/MICRO_STAGES; j++) {
+        m->puzzle.grid[cells[j]] = solutions[i].grid[cells[j]];
+      }
+      sudoku_state_init(&m->st, &m->puzzle);
+      m->cells = sudoku_dlx_cells(&m->st, &m->count, &m->ncols, &m->nrows);
+      m->slvr = solver_create(m->count, m->ncols, m->nrows);
+      solver_init_graph(m->slvr, m->cells, false);
+
+      // Take the steps of a search straight down to the solution:
+      // branch on the column it would choose each time, and select the
+      // row of that column that is in the solution, covering its other
+      // columns too
+      int solution[GRID_SIZE];
+      bool in_solution[GRID_SIZE*SUDOKU_SIZE] = { false };
+      assert(m->nrows <= GRID_SIZE*SUDOKU_SIZE);
+      if (!solver_run(m->slvr, DLX_FIRST, solution, GRID_SIZE)) {
+        fatal("minimal puzzle %d has no solution", i);
+      }
+      for (int j = 0; j < GRID_SIZE && solution[j] >= 0; j++) {
+        in_solution[solution[j]] = true;
+      }
+      m->nsteps = 0;
+      int col;
+      while ((col = solver_choose_column(m->slvr)) >= 0) {
+        assert(m->nsteps < MICRO_MAX_STEPS);
+        int rows[SUDOKU_SIZE], row = -1;
+        int n = solver_branch_rows(m->slvr, rows, SUDOKU_SIZE);
+        for (int j = 0; j < n && j < SUDOKU_SIZE; j++) {
+          if (in_solution[rows[j]]) {
+            row = rows[j];
+          }
+        }
+        assert(row >= 0);
+        solver_select_row(m->slvr, row);
+        m->branch[m->nsteps] = col;
+        m->order[m->nsteps++] = row;
+      }
+      for (int j = m->nsteps - 1; j >= 0; j--) {
+        solver_unselect_row(m->slvr, m->order[j]);
+      }
+    }
+  }
+  rng_seed(1);
+}
+
+static void free_micro_states(void)
+{
+  for (int i = 0; i < MICRO_STATES; i++) {
+    free(micro_states[i].cells);
+    solver_destroy(micro_states[i].slvr);
+  }
+}
+
+// Set up the value masks of the puzzle, per cell with a hint
+static void micro_masks(micro_state *m, micro_count *c)
+{
+  sudoku_state st;
+  uint64_t start = get_time_ns();
+  for (int i = 0; i < MICRO_PASSES; i++) {
+    sudoku_state_init(&st, &m->puzzle);
+  }
+  c->ns += get_time_ns() - start;
+  c->ops += MICRO_PASSES;
+  c->links += MICRO_PASSES*(GRID_SIZE - st.empty);
+}
+
+// Make the DLX cells of the puzzle, per cell that is on
+static void micro_dlx_cells(micro_state *m, micro_count *c)
+{
+  size_t count, ncols, nrows;
+  uint64_t start = get_time_ns();
+  for (int i = 0; i < MICRO_PASSES; i++) {
+    free(sudoku_dlx_cells(&m->st, &count, &ncols, &nrows));
+  }
+  c->ns += get_time_ns() - start;
+  c->ops += MICRO_PASSES;
+  c->links += MICRO_PASSES*count;
+}
+
+// Build the graph from the DLX cells again, per node linked
+static void micro_init_graph(micro_state *m, micro_count *c)
+{
+  uint64_t start = get_time_ns();
+  for (int i = 0; i < MICRO_PASSES; i++) {
+    solver_init_graph(m->slvr, m->cells, false);
+  }
+  c->ns += get_time_ns() - start;
+  c->ops += MICRO_PASSES;
+  c->links += MICRO_PASSES*m->count;
+}
+
+// Choose the column to branch on, per column header looked at. The
+// rows of the solution cover each column once, four columns a row.
+static void micro_choose(micro_state *m, micro_count *c)
+{
+  uint64_t start = get_time_ns();
+  for (int i = 0; i < MICRO_PASSES; i++) {
+    solver_choose_column(m->slvr);
+  }
+  c->ns += get_time_ns() - start;
+  c->ops += MICRO_PASSES;
+  c->links += MICRO_PASSES*4*m->nsteps;
+}
+
+static void micro_cover(micro_state *m, micro_count *c)
+{
+  micro_count uncover = { 0 };
+  time_covers(m, c, &uncover);
+}
+
+static void micro_uncover(micro_state *m, micro_count *c)
+{
+  micro_count cover = { 0 };
+  time_covers(m, &cover, c);
+}
+
+// Gather and shuffle the rows of each column a search branches on, per
+// row
+static void micro_shuffle(micro_state *m, micro_count *c)
+{
+  int rows[SUDOKU_SIZE];
+  size_t links = 0;
+  uint64_t start = get_time_ns();
+  for (int i = 0; i < MICRO_PASSES; i++) {
+    for (int j = 0; j < m->nsteps; j++) {
+      links += solver_shuffle_rows(m->slvr, m->branch[j], rows, SUDOKU_SIZE);
+    }
+  }
+  c->ns += get_time_ns() - start;
+  c->ops += MICRO_PASSES*m->nsteps;
+  c->links += links;
+}
+
+// Take the steps of a search down to the solution, then undo them,
+// timing each half separately, per step and per link
+static void time_covers(micro_state *m, micro_count *cover, micro_count *uncover)
+{
+  solver_stats before, after;
+  for (int i = 0; i < MICRO_PASSES; i++) {
+    solver_get_stats(m->slvr, &before);
+    uint64_t start = get_time_ns();
+    for (int j = 0; j < m->nsteps; j++) {
+      solver_select_row(m->slvr, m->order[j]);
+    }
+    uint64_t middle = get_time_ns();
+    for (int j = m->nsteps - 1; j >= 0; j--) {
+      solver_unselect_row(m->slvr, m->order[j]);
+    }
+    uint64_t end = get_time_ns();
+    solver_get_stats(m->slvr, &after);
+
+    // Uncovering relinks as many nodes as covering unlinked
+    size_t links = (after.links - before.links) / 2;
+    cover->ns += middle - start;
+    cover->ops += m->nsteps;
+    cover->links += links;
+    uncover->ns += end - middle;
+    uncover->ops += m->nsteps;
+    uncover->links += links;
+  }
+}
+
+// Run a microbenchmark over every graph, print a summary line to stderr
+// and write its results to out. The time per operation is the median
+// over the repetitions.
+static void run_micro(const micro *mb, int warmup, int reps, FILE *out, bool first)
+{
+  micro_count *counts = calloc(warmup + reps, sizeof(micro_count));
+  double *ns_per_op = malloc(reps*sizeof(double));
+  if (counts == NULL || ns_per_op == NULL) {
+    fatal("failed to allocate memory for timings");
+  }
+  for (int r = 0; r < warmup + reps; r++) {
+    for (int i = 0; i < MICRO_STATES; i++) {
+      mb->run(&micro_states[i], &counts[r]);
+    }
+    if (r >= warmup) {
+      ns_per_op[r - warmup] = (double) counts[r].ns / counts[r].ops;
+    }
+  }
+
+  // Find the repetition with the median time to report its links
+  qsort(ns_per_op, reps, sizeof(double), compare_doubles);
+  double median = ns_per_op[reps / 2];
+  micro_count *c = &counts[warmup];
+  for (int r = warmup; r < warmup + reps; r++) {
+    if ((double) counts[r].ns / counts[r].ops == median) {
+      c = &counts[r];
+    }
+  }
+  double links_per_op = (double) c->links / c->ops;
+  double ns_per_link = c->links > 0 ? (double) c->ns / c->links : 0;
+
+  warn("%-14s %12.1f %9.1f %9.1f %9.3f", mb->name, 1e9 / median, median, links_per_op,
+       ns_per_link);
+  fprintf(out, "%s{\"name\":\"%s\",\"ops\":%zu,\"ops_per_sec\":%.3f,\"ns_per_op\":%.3f,"
+          "\"links_per_op\":%.3f,\"ns_per_link\":%.3f}",
+          first ? "" : ",\n", mb->name, c->ops, 1e9 / median, median, links_per_op,
+          ns_per_link);
+
+  free(ns_per_op);
+  free(counts);
+}
+
+// Compare the throughput in the results with the baseline file, which
+// holds the results of an earlier run. Return 1 if any workload is
+// slower by more than tolerance percent, or 0.
+static int compare(const char *path, const char *results, double tolerance)
+{
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    fatal("unable to read baseline %s: %s", path, strerror(errno));
+  }
+  baseline_entry base[MAX_WORKLOADS];
+  size_t nbase = 0;
+  char line[512];
+  while (nbase < MAX_WORKLOADS && fgets(line, sizeof(line), fp) != NULL) {
+    const char *entry = strstr(line, "{\"name\":");
+    if (entry != NULL && sscanf(entry, "{\"name\":\"%31[^\"]\",\"ops\":%*u,\"ops_per_sec\":%lf",
+                                base[nbase].name, &base[nbase].ops_per_sec) == 2) {
+      nbase++;
+    }
+  }
+  fclose(fp);
+
+  int status = 0;
+  warn("%-14s %10s %10s %8s", "workload", "baseline", "ops/s", "change");
+  for (const char *entry = strstr(results, "{\"name\":"); entry != NULL;
+       entry = strstr(entry + 1, "{\"name\":")) {
+    char name[32];
+    double ops_per_sec;
+    if (sscanf(entry, "{\"name\":\"%31[^\"]\",\"ops\":%*u,\"ops_per_sec\":%lf", name,
+               &ops_per_sec) != 2) {
+      continue;
+    }
+    size_t i = 0;
+    while (i < nbase && strcmp(base[i].name, name) != 0) {
+      i++;
+    }
+    if (i == nbase) {
+      warn("%-14s %10s %10.1f", name, "-", ops_per_sec);
+      continue;
+    }
+    double change = 100 * (ops_per_sec / base[i].ops_per_sec - 1);
+    bool regressed = change < -tolerance;
+    warn("%-14s %10.1f %10.1f %+7.1f%%%s", name, base[i].ops_per_sec, ops_per_sec, change,
+         regressed ? "  REGRESSION" : "");
+    if (regressed) {
+      status = 1;
+    }
+  }
+  return status;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
@@ -0,0 +1,335 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "parallel.h"
+#include "corpus.h"
+
+// Sets of puzzles made from fixed seeds, so benchmarks of every mode
+// can run on the same data on any machine, without downloading it.
+//
+// Puzzle i of a set starts from the puzzle generated with the seed
+// SEED+i, and anything random done to it afterwards uses that seed's
+// generator too, so a set is the same whatever the number of threads.
+// The low clue set keeps the generated puzzles with few enough clues,
+// taking the seeds in order until it has enough.
+//
+// The binary format is a 16 byte header: "SDKC", a version byte (1),
+// the grid size (9), two zero bytes, the number of puzzles as a 32 bit
+// little endian integer, and four zero bytes. Each puzzle follows in
+// (GRID_SIZE+1)/2 bytes, cell 2k in the low 4 bits of byte k and cell
+// 2k+1 in the high 4 bits.
+
+// Hints added back to make the easy puzzles
+#define EASY_HINTS 20
+// Most clues a puzzle of the low clue set has
+#define LOW_CLUES 22
+// Hints of the solution the near empty puzzles keep
+#define NEAR_EMPTY_HINTS 8
+// Seeds tried at a time for the low clue set
+#define LOWCLUE_BLOCK 256
+
+#define HEADER_SIZE 16
+#define PACKED_SIZE ((GRID_SIZE+1)/2)
+#define VERSION 1
+
+typedef struct {
+  corpus_set set;
+  unsigned int seed;
+  size_t count;
+  size_t next;     // The next puzzle to make
+  sudoku *puzzles;
+} make_ctx;
+
+static const char *set_names[] = {
+  "easy", "minimal", "lowclue", "near-empty", "invalid", "unsolvable",
+};
+
+static void make_worker(int id, void *arg);
+static void make_puzzle(corpus_set set, sudoku_checker *checker, sudoku *puzzle);
+static void make_invalid(sudoku *puzzle);
+static bool make_unsolvable(sudoku_checker *checker, sudoku *puzzle);
+static void shuffled_cells(int *cells);
+
+const char *corpus_set_name(corpus_set set)
+{
+  assert(set >= 0 && set < CORPUS_SETS);
+  return set_names[set];
+}
+
+// Make count puzzles of a set from the seeds starting at seed, on the
+// given number of threads
+void corpus_make(corpus_set set, unsigned int seed, size_t count, int threads,
+                 sudoku *puzzles)
+{
+  assert(set >= 0 && set < CORPUS_SETS);
+  assert(puzzles);
+  assert(threads > 0);
+
+  if (set != CORPUS_LOWCLUE) {
+    make_ctx ctx = { set, seed, count, 0, puzzles };
+    parallel_run(threads, make_worker, &ctx);
+    return;
+  }
+
+  sudoku *block = malloc(LOWCLUE_BLOCK*sizeof(sudoku));
+  if (block == NULL) {
+    fatal("failed to allocate memory for corpus");
+  }
+  size_t found = 0;
+  while (found < count) {
+    make_ctx ctx = { CORPUS_MINIMAL, seed, LOWCLUE_BLOCK, 0, block };
+    parallel_run(threads, make_worker, &ctx);
+    for (size_t i = 0; i < LOWCLUE_BLOCK && found < count; i++) {
+      if (sudoku_count_hints(&block[i]) <= LOW_CLUES) {
+        puzzles[found++] = block[i];
+      }
+    }
+    seed += LOWCLUE_BLOCK;
+  }
+  free(block);
+}
+
+// Create the directory a corpus is written to, unless it exists.
+// Return false if it can't be created.
+bool corpus_make_dir(const char *dir)
+{
+  assert(dir);
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+    warn("unable to create %s: %s", dir, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+// Write the puzzles to the file at path. Return false if it can't be
+// written.
+bool corpus_write(const char *path, corpus_format format, const sudoku *puzzles,
+                  size_t count)
+{
+  assert(path);
+  assert(puzzles || count == 0);
+
+  FILE *fp = fopen(path, format == CORPUS_BINARY ? "wb" : "w");
+  if (fp == NULL) {
+    warn("unable to write %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  if (format == CORPUS_BINARY) {
+    uint8_t header[HEADER_SIZE] = { 'S', 'D', 'K', 'C', VERSION, SUDOKU_SIZE };
+    for (int i = 0; i < 4; i++) {
+      header[8+i] = count >> 8*i;
+    }
+    fwrite(header, 1, HEADER_SIZE, fp);
+    for (size_t i = 0; i < count; i++) {
+      uint8_t packed[PACKED_SIZE];
+      memset(packed, 0, sizeof(packed));
+      for (int j = 0; j < GRID_SIZE; j++) {
+        packed[j/2] |= puzzles[i].grid[j] << 4*(j%2);
+      }
+      fwrite(packed, 1, PACKED_SIZE, fp);
+    }
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      char line[GRID_SIZE+2];
+      sudoku s = puzzles[i];
+      sudoku_format_line(&s, line);
+      fputs(line, fp);
+    }
+  }
+
+  bool failed = ferror(fp);
+  if (fclose(fp) != 0 || failed) {
+    warn("unable to write %s", path);
+    return false;
+  }
+  return true;
+}
+
+// Start reading puzzles from fp, in the binary format if it starts
+// with its header and as text otherwise. Return false if the header is
+// for another version or grid size.
+bool corpus_reader_init(corpus_reader *r, FILE *fp)
+{
+  assert(r);
+  assert(fp);
+
+  r->fp = fp;
+  r->left = 0;
+  r->lines = 0;
+  r->format = CORPUS_TEXT;
+
+  // A text corpus starts with a digit or '.', never with the 'S' of
+  // the binary header
+  int c = getc(fp);
+  if (c == EOF) {
+    return true;
+  }
+  ungetc(c, fp);
+  if (c != 'S') {
+    return true;
+  }
+
+  uint8_t header[HEADER_SIZE];
+  if (fread(header, 1, HEADER_SIZE, fp) != HEADER_SIZE || memcmp(header, "SDKC", 4) != 0) {
+    warn("invalid corpus header");
+    return false;
+  }
+  if (header[4] != VERSION || header[5] != SUDOKU_SIZE) {
+    warn("unsupported corpus version %d or grid size %d", header[4], header[5]);
+    return false;
+  }
+  r->format = CORPUS_BINARY;
+  for (int i = 0; i < 4; i++) {
+    r->left |= (size_t) header[8+i] << 8*i;
+  }
+  return true;
+}
+
+// Read the next puzzle. Lines of a text corpus that aren't puzzles are
+// skipped with a warning. Return false at the end of the corpus.
+bool corpus_read(corpus_reader *r, sudoku *s)
+{
+  assert(r);
+  assert(s);
+
+  if (r->format == CORPUS_BINARY) {
+    uint8_t packed[PACKED_SIZE];
+    if (r->left == 0) {
+      return false;
+    }
+    if (fread(packed, 1, PACKED_SIZE, r->fp) != PACKED_SIZE) {
+      warn("corpus ends %zu puzzles early", r->left);
+      r->left = 0;
+      return false;
+    }
+    r->left--;
+    for (int j = 0; j < GRID_SIZE; j++) {
+      s->grid[j] = packed[j/2] >> 4*(j%2) & 0xf;
+    }
+    return true;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), r->fp) != NULL) {
+    r->lines++;
+    if (sudoku_parse(line, s)) {
+      return true;
+    }
+    warn("skipping line %zu, which is not a puzzle: %s", r->lines, line);
+  }
+  return false;
+}
+
+static void make_worker(int id, void *arg)
+{
+  make_ctx *ctx = arg;
+  sudoku_checker *checker = ctx->set == CORPUS_UNSOLVABLE ? sudoku_checker_create() : NULL;
+
+  for (;;) {
+    size_t i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED);
+    if (i >= ctx->count) {
+      break;
+    }
+    rng_seed(ctx->seed + i);
+    make_puzzle(ctx->set, checker, &ctx->puzzles[i]);
+  }
+
+  if (checker != NULL) {
+    sudoku_checker_destroy(checker);
+  }
+}
+
+// Make a puzzle of the set with the calling thread's generator, which
+// has been seeded
+static void make_puzzle(corpus_set set, sudoku_checker *checker, sudoku *puzzle)
+{
+  sudoku_options opts = { set == CORPUS_EASY ? EASY_HINTS : 0, SYMMETRY_NONE };
+  sudoku solution;
+  sudoku_generate(puzzle, &solution, &opts, NULL);
+
+  if (set == CORPUS_NEAR_EMPTY) {
+    int cells[GRID_SIZE];
+    shuffled_cells(cells);
+    memset(puzzle, 0, sizeof(sudoku));
+    for (int i = 0; i < NEAR_EMPTY_HINTS; i++) {
+      puzzle->grid[cells[i]] = solution.grid[cells[i]];
+    }
+  } else if (set == CORPUS_INVALID) {
+    make_invalid(puzzle);
+  } else if (set == CORPUS_UNSOLVABLE) {
+    if (!make_unsolvable(checker, puzzle)) {
+      fatal("could not make an unsolvable puzzle");
+    }
+  }
+}
+
+// Copy a random hint into an empty cell that shares a row, column or
+// box with it
+static void make_invalid(sudoku *puzzle)
+{
+  int cells[GRID_SIZE];
+  shuffled_cells(cells);
+  for (int i = 0; i < GRID_SIZE; i++) {
+    int from = cells[i];
+    if (puzzle->grid[from] == 0) {
+      continue;
+    }
+    for (int j = 0; j < GRID_SIZE; j++) {
+      int to = cells[j];
+      int fx = GRID_X(from), fy = GRID_Y(from), tx = GRID_X(to), ty = GRID_Y(to);
+      if (puzzle->grid[to] == 0 &&
+          (fx == tx || fy == ty || SEC_IDX(fx, fy) == SEC_IDX(tx, ty))) {
+        puzzle->grid[to] = puzzle->grid[from];
+        return;
+      }
+    }
+  }
+}
+
+// Change one hint of a unique puzzle to another value that clashes with
+// no other hint, such that the puzzle has no solution. Return false if
+// no such change is found.
+static bool make_unsolvable(sudoku_checker *checker, sudoku *puzzle)
+{
+  int cells[GRID_SIZE];
+  shuffled_cells(cells);
+  for (int i = 0; i < GRID_SIZE; i++) {
+    int idx = cells[i];
+    sudoku_value hint = puzzle->grid[idx];
+    if (hint == 0) {
+      continue;
+    }
+    int offset = rng_int(SUDOKU_SIZE);
+    for (int k = 0; k < SUDOKU_SIZE; k++) {
+      sudoku_value v = (offset + k) % SUDOKU_SIZE + 1;
+      if (v == hint) {
+        continue;
+      }
+      sudoku changed = *puzzle;
+      changed.grid[idx] = v;
+      sudoku_state st;
+      if (sudoku_state_init(&st, &changed)) {
+        sudoku solved = changed;
+        if (!sudoku_checker_solve(checker, &solved)) {
+          *puzzle = changed;
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// Get the cells in a random order
+static void shuffled_cells(int *cells)
+{
+  for (int i = 0; i < GRID_SIZE; i++) {
+    cells[i] = i;
+  }
+  shuffle(cells, GRID_SIZE);
+}
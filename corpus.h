@@ -0,0 +1,41 @@
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "sudoku.h"
+
+// The sets of puzzles --make-corpus writes
+typedef enum {
+  CORPUS_EASY,       // Minimal puzzles with hints added back
+  CORPUS_MINIMAL,    // Puzzles as generated
+  CORPUS_LOWCLUE,    // Generated puzzles with few clues
+  CORPUS_NEAR_EMPTY, // A few hints of a solved grid, with many solutions
+  CORPUS_INVALID,    // Puzzles with two equal hints in a row, column or box
+  CORPUS_UNSOLVABLE, // Puzzles without clashing hints but with no solution
+  CORPUS_SETS,
+} corpus_set;
+
+typedef enum {
+  CORPUS_TEXT,   // One puzzle per line
+  CORPUS_BINARY, // A header, then 4 bits per cell
+} corpus_format;
+
+// Reads puzzles in either format, telling them apart by the header
+typedef struct {
+  FILE *fp;
+  corpus_format format;
+  size_t left;   // Puzzles left in a binary corpus
+  size_t lines;  // Lines read from a text corpus
+} corpus_reader;
+
+const char *corpus_set_name(corpus_set set);
+void corpus_make(corpus_set set, unsigned int seed, size_t count, int threads,
+                 sudoku *puzzles);
+bool corpus_make_dir(const char *dir);
+bool corpus_write(const char *path, corpus_format format, const sudoku *puzzles,
+                  size_t count);
+bool corpus_reader_init(corpus_reader *r, FILE *fp);
+bool corpus_read(corpus_reader *r, sudoku *s);
+
+#endif
@@ -0,0 +1,326 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <assert.h>
+#include <pthread.h>
+#include "util.h"
+#include "solver.h"
+#include "parallel.h"
+#include "cover.h"
+
+// Exact cover problems read from a text format and solved with the
+// DLX solver, the same one that checks sudoku puzzles.
+//
+// The format is streamed a line at a time: each line is a row of the
+// matrix, given as the ids of the columns it covers, separated by
+// spaces. Lines starting with '#' and blank lines are skipped. The
+// first row may instead be a header, "columns P S", declaring P
+// primary columns with ids 0 to P-1 and S secondary columns with ids P
+// to P+S-1. Without it, every column up to the largest id used is
+// primary. Only the ids are kept, so memory grows with the number of
+// cells that are on, not with the size of the matrix.
+//
+// With several threads, each builds its own graph and takes its share
+// of the rows of the column the search would branch on first. Every
+// solution uses exactly one of those rows, so the parts don't overlap.
+// Only printing takes a lock: a count without a limit is kept by each
+// thread and added up at the end, and one with a limit is shared.
+
+typedef struct {
+  const cover_matrix *m;
+  const cover_options *opts;
+  double deadline;
+  pthread_mutex_t lock;    // Serializes the output
+  size_t solutions;        // Solutions found, with the threads' own counts added at the end
+  bool stop;               // The limit was reached
+  bool timed_out;
+} cover_ctx;
+
+// What a thread's callback needs: the shared context, and the branch
+// row the thread selected, which the solver doesn't report
+typedef struct {
+  cover_ctx *ctx;
+  int branch;
+  int *buffer;
+  size_t solutions; // Solutions counted by the thread, without a limit
+} cover_part;
+
+static void solve_worker(int id, void *arg);
+static solver *build_solver(const cover_matrix *m);
+static bool report_solution(const int *rows, size_t n, void *arg);
+static int compare_ints(const void *a, const void *b);
+
+// Read a matrix in the format above. Return false, with a warning, if
+// the input isn't valid. The caller should free the matrix with
+// cover_free.
+bool cover_read(FILE *in, cover_matrix *m)
+{
+  assert(in);
+  assert(m);
+
+  size_t starts_size = 1024, cols_size = 4096, ncells = 0, line_num = 0;
+  size_t declared = 0;
+  bool header = false, ok = true;
+  long max_col = -1;
+  char *line = NULL;
+  size_t line_size = 0;
+
+  memset(m, 0, sizeof(*m));
+  m->starts = malloc(starts_size*sizeof(size_t));
+  m->cols = malloc(cols_size*sizeof(int));
+  if (m->starts == NULL || m->cols == NULL) {
+    fatal("failed to allocate memory for matrix");
+  }
+
+  while (ok && getline(&line, &line_size, in) != -1) {
+    line_num++;
+    char *p = line;
+    while (*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (*p == '#' || *p == '\n' || *p == '\0') {
+      continue;
+    }
+
+    long primary, secondary = 0;
+    int consumed = 0;
+    if (m->nrows == 0 && !header &&
+        sscanf(p, "columns %ld %n", &primary, &consumed) == 1) {
+      sscanf(p + consumed, "%ld", &secondary);
+      if (primary < 0 || secondary < 0 || primary + secondary > INT_MAX) {
+        warn("line %zu: invalid column counts", line_num);
+        ok = false;
+      }
+      header = true;
+      m->nprimary = primary;
+      declared = primary + secondary;
+      continue;
+    }
+
+    // Read the column ids of the row, and sort them for the solver
+    size_t first = ncells;
+    for (;;) {
+      char *end;
+      errno = 0;
+      long col = strtol(p, &end, 10);
+      if (end == p) {
+        break;
+      }
+      if (errno == ERANGE || col < 0 || col > INT_MAX ||
+          (header && col >= declared)) {
+        warn("line %zu: invalid column id", line_num);
+        ok = false;
+        break;
+      }
+      if (ncells == cols_size) {
+        cols_size *= 2;
+        if ((m->cols = realloc(m->cols, cols_size*sizeof(int))) == NULL) {
+          fatal("failed to allocate memory for matrix");
+        }
+      }
+      m->cols[ncells++] = col;
+      max_col = col > max_col ? col : max_col;
+      p = end;
+    }
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+      p++;
+    }
+    if (ok && *p != '\0') {
+      warn("line %zu: expected column ids", line_num);
+      ok = false;
+    }
+    qsort(&m->cols[first], ncells - first, sizeof(int), compare_ints);
+    for (size_t i = first + 1; ok && i < ncells; i++) {
+      if (m->cols[i] == m->cols[i-1]) {
+        warn("line %zu: column %d appears twice", line_num, m->cols[i]);
+        ok = false;
+      }
+    }
+
+    if (m->nrows + 1 == starts_size) {
+      starts_size *= 2;
+      if ((m->starts = realloc(m->starts, starts_size*sizeof(size_t))) == NULL) {
+        fatal("failed to allocate memory for matrix");
+      }
+    }
+    m->starts[m->nrows++] = first;
+  }
+  free(line);
+
+  m->starts[m->nrows] = ncells;
+  m->ncols = header ? declared : max_col + 1;
+  if (!header) {
+    m->nprimary = m->ncols;
+  }
+  if (ok && m->ncols == 0) {
+    warn("the matrix has no columns");
+    ok = false;
+  }
+  if (!ok) {
+    cover_free(m);
+  }
+  return ok;
+}
+
+void cover_free(cover_matrix *m)
+{
+  assert(m);
+  free(m->starts);
+  free(m->cols);
+  memset(m, 0, sizeof(*m));
+}
+
+// Solve the exact cover problem, writing the solutions found to
+// opts->out as the ids of their rows, counting from 0 in the order
+// they were read
+void cover_solve(const cover_matrix *m, const cover_options *opts, cover_stats *stats)
+{
+  assert(m);
+  assert(opts);
+  assert(stats);
+
+  cover_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.m = m;
+  ctx.opts = opts;
+  pthread_mutex_init(&ctx.lock, NULL);
+
+  double start = get_time();
+  ctx.deadline = opts->time_limit > 0 ? start + opts->time_limit : 0;
+
+  // Looking for the first solution is left to one thread, so that it
+  // is the first in the order of the rows
+  int nthreads = opts->mode == COVER_FIRST || opts->threads < 1 ? 1 : opts->threads;
+  if (nthreads == 1) {
+    solve_worker(-1, &ctx);
+  } else {
+    parallel_run(nthreads, solve_worker, &ctx);
+  }
+
+  // Threads sharing a limit can count a few past it between them
+  stats->solutions = ctx.solutions;
+  if (opts->mode == COVER_COUNT && opts->limit > 0 && stats->solutions > opts->limit) {
+    stats->solutions = opts->limit;
+  }
+  stats->timed_out = ctx.timed_out;
+  stats->seconds = get_time() - start;
+  pthread_mutex_destroy(&ctx.lock);
+}
+
+// Search with a graph of the thread's own. With an id of -1, the one
+// thread searches everything; otherwise thread id takes every
+// nthreads'th row of the first branch.
+static void solve_worker(int id, void *arg)
+{
+  cover_ctx *ctx = arg;
+  const cover_options *opts = ctx->opts;
+  int nthreads = opts->threads;
+  solver *slvr = build_solver(ctx->m);
+  size_t size = ctx->m->nprimary + 1;
+  int *set = malloc(size*sizeof(int));
+  cover_part part = { ctx, -1, malloc(size*sizeof(int)) };
+  if (set == NULL || part.buffer == NULL) {
+    fatal("failed to allocate memory for solutions");
+  }
+
+  solver_set_deadline(slvr, ctx->deadline);
+  solver_set_callback(slvr, report_solution, &part);
+  dlx_mode mode = opts->mode == COVER_FIRST ? DLX_FIRST : DLX_ALL;
+
+  int nbranch = id < 0 ? -1 : solver_branch_rows(slvr, NULL, 0);
+  if (nbranch < 0) {
+    // Either there is one thread, or no columns to branch on, in which
+    // case the empty set is the one solution and thread 0 reports it
+    if (id <= 0) {
+      solver_run(slvr, mode, set, size);
+    }
+  } else {
+    int *branch = malloc((nbranch > 0 ? nbranch : 1)*sizeof(int));
+    if (branch == NULL) {
+      fatal("failed to allocate memory for branch rows");
+    }
+    solver_branch_rows(slvr, branch, nbranch);
+    for (int i = id; i < nbranch && !__atomic_load_n(&ctx->stop, __ATOMIC_RELAXED);
+         i += nthreads) {
+      part.branch = branch[i];
+      solver_select_row(slvr, branch[i]);
+      solver_run(slvr, mode, set, size);
+      solver_unselect_row(slvr, branch[i]);
+      if (solver_timed_out(slvr)) {
+        break;
+      }
+    }
+    free(branch);
+  }
+
+  if (solver_timed_out(slvr)) {
+    __atomic_store_n(&ctx->timed_out, true, __ATOMIC_RELAXED);
+  }
+  __atomic_fetch_add(&ctx->solutions, part.solutions, __ATOMIC_RELAXED);
+  free(set);
+  free(part.buffer);
+  solver_destroy(slvr);
+}
+
+// Build a solver for the matrix
+static solver *build_solver(const cover_matrix *m)
+{
+  solver *slvr = solver_create(m->starts[m->nrows], m->ncols, m->nrows);
+  solver_set_primary(slvr, m->nprimary);
+  solver_init_rows(slvr, m->starts, m->cols, true);
+  return slvr;
+}
+
+// Count a solution, and print it unless only counting. Return true to
+// stop the search once the limit is reached, by this thread or another.
+// Counting doesn't take the lock.
+static bool report_solution(const int *rows, size_t n, void *arg)
+{
+  cover_part *part = arg;
+  cover_ctx *ctx = part->ctx;
+  const cover_options *opts = ctx->opts;
+
+  if (opts->mode == COVER_COUNT) {
+    if (opts->limit == 0) {
+      part->solutions++;
+      return false;
+    }
+    if (__atomic_load_n(&ctx->stop, __ATOMIC_RELAXED)) {
+      return true;
+    }
+    bool stop = __atomic_add_fetch(&ctx->solutions, 1, __ATOMIC_RELAXED) >= opts->limit;
+    if (stop) {
+      __atomic_store_n(&ctx->stop, true, __ATOMIC_RELAXED);
+    }
+    return stop;
+  }
+
+  pthread_mutex_lock(&ctx->lock);
+  bool stop = ctx->stop;
+  if (!stop) {
+    ctx->solutions++;
+    size_t k = 0;
+    if (part->branch >= 0) {
+      part->buffer[k++] = part->branch;
+    }
+    memcpy(&part->buffer[k], rows, n*sizeof(int));
+    k += n;
+    qsort(part->buffer, k, sizeof(int), compare_ints);
+    for (size_t i = 0; i < k; i++) {
+      fprintf(opts->out, i == 0 ? "%d" : " %d", part->buffer[i]);
+    }
+    fputc('\n', opts->out);
+    stop = opts->mode == COVER_FIRST || (opts->limit > 0 && ctx->solutions >= opts->limit);
+    __atomic_store_n(&ctx->stop, stop, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&ctx->lock);
+  return stop;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+  int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
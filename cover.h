@@ -0,0 +1,44 @@
+#ifndef __COVER_H__
+#define __COVER_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// A sparse exact cover matrix: row r covers the columns
+// cols[starts[r]] up to cols[starts[r+1]-1], in increasing order.
+// Columns from nprimary on are secondary: a solution covers each
+// primary column exactly once, and each secondary column at most once.
+typedef struct {
+  size_t nrows;
+  size_t ncols;
+  size_t nprimary;
+  size_t *starts;
+  int *cols;
+} cover_matrix;
+
+typedef enum {
+  COVER_FIRST, // Print the first solution
+  COVER_COUNT, // Count the solutions
+  COVER_ALL,   // Print every solution
+} cover_mode;
+
+typedef struct {
+  cover_mode mode;
+  size_t limit;      // Stop after this many solutions, 0 for no limit
+  int threads;
+  double time_limit; // Seconds to search for, 0 for no limit
+  FILE *out;
+} cover_options;
+
+typedef struct {
+  size_t solutions;
+  bool timed_out;
+  double seconds;
+} cover_stats;
+
+bool cover_read(FILE *in, cover_matrix *m);
+void cover_free(cover_matrix *m);
+void cover_solve(const cover_matrix *m, const cover_options *opts, cover_stats *stats);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <errno.h>
+#include "cover.h"
+#include "parallel.h"
+#include "util.h"
+
+// Values for options that only have a long form
+enum {
+  OPT_LIMIT = 256,
+  OPT_THREADS,
+  OPT_TIME,
+};
+
+static void usage(void)
+{
+  printf("Usage: exactcover [options] [FILE]\n\n"
+         "Solve the exact cover problem read from FILE, or stdin. Each line\n"
+         "is a row of the matrix, given as the ids of the columns it covers.\n"
+         "Lines starting with # are skipped. The first line may be a header,\n"
+         "\"columns P S\", for P primary columns numbered from 0 and S\n"
+         "secondary columns numbered from P, which a solution covers at most\n"
+         "once. Solutions are printed one per line, as the rows that make\n"
+         "them up, numbered from 0.\n\n"
+         "Options:\n"
+         "  --first                   Print the first solution (the default)\n"
+         "  --count                   Count the solutions\n"
+         "  --all                     Print every solution\n"
+         "  --limit=NUM               Stop after NUM solutions\n"
+         "  --threads=NUM             Search with NUM threads, which also changes\n"
+         "                            the order --all prints solutions in\n"
+         "  --time=SECS               Give up after SECS seconds\n");
+}
+
+static long parse_number(const char *name, const char *arg, long min)
+{
+  char *end;
+  errno = 0;
+  long val = strtol(arg, &end, 0);
+  if (*end != '\0' || errno == ERANGE || val < min) {
+    fatal("invalid value for %s: %s", name, arg);
+  }
+  return val;
+}
+
+int main(int argc, char **argv)
+{
+  cover_options opts = { COVER_FIRST, 0, 0, 0, stdout };
+  cover_matrix m;
+  cover_stats stats;
+  int c, mode = COVER_FIRST;
+
+  const struct option long_options[] = {
+    { "first",   no_argument,       &mode, COVER_FIRST },
+    { "count",   no_argument,       &mode, COVER_COUNT },
+    { "all",     no_argument,       &mode, COVER_ALL   },
+    { "limit",   required_argument, 0,     OPT_LIMIT   },
+    { "threads", required_argument, 0,     OPT_THREADS },
+    { "time",    required_argument, 0,     OPT_TIME    },
+    { "help",    no_argument,       0,     'h'         },
+    { 0,         0,                 0,     0           },
+  };
+
+  while ((c = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+    switch (c) {
+    case 0:
+      // getopt_long already set the mode
+      break;
+    case OPT_LIMIT:
+      opts.limit = parse_number("limit", optarg, 1);
+      break;
+    case OPT_THREADS:
+      opts.threads = parse_number("threads", optarg, 1);
+      break;
+    case OPT_TIME:
+      opts.time_limit = parse_number("time", optarg, 0);
+      break;
+    case 'h':
+      usage();
+      return 0;
+    default:
+      usage();
+      exit(EXIT_FAILURE);
+    }
+  }
+  opts.mode = mode;
+  if (opts.threads == 0) {
+    opts.threads = parallel_default_threads();
+  }
+
+  FILE *in = stdin;
+  if (optind < argc && (in = fopen(argv[optind], "r")) == NULL) {
+    fatal("unable to open %s", argv[optind]);
+  }
+  if (!cover_read(in, &m)) {
+    exit(EXIT_FAILURE);
+  }
+  if (in != stdin) {
+    fclose(in);
+  }
+
+  cover_solve(&m, &opts, &stats);
+  if (opts.mode == COVER_COUNT) {
+    printf("%zu\n", stats.solutions);
+  }
+  fprintf(stderr, "rows: %zu, columns: %zu (%zu primary), cells: %zu\n",
+          m.nrows, m.ncols, m.nprimary, m.starts[m.nrows]);
+  fprintf(stderr, "solutions: %zu%s, seconds: %.3f\n", stats.solutions,
+          stats.timed_out ? " (timed out)" : "", stats.seconds);
+  cover_free(&m);
+
+  return stats.solutions > 0 ? 0 : 1;
+}
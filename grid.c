@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "util.h"
+#include "grid.h"
+
+// Dispatch to the generator for a grid size. The 9x9 entry wraps the
+// functions in sudoku.c.
+//
+// The generators of every size, sudoku.c's included, check puzzles on
+// the DLX graph of the empty grid made here: a check selects the rows
+// of the puzzle's hints, searches, and unselects them.
+
+static bool generate_9(sudoku_value *puzzle, sudoku_value *solution,
+                       const grid_options *opts, grid_stats *stats);
+static void print_9(const sudoku_value *grid, FILE *fp);
+static void print_line_9(const sudoku_value *grid, FILE *fp);
+
+static const grid_kernel grid_kernel_9 = {
+  9, 3, 3, generate_9, print_9, print_line_9,
+};
+
+static const grid_kernel *const kernels[] = {
+  &grid_kernel_4, &grid_kernel_6, &grid_kernel_9, &grid_kernel_12,
+  &grid_kernel_16, &grid_kernel_25,
+};
+
+// Get the generator for grids of size x size values. Return NULL if
+// the size isn't supported.
+const grid_kernel *grid_kernel_find(int size)
+{
+  for (int i = 0; i < sizeof(kernels)/sizeof(kernels[0]); i++) {
+    if (kernels[i]->size == size) {
+      return kernels[i];
+    }
+  }
+  return NULL;
+}
+
+// Get the character a value is written as: '.' for an empty cell, the
+// digits 1 to 9, and then the letters from A for the values from 10
+char grid_value_char(sudoku_value v)
+{
+  static const char chars[] = ".123456789ABCDEFGHIJKLMNOP";
+  assert(v <= GRID_MAX_SIZE);
+  return chars[v];
+}
+
+// Create a DLX solver for the empty grid of size x size values, with
+// boxes of box_width x box_height. Row size*size*y + size*x + v-1 puts
+// the value v in the cell at x, y, and the columns are laid out as in
+// sudoku_dlx_cells. The matrix is built in its sparse form, four cells
+// to a row, so it takes memory in proportion to its cells rather than
+// to its rows x columns.
+solver *grid_solver_create(int size, int box_width, int box_height)
+{
+  assert(size > 0 && size <= GRID_MAX_SIZE);
+  assert(size % box_width == 0 && size % box_height == 0);
+
+  size_t cells = size*size, nrows = cells*size;
+  size_t *starts = malloc((nrows+1)*sizeof(size_t));
+  int *cols = malloc(4*nrows*sizeof(int));
+  if (starts == NULL || cols == NULL) {
+    fatal("failed to allocate memory for dlx rows");
+  }
+
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      int box = (y/box_height)*(size/box_width) + x/box_width;
+      for (int v = 0; v < size; v++) {
+        size_t row = cells*y + size*x + v;
+        starts[row] = 4*row;
+        cols[4*row] = size*y + x;
+        cols[4*row+1] = cells + size*y + v;
+        cols[4*row+2] = 2*cells + size*x + v;
+        cols[4*row+3] = 3*cells + size*box + v;
+      }
+    }
+  }
+  starts[nrows] = 4*nrows;
+
+  solver *slvr = solver_create(4*nrows, 4*cells, nrows);
+  solver_init_rows(slvr, starts, cols, true);
+  free(starts);
+  free(cols);
+  return slvr;
+}
+
+// Search a solver made by grid_solver_create for the puzzle whose hints
+// are the given nhints rows, which must not conflict. If exclude isn't
+// -1, that row is taken out for the search. The hints are unselected
+// afterwards, leaving the graph ready for the next puzzle. set and size
+// are passed on to solver_run.
+bool grid_solver_run(solver *slvr, const int *hints, int nhints, int exclude,
+                     dlx_mode mode, int *set, size_t size)
+{
+  assert(slvr);
+  assert(hints || nhints == 0);
+
+  for (int i = 0; i < nhints; i++) {
+    solver_select_row(slvr, hints[i]);
+  }
+  if (exclude >= 0) {
+    solver_exclude_row(slvr, exclude);
+  }
+  bool found = solver_run(slvr, mode, set, size);
+  if (exclude >= 0) {
+    solver_include_row(slvr, exclude);
+  }
+  for (int i = nhints-1; i >= 0; i--) {
+    solver_unselect_row(slvr, hints[i]);
+  }
+  return found;
+}
+
+// 9x9 puzzles take milliseconds, so the time limit and threads aren't
+// needed
+static bool generate_9(sudoku_value *puzzle, sudoku_value *solution,
+                       const grid_options *opts, grid_stats *stats)
+{
+  sudoku_options gen_opts;
+  sudoku p, s;
+  memset(&gen_opts, 0, sizeof(gen_opts));
+  gen_opts.extra_hints = opts->extra_hints;
+  memset(stats, 0, sizeof(*stats));
+  sudoku_generate(&p, &s, &gen_opts, &stats->gen);
+  stats->minimal = true;
+  memcpy(puzzle, p.grid, sizeof(p.grid));
+  memcpy(solution, s.grid, sizeof(s.grid));
+  return true;
+}
+
+static void print_9(const sudoku_value *grid, FILE *fp)
+{
+  sudoku s;
+  memcpy(s.grid, grid, sizeof(s.grid));
+  sudoku_print(&s, fp);
+}
+
+static void print_line_9(const sudoku_value *grid, FILE *fp)
+{
+  sudoku s;
+  memcpy(s.grid, grid, sizeof(s.grid));
+  sudoku_print_line(&s, fp);
+}
@@ -0,0 +1,54 @@
+#ifndef __GRID_H__
+#define __GRID_H__
+
+#include <stdio.h>
+#include "sudoku.h"
+#include "solver.h"
+
+// The largest grid size supported, and the number of cells in it.
+// Buffers of this many cells hold a grid of any size.
+#define GRID_MAX_SIZE 25
+#define GRID_MAX_CELLS (GRID_MAX_SIZE*GRID_MAX_SIZE)
+
+typedef struct {
+  int extra_hints;
+  double time_limit; // Seconds to spend on a puzzle, 0 for no limit
+  int threads;       // Threads checking hints for uniqueness
+} grid_options;
+
+typedef struct {
+  sudoku_stats gen; // Uniqueness checks run with DLX and by propagation
+  size_t timeouts;  // DLX checks that took their share of the time limit
+  bool stopped;     // Hints were left unchecked at the time limit
+  bool minimal;     // Every hint left was checked to be needed
+} grid_stats;
+
+// The generator for one grid size. Grids are arrays of size*size
+// values in row major order, with 0 for an empty cell.
+//
+// Each size other than 9x9 is compiled from kernel.c with its
+// dimensions as constants, so the kernels have constant strides and
+// fixed size tables. 9x9 uses sudoku.c.
+typedef struct {
+  int size;       // Values in each row, column and box
+  int box_width;
+  int box_height;
+  bool (*generate)(sudoku_value *puzzle, sudoku_value *solution,
+                   const grid_options *opts, grid_stats *stats);
+  void (*print)(const sudoku_value *grid, FILE *fp);
+  void (*print_line)(const sudoku_value *grid, FILE *fp);
+} grid_kernel;
+
+extern const grid_kernel grid_kernel_4;
+extern const grid_kernel grid_kernel_6;
+extern const grid_kernel grid_kernel_12;
+extern const grid_kernel grid_kernel_16;
+extern const grid_kernel grid_kernel_25;
+
+const grid_kernel *grid_kernel_find(int size);
+char grid_value_char(sudoku_value v);
+solver *grid_solver_create(int size, int box_width, int box_height);
+bool grid_solver_run(solver *slvr, const int *hints, int nhints, int exclude,
+                     dlx_mode mode, int *set, size_t size);
+
+#endif
@@ -0,0 +1,142 @@
+#include <assert.h>
+#include "histogram.h"
+
+// Histograms are recorded into by one thread each, and read by others
+// to report on a run while it goes on. A single writer doesn't need
+// atomic read-modify-write instructions: it loads and stores each
+// counter atomically, so readers never see a torn value, and nothing
+// locks or bounces between threads.
+
+static inline int bucket_index(uint64_t value);
+static inline uint64_t bucket_high(int idx);
+
+// Record a value. Only the thread that owns the histogram may do this.
+void histogram_record(histogram *h, uint64_t value)
+{
+  assert(h);
+
+  histogram_add(&h->counts[bucket_index(value)], 1);
+  histogram_add(&h->count, 1);
+  histogram_add(&h->sum, value);
+  if (value > __atomic_load_n(&h->max, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+  }
+}
+
+// Halve the counts, rounding up, so that the values recorded so far
+// count for half as much as the ones recorded next. A bucket that
+// holds any value keeps at least one. Only the thread that owns the
+// histogram may do this.
+void histogram_halve(histogram *h)
+{
+  assert(h);
+
+  uint64_t count = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    uint64_t c = (h->counts[i] + 1) / 2;
+    __atomic_store_n(&h->counts[i], c, __ATOMIC_RELAXED);
+    count += c;
+  }
+  __atomic_store_n(&h->count, count, __ATOMIC_RELAXED);
+  __atomic_store_n(&h->sum, h->sum / 2, __ATOMIC_RELAXED);
+}
+
+// Add the values recorded in h to total, which should belong to the
+// calling thread. h may be recorded into at the same time, in which
+// case the totals are close to a snapshot.
+void histogram_merge(histogram *total, const histogram *h)
+{
+  assert(total);
+  assert(h);
+
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    total->counts[i] += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+  }
+  total->count += __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+  total->sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+  uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+  if (max > total->max) {
+    total->max = max;
+  }
+}
+
+// Get the value that the given fraction of the values are at or below,
+// rounded up to the top of its bucket. Return 0 for an empty histogram.
+uint64_t histogram_percentile(const histogram *h, double fraction)
+{
+  assert(h);
+  assert(fraction >= 0 && fraction <= 1);
+
+  uint64_t rank = fraction * h->count + 0.5, seen = 0;
+  if (rank < 1) {
+    rank = 1;
+  }
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      uint64_t high = bucket_high(i);
+      return high < h->max ? high : h->max;
+    }
+  }
+  return h->max;
+}
+
+// Count the values at or below value, to within the bucket holding it:
+// a bucket is counted only if its top is at or below value
+uint64_t histogram_count_below(const histogram *h, uint64_t value)
+{
+  assert(h);
+
+  uint64_t count = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS && bucket_high(i) <= value; i++) {
+    count += h->counts[i];
+  }
+  return count;
+}
+
+// Print the column headings for histogram_print
+void histogram_print_header(FILE *fp)
+{
+  assert(fp);
+  fprintf(fp, "%-8s %9s %9s %9s %9s %9s %9s %9s\n", "phase", "count", "mean", "p50",
+          "p90", "p99", "p999", "max");
+}
+
+// Print the count and the mean, percentiles and max in microseconds,
+// of a histogram of nanoseconds
+void histogram_print(const histogram *h, const char *name, FILE *fp)
+{
+  assert(h);
+  assert(name);
+  assert(fp);
+
+  fprintf(fp, "%-8s %9llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", name,
+          (unsigned long long) h->count, h->count ? h->sum / 1e3 / h->count : 0.0,
+          histogram_percentile(h, 0.5) / 1e3, histogram_percentile(h, 0.9) / 1e3,
+          histogram_percentile(h, 0.99) / 1e3, histogram_percentile(h, 0.999) / 1e3,
+          h->max / 1e3);
+}
+
+// Get the bucket of a value. Values below 2*HISTOGRAM_SUB have a
+// bucket each; above that, the bucket is the value's power of two and
+// the HISTOGRAM_SUB_BITS bits after its leading one.
+static inline int bucket_index(uint64_t value)
+{
+  if (value < 2*HISTOGRAM_SUB) {
+    return value;
+  }
+  int exp = 63 - __builtin_clzll(value);
+  return (exp - HISTOGRAM_SUB_BITS + 1)*HISTOGRAM_SUB +
+    (int) (value >> (exp - HISTOGRAM_SUB_BITS)) - HISTOGRAM_SUB;
+}
+
+// Get the largest value that falls in a bucket
+static inline uint64_t bucket_high(int idx)
+{
+  if (idx < 2*HISTOGRAM_SUB) {
+    return idx;
+  }
+  int shift = idx / HISTOGRAM_SUB - 1;
+  uint64_t mantissa = idx % HISTOGRAM_SUB + HISTOGRAM_SUB;
+  return ((mantissa + 1) << shift) - 1;
+}
@@ -0,0 +1,39 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+// A log-linear histogram of durations in nanoseconds: each power of
+// two is split into HISTOGRAM_SUB linear buckets, so a value is known
+// to within 1/HISTOGRAM_SUB of itself, from nanoseconds to centuries.
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1)*HISTOGRAM_SUB)
+
+// Only one thread should record into a histogram, but any thread can
+// read or merge it at the same time.
+typedef struct {
+  uint64_t counts[HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+} histogram;
+
+// Add to a counter that only the calling thread writes, such that
+// other threads can read it at any time
+static inline void histogram_add(uint64_t *counter, uint64_t n)
+{
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n,
+                   __ATOMIC_RELAXED);
+}
+
+void histogram_record(histogram *h, uint64_t value);
+void histogram_halve(histogram *h);
+void histogram_merge(histogram *total, const histogram *h);
+uint64_t histogram_percentile(const histogram *h, double fraction);
+uint64_t histogram_count_below(const histogram *h, uint64_t value);
+void histogram_print_header(FILE *fp);
+void histogram_print(const histogram *h, const char *name, FILE *fp);
+
+#endif
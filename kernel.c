@@ -0,0 +1,551 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "util.h"
+#include "solver.h"
+#include "parallel.h"
+#include "grid.h"
+
+// A generator for one grid size, compiled once for each size by the
+// Makefile with KERNEL_SIZE set. The box dimensions follow from the
+// size, and every stride, mask and table size below is a compile time
+// constant, so the compiler turns the index arithmetic into shifts and
+// multiplies rather than divisions, and each size gets its own fixed
+// size arrays.
+//
+// The generation steps are the same as for 9x9 in sudoku.c: a random
+// solution grid is found with the DLX solver, hints that can be
+// deduced from their row, column and box are removed, and then hints
+// whose removal keeps the solution unique. Like sudoku.c, the searches
+// run on the DLX graph of the empty grid from grid_solver_create, with
+// the hints selected by grid_solver_run. The last step is what makes
+// big grids expensive, so it adds to what sudoku.c does:
+//
+//  - Before running DLX, a hint's removal is checked by propagating
+//    naked and hidden singles, which settles most of them cheaply.
+//  - Hints are checked in parallel batches, one graph per thread. The
+//    threads are started once per puzzle and meet at a barrier between
+//    batches. Each check assumes the rest of the batch stays, so a
+//    hint found to be needed is decided for good, as removing more
+//    hints only adds solutions, but one found removable after an
+//    earlier hint in the batch was removed is checked again.
+//  - Checks stop at the time limit, leaving the hints not yet checked,
+//    so the puzzle is unique but may not be minimal.
+
+#if KERNEL_SIZE == 4
+#define BOX_W 2
+#define BOX_H 2
+#elif KERNEL_SIZE == 6
+#define BOX_W 3
+#define BOX_H 2
+#elif KERNEL_SIZE == 12
+#define BOX_W 4
+#define BOX_H 3
+#elif KERNEL_SIZE == 16
+#define BOX_W 4
+#define BOX_H 4
+#elif KERNEL_SIZE == 25
+#define BOX_W 5
+#define BOX_H 5
+#else
+#error "KERNEL_SIZE should be one of 4, 6, 12, 16 or 25"
+#endif
+
+#define N KERNEL_SIZE
+#define CELLS (N*N)
+#define ALL_VALUES ((kernel_mask) (((1u << N) - 1) << 1))
+
+// Get the index into the grid array, and back
+#define IDX(x, y) ((y)*N + (x))
+#define CELL_X(idx) ((idx)%N)
+#define CELL_Y(idx) ((idx)/N)
+
+// Get the box index given the cell position
+#define BOX(x, y) (((y)/BOX_H)*(N/BOX_W) + (x)/BOX_W)
+
+// The DLX matrix has a row for each value in each cell, numbered as by
+// grid_solver_create
+#define DLX_ROW(v, x, y) (CELLS*(y) + N*(x) + (v))
+#define DLX_X(r) (((r)/N)%N)
+#define DLX_Y(r) ((r)/CELLS)
+#define DLX_V(r) (((r)%N)+1)
+
+// The DLX row for the value in the filled cell at idx
+#define HINT_ROW(st, idx) DLX_ROW((st)->grid[idx] - 1, CELL_X(idx), CELL_Y(idx))
+
+// Name the kernel after its size, e.g. grid_kernel_16
+#define KERNEL_CAT(a, b) a ## b
+#define KERNEL_NAME(a, b) KERNEL_CAT(a, b)
+
+// The most hints checked at once
+#define MAX_BATCH 64
+
+// The share of the time limit one DLX check may take. A check that
+// takes longer keeps its hint, leaving time for the others.
+#define CHECK_SHARE 20
+
+typedef uint32_t kernel_mask;
+
+// The grid with masks of the values used in each row, column and box,
+// as sudoku_state is for 9x9
+typedef struct {
+  sudoku_value grid[CELLS];
+  kernel_mask rows[N];
+  kernel_mask cols[N];
+  kernel_mask boxes[N];
+  int empty;
+} kernel_state;
+
+// How a hint's removal was checked
+typedef enum {
+  CHECK_PROPAGATED, // Singles solve the puzzle without it
+  CHECK_UNIQUE,     // DLX found one solution without it
+  CHECK_MULTIPLE,   // DLX found more than one solution without it
+  CHECK_TIMEOUT,    // DLX gave up at the time limit
+} check_result;
+
+// The hints left to check, checked in parallel batches. Worker 0
+// picks each batch and applies its results, while the other workers
+// wait at the barrier.
+typedef struct {
+  kernel_state *st;
+  solver **solvers;   // A graph of the empty grid for each thread
+  int nthreads;
+  double deadline;    // When to stop checking, or 0 for never
+  double check_limit; // Seconds one check may take, or 0 for no limit
+  pthread_barrier_t barrier;
+  int queue[CELLS];   // The hints to check, in order
+  int n;
+  int pos;            // The first hint of queue not decided yet
+  bool done;          // Set by worker 0 once no batch is left
+  int batch[MAX_BATCH];
+  check_result results[MAX_BATCH];
+  int size;
+  grid_stats *stats;
+} check_batch;
+
+static bool generate(sudoku_value *puzzle, sudoku_value *solution,
+                     const grid_options *opts, grid_stats *stats);
+static void print(const sudoku_value *grid, FILE *fp);
+static void print_line(const sudoku_value *grid, FILE *fp);
+static void state_init(kernel_state *st, const sudoku_value *grid);
+static inline kernel_mask candidates(const kernel_state *st, int idx);
+static inline void place(kernel_state *st, int idx, sudoku_value v);
+static inline sudoku_value remove_value(kernel_state *st, int idx);
+static bool solve(kernel_state *st, solver *slvr);
+static void remove_deduced_hints(kernel_state *st, const int *order);
+static void remove_non_unique_hints(kernel_state *st, const int *order, solver **solvers,
+                                    int nthreads, double deadline, double check_limit,
+                                    grid_stats *stats);
+static void check_worker(int id, void *arg);
+static bool next_batch(check_batch *b);
+static void apply_batch(check_batch *b);
+static check_result check_hint(const kernel_state *st, int idx, solver *slvr,
+                               double deadline);
+static bool propagate(kernel_state *st);
+static void add_extra_hints(kernel_state *st, const sudoku_value *solution, int num);
+
+const grid_kernel KERNEL_NAME(grid_kernel_, KERNEL_SIZE) = {
+  N, BOX_W, BOX_H, generate, print, print_line,
+};
+
+// Generate a puzzle and its solution, following opts. stats is filled
+// in with counters describing the work done. Return false if no
+// solution grid was found within the time limit.
+static bool generate(sudoku_value *puzzle, sudoku_value *solution,
+                     const grid_options *opts, grid_stats *stats)
+{
+  assert(puzzle);
+  assert(solution);
+  assert(opts);
+  assert(stats);
+
+  kernel_state st;
+  int order[CELLS], first_row[N];
+  int nthreads = opts->threads < 1 ? 1 : opts->threads > MAX_BATCH ? MAX_BATCH : opts->threads;
+  double deadline = opts->time_limit > 0 ? get_time() + opts->time_limit : 0;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->gen.attempts = 1;
+  solver *solvers[MAX_BATCH];
+  for (int i = 0; i < nthreads; i++) {
+    solvers[i] = grid_solver_create(N, BOX_W, BOX_H);
+    solver_set_deadline(solvers[i], deadline);
+  }
+
+  // Partially prefill an empty grid with a random first row, to speed
+  // up generation, and solve it
+  memset(solution, 0, CELLS*sizeof(sudoku_value));
+  for (int i = 0; i < N; i++) {
+    first_row[i] = i + 1;
+  }
+  shuffle(first_row, N);
+  for (int i = 0; i < N; i++) {
+    solution[IDX(i, 0)] = first_row[i];
+  }
+  state_init(&st, solution);
+  bool solved = solve(&st, solvers[0]);
+  if (solved) {
+    memcpy(solution, st.grid, sizeof(st.grid));
+
+    // Go through the hints in random order, removing the ones that can
+    // be deduced and then the ones that aren't needed for uniqueness
+    for (int i = 0; i < CELLS; i++) {
+      order[i] = i;
+    }
+    shuffle(order, CELLS);
+    remove_deduced_hints(&st, order);
+    remove_non_unique_hints(&st, order, solvers, nthreads, deadline,
+                            opts->time_limit / CHECK_SHARE, stats);
+    add_extra_hints(&st, solution, opts->extra_hints);
+    memcpy(puzzle, st.grid, sizeof(st.grid));
+  }
+
+  for (int i = 0; i < nthreads; i++) {
+    solver_destroy(solvers[i]);
+  }
+  return solved;
+}
+
+// Print the grid with its boxes marked out, in the format sudoku_print
+// uses for 9x9
+static void print(const sudoku_value *grid, FILE *fp)
+{
+  assert(grid);
+  assert(fp);
+
+  for (int y = 0; y < N; y++) {
+    if (y % BOX_H == 0 && y != 0) {
+      for (int b = 0; b < N/BOX_W; b++) {
+        int dashes = 2*BOX_W + (b != 0 && b != N/BOX_W - 1);
+        if (b != 0) {
+          fputc('+', fp);
+        }
+        for (int i = 0; i < dashes; i++) {
+          fputc('-', fp);
+        }
+      }
+      fputc('\n', fp);
+    }
+    for (int x = 0; x < N; x++) {
+      if (x % BOX_W == 0 && x != 0) {
+        fprintf(fp, "| ");
+      }
+      fprintf(fp, "%c ", grid_value_char(grid[IDX(x, y)]));
+    }
+    fprintf(fp, "\n");
+  }
+}
+
+// Print the grid on a single line, one character per cell in row major
+// order, with '.' for empty cells
+static void print_line(const sudoku_value *grid, FILE *fp)
+{
+  assert(grid);
+  assert(fp);
+
+  char line[CELLS+2];
+  for (int i = 0; i < CELLS; i++) {
+    line[i] = grid_value_char(grid[i]);
+  }
+  line[CELLS] = '\n';
+  line[CELLS+1] = '\0';
+  fputs(line, fp);
+}
+
+// Set up the masks for the values in the grid, which shouldn't
+// conflict
+static void state_init(kernel_state *st, const sudoku_value *grid)
+{
+  memset(st, 0, sizeof(*st));
+  st->empty = CELLS;
+  for (int i = 0; i < CELLS; i++) {
+    if (grid[i] != 0) {
+      place(st, i, grid[i]);
+    }
+  }
+}
+
+// Get the values that aren't used in the row, column or box of the
+// empty cell at idx
+static inline kernel_mask candidates(const kernel_state *st, int idx)
+{
+  int x = CELL_X(idx), y = CELL_Y(idx);
+  return ~(st->rows[y] | st->cols[x] | st->boxes[BOX(x, y)]) & ALL_VALUES;
+}
+
+// Put the value v in the empty cell at idx
+static inline void place(kernel_state *st, int idx, sudoku_value v)
+{
+  int x = CELL_X(idx), y = CELL_Y(idx);
+  kernel_mask bit = (kernel_mask) 1 << v;
+  st->grid[idx] = v;
+  st->rows[y] |= bit;
+  st->cols[x] |= bit;
+  st->boxes[BOX(x, y)] |= bit;
+  st->empty--;
+}
+
+// Empty the filled cell at idx, returning its value
+static inline sudoku_value remove_value(kernel_state *st, int idx)
+{
+  int x = CELL_X(idx), y = CELL_Y(idx);
+  sudoku_value v = st->grid[idx];
+  kernel_mask bit = (kernel_mask) 1 << v;
+  st->grid[idx] = 0;
+  st->rows[y] &= ~bit;
+  st->cols[x] &= ~bit;
+  st->boxes[BOX(x, y)] &= ~bit;
+  st->empty++;
+  return v;
+}
+
+// Fill in the grid with a random solution, using a solver for the
+// empty grid. Return false if there is none, or the solver gave up at
+// its deadline.
+static bool solve(kernel_state *st, solver *slvr)
+{
+  int hints[CELLS], set[CELLS+1];
+  int nhints = 0;
+  for (int i = 0; i < CELLS; i++) {
+    if (st->grid[i] != 0) {
+      hints[nhints++] = HINT_ROW(st, i);
+    }
+  }
+
+  bool solved = grid_solver_run(slvr, hints, nhints, -1, DLX_RANDOM, set, CELLS+1);
+  if (solved) {
+    for (int i = 0; i < CELLS && set[i] != -1; i++) {
+      int r = set[i];
+      place(st, IDX(DLX_X(r), DLX_Y(r)), DLX_V(r));
+    }
+  }
+  return solved;
+}
+
+// From a completely solved grid, remove the hints, in the given order,
+// that are the only value left for their cell once removed
+static void remove_deduced_hints(kernel_state *st, const int *order)
+{
+  for (int i = 0; i < CELLS; i++) {
+    int idx = order[i];
+    sudoku_value v = remove_value(st, idx);
+    if (candidates(st, idx) != ((kernel_mask) 1 << v)) {
+      place(st, idx, v);
+    }
+  }
+}
+
+// Remove the hints, in the given order, whose removal leaves the
+// puzzle with a unique solution, checking batches of nthreads hints at
+// a time with the given solvers. The result is the same as checking
+// them one by one, whatever the number of threads. Stop at the
+// deadline, and give up on a DLX check after check_limit seconds,
+// unless they are 0.
+static void remove_non_unique_hints(kernel_state *st, const int *order, solver **solvers,
+                                    int nthreads, double deadline, double check_limit,
+                                    grid_stats *stats)
+{
+  check_batch b;
+  b.st = st;
+  b.solvers = solvers;
+  b.nthreads = nthreads;
+  b.deadline = deadline;
+  b.check_limit = check_limit;
+  b.n = 0;
+  b.pos = 0;
+  b.done = false;
+  b.stats = stats;
+  for (int i = 0; i < CELLS; i++) {
+    if (st->grid[order[i]] != 0) {
+      b.queue[b.n++] = order[i];
+    }
+  }
+
+  pthread_barrier_init(&b.barrier, NULL, nthreads);
+  parallel_run(nthreads, check_worker, &b);
+  pthread_barrier_destroy(&b.barrier);
+
+  // Checks cut short by the deadline count as stopping there too
+  stats->stopped = b.pos < b.n ||
+    (stats->timeouts > 0 && deadline != 0 && get_time() >= deadline);
+  stats->minimal = !stats->stopped && stats->timeouts == 0;
+}
+
+// Check the hints of each batch, each thread taking every nthreads'th,
+// until worker 0 finds no batch left
+static void check_worker(int id, void *arg)
+{
+  check_batch *b = arg;
+  for (;;) {
+    if (id == 0) {
+      b->done = !next_batch(b);
+    }
+    pthread_barrier_wait(&b->barrier);
+    if (b->done) {
+      break;
+    }
+
+    for (int i = id; i < b->size; i += b->nthreads) {
+      double deadline = b->deadline;
+      if (b->check_limit > 0 && (deadline == 0 || get_time() + b->check_limit < deadline)) {
+        deadline = get_time() + b->check_limit;
+      }
+      b->results[i] = check_hint(b->st, b->batch[i], b->solvers[id], deadline);
+    }
+    pthread_barrier_wait(&b->barrier);
+
+    if (id == 0) {
+      apply_batch(b);
+    }
+  }
+}
+
+// Take the next batch of hints from the queue. Return false if there is
+// none left or the deadline has passed.
+static bool next_batch(check_batch *b)
+{
+  if (b->pos >= b->n || (b->deadline != 0 && get_time() >= b->deadline)) {
+    return false;
+  }
+  b->size = b->n - b->pos < b->nthreads ? b->n - b->pos : b->nthreads;
+  memcpy(b->batch, &b->queue[b->pos], b->size*sizeof(int));
+  return true;
+}
+
+// Remove the hints the batch found not to be needed. Only the first
+// removal in the batch is sure to be right, as the later checks assumed
+// it would stay. Hints that turned out to be needed stay needed, so
+// only later removable ones are checked again, ahead of the rest of
+// the queue.
+static void apply_batch(check_batch *b)
+{
+  bool removed = false;
+  int retry = 0;
+  for (int i = 0; i < b->size; i++) {
+    check_result r = b->results[i];
+    b->stats->gen.probes += r != CHECK_PROPAGATED;
+    b->stats->gen.propagations++;
+    b->stats->timeouts += r == CHECK_TIMEOUT;
+    if (r == CHECK_PROPAGATED || r == CHECK_UNIQUE) {
+      if (!removed) {
+        remove_value(b->st, b->batch[i]);
+        removed = true;
+      } else {
+        b->batch[retry++] = b->batch[i];
+      }
+    }
+  }
+  b->pos += b->size - retry;
+  memcpy(&b->queue[b->pos], b->batch, retry*sizeof(int));
+}
+
+// Check whether the puzzle is still unique without the hint at idx:
+// first by propagating singles, and if that doesn't solve it, by
+// searching the graph of the empty grid with the other hints selected.
+// The search gives up at deadline, if it isn't 0.
+static check_result check_hint(const kernel_state *st, int idx, solver *slvr,
+                               double deadline)
+{
+  kernel_state copy = *st;
+  remove_value(&copy, idx);
+  if (propagate(&copy)) {
+    return CHECK_PROPAGATED;
+  }
+
+  // The puzzle has one solution with the hint, so any other solution
+  // without it has a different value in its cell. Excluding the hint's
+  // row, a search for the first solution settles it.
+  int hints[CELLS], set[CELLS+1];
+  int nhints = 0;
+  for (int i = 0; i < CELLS; i++) {
+    if (st->grid[i] != 0 && i != idx) {
+      hints[nhints++] = HINT_ROW(st, i);
+    }
+  }
+  solver_set_deadline(slvr, deadline);
+  bool unique = !grid_solver_run(slvr, hints, nhints, HINT_ROW(st, idx), DLX_FIRST, set,
+                                 CELLS+1);
+  bool timed_out = solver_timed_out(slvr);
+
+  return timed_out ? CHECK_TIMEOUT : unique ? CHECK_UNIQUE : CHECK_MULTIPLE;
+}
+
+// Fill in naked singles (cells with one candidate) and hidden singles
+// (values with one place in a row, column or box) until none are left.
+// Return true if that solves the grid.
+static bool propagate(kernel_state *st)
+{
+  bool changed = true;
+  while (changed && st->empty > 0) {
+    changed = false;
+    for (int i = 0; i < CELLS; i++) {
+      if (st->grid[i] == 0) {
+        kernel_mask c = candidates(st, i);
+        if (c == 0) {
+          return false;
+        } else if ((c & (c-1)) == 0) {
+          place(st, i, __builtin_ctz(c));
+          changed = true;
+        }
+      }
+    }
+
+    // Unit u is row u, column u-N or box u-2N
+    for (int u = 0; u < 3*N; u++) {
+      int cells[N];
+      for (int j = 0; j < N; j++) {
+        int k = u % N;
+        cells[j] = u < N ? IDX(j, k) : u < 2*N ? IDX(k, j) :
+          IDX((k % (N/BOX_W))*BOX_W + j % BOX_W, (k / (N/BOX_W))*BOX_H + j / BOX_W);
+      }
+      kernel_mask once = 0, twice = 0, placed = 0;
+      for (int j = 0; j < N; j++) {
+        if (st->grid[cells[j]] != 0) {
+          placed |= (kernel_mask) 1 << st->grid[cells[j]];
+        } else {
+          kernel_mask c = candidates(st, cells[j]);
+          twice |= once & c;
+          once |= c;
+        }
+      }
+      if ((once | placed) != ALL_VALUES) {
+        return false;
+      }
+      kernel_mask hidden = once & ~twice & ~placed;
+      for (int j = 0; j < N && hidden != 0; j++) {
+        if (st->grid[cells[j]] == 0) {
+          kernel_mask c = candidates(st, cells[j]) & hidden;
+          if (c != 0) {
+            sudoku_value v = __builtin_ctz(c);
+            place(st, cells[j], v);
+            hidden &= ~((kernel_mask) 1 << v);
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+  return st->empty == 0;
+}
+
+// Copy num hints from the solution into random empty cells to make
+// the puzzle easier
+static void add_extra_hints(kernel_state *st, const sudoku_value *solution, int num)
+{
+  int empty[CELLS];
+  int num_empty = 0;
+  for (int i = 0; i < CELLS; i++) {
+    if (st->grid[i] == 0) {
+      empty[num_empty++] = i;
+    }
+  }
+  shuffle(empty, num_empty);
+
+  for (int i = 0; i < num_empty && i < num; i++) {
+    place(st, empty[i], solution[empty[i]]);
+  }
+}
@@ -0,0 +1,264 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "util.h"
+#include "parallel.h"
+#include "lowclue.h"
+
+// Local search for puzzles with few clues. A greedy pass of
+// sudoku_generate stops at a minimal puzzle, which is usually far
+// from the smallest puzzle for its solution grid. Each walker starts
+// from a minimal puzzle and swaps clues around: a {-1,+1} move trades
+// a clue for a different cell of the same solution, which keeps the
+// clue count but may open up further removals, and a {-2,+1} move
+// trades two clues for one. Moves that keep the puzzle unique are
+// accepted, and then the puzzle is minimized again.
+//
+// The walkers run on their own threads and share the best puzzles
+// found through an elite pool. A walker that stops making progress
+// restarts from either a pooled puzzle or a freshly generated one.
+
+// Number of moves without improvement before a walker restarts
+#define STALL_LIMIT 200
+
+typedef struct {
+  pthread_mutex_t lock;
+  lowclue_result *entries;
+  size_t size;
+  size_t capacity;
+} elite_pool;
+
+typedef struct {
+  const lowclue_options *opts;
+  elite_pool pool;
+  double deadline;
+  int stop;
+  lowclue_stats *stats; // One per walker
+} search_ctx;
+
+static void walk(int id, void *arg);
+static bool probe(sudoku_checker *checker, sudoku *s, lowclue_stats *stats);
+static void minimize(sudoku_checker *checker, sudoku *s, lowclue_stats *stats);
+static void swap_clues(sudoku *s, sudoku *solution, int remove);
+static void pool_offer(search_ctx *ctx, sudoku *puzzle, sudoku *solution, int hints);
+static bool pool_sample(elite_pool *pool, sudoku *puzzle, sudoku *solution);
+static bool pool_done(search_ctx *ctx);
+static int compare_results(const void *a, const void *b);
+
+// Search for puzzles with at most opts->target clues until opts->count
+// of them are found or the time limit runs out. The results array
+// should have room for opts->count puzzles, and is filled with the
+// best puzzles found sorted by clue count. Return the number of
+// results.
+size_t lowclue_search(const lowclue_options *opts, lowclue_result *results,
+                      lowclue_stats *stats)
+{
+  assert(opts);
+  assert(results);
+  assert(opts->count > 0);
+
+  search_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.opts = opts;
+  ctx.deadline = get_time() + opts->time_limit;
+  ctx.pool.entries = results;
+  ctx.pool.capacity = opts->count;
+  pthread_mutex_init(&ctx.pool.lock, NULL);
+  if ((ctx.stats = calloc(opts->threads, sizeof(lowclue_stats))) == NULL) {
+    fatal("failed to allocate memory for search stats");
+  }
+
+  parallel_run(opts->threads, walk, &ctx);
+
+  if (stats != NULL) {
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < opts->threads; i++) {
+      stats->moves += ctx.stats[i].moves;
+      stats->accepted += ctx.stats[i].accepted;
+      stats->restarts += ctx.stats[i].restarts;
+      stats->probes += ctx.stats[i].probes;
+    }
+  }
+
+  pthread_mutex_destroy(&ctx.pool.lock);
+  free(ctx.stats);
+  qsort(results, ctx.pool.size, sizeof(lowclue_result), compare_results);
+  return ctx.pool.size;
+}
+
+// Run a single walker until the search is over
+static void walk(int id, void *arg)
+{
+  search_ctx *ctx = arg;
+  lowclue_stats *stats = &ctx->stats[id];
+  sudoku_options gen_opts = { 0, SYMMETRY_NONE };
+  sudoku puzzle, solution, candidate;
+
+  rng_seed(ctx->opts->seed + id);
+  sudoku_checker *checker = sudoku_checker_create();
+
+  while (!__atomic_load_n(&ctx->stop, __ATOMIC_RELAXED) && get_time() < ctx->deadline) {
+    // Start over from a pooled puzzle half of the time, so the walkers
+    // concentrate on the most promising solution grids
+    stats->restarts++;
+    if (rng_int(2) == 0 || !pool_sample(&ctx->pool, &puzzle, &solution)) {
+      sudoku_generate(&puzzle, &solution, &gen_opts, NULL);
+    }
+    int hints = sudoku_count_hints(&puzzle);
+    pool_offer(ctx, &puzzle, &solution, hints);
+
+    int stalled = 0;
+    while (stalled < STALL_LIMIT && get_time() < ctx->deadline &&
+           !__atomic_load_n(&ctx->stop, __ATOMIC_RELAXED)) {
+      memcpy(&candidate, &puzzle, sizeof(sudoku));
+      swap_clues(&candidate, &solution, hints > 1 && rng_int(2) == 0 ? 2 : 1);
+      stats->moves++;
+      if (!probe(checker, &candidate, stats)) {
+        stalled++;
+        continue;
+      }
+
+      stats->accepted++;
+      minimize(checker, &candidate, stats);
+      int candidate_hints = sudoku_count_hints(&candidate);
+      if (candidate_hints < hints) {
+        stalled = 0;
+        pool_offer(ctx, &candidate, &solution, candidate_hints);
+      } else {
+        stalled++;
+      }
+      memcpy(&puzzle, &candidate, sizeof(sudoku));
+      hints = candidate_hints;
+    }
+  }
+
+  sudoku_checker_destroy(checker);
+}
+
+static bool probe(sudoku_checker *checker, sudoku *s, lowclue_stats *stats)
+{
+  stats->probes++;
+  return sudoku_checker_unique(checker, s);
+}
+
+// Remove every clue that the puzzle stays unique without, trying the
+// clues in random order
+static void minimize(sudoku_checker *checker, sudoku *s, lowclue_stats *stats)
+{
+  int order[GRID_SIZE];
+  for (int i = 0; i < GRID_SIZE; i++) {
+    order[i] = i;
+  }
+  shuffle(order, GRID_SIZE);
+
+  for (int i = 0; i < GRID_SIZE; i++) {
+    sudoku_value v = s->grid[order[i]];
+    if (v != 0) {
+      s->grid[order[i]] = 0;
+      if (!probe(checker, s, stats)) {
+        s->grid[order[i]] = v;
+      }
+    }
+  }
+}
+
+// Take remove random clues out of the puzzle and put in one random
+// cell of the solution that wasn't a clue
+static void swap_clues(sudoku *s, sudoku *solution, int remove)
+{
+  int clues[GRID_SIZE], empty[GRID_SIZE];
+  int nclues = 0, nempty = 0;
+  for (int i = 0; i < GRID_SIZE; i++) {
+    if (s->grid[i] != 0) {
+      clues[nclues++] = i;
+    } else {
+      empty[nempty++] = i;
+    }
+  }
+
+  if (nempty > 0) {
+    int add = empty[rng_int(nempty)];
+    s->grid[add] = solution->grid[add];
+  }
+  for (int i = 0; i < remove && nclues > 0; i++) {
+    int j = rng_int(nclues);
+    s->grid[clues[j]] = 0;
+    clues[j] = clues[--nclues];
+  }
+}
+
+// Add a puzzle to the elite pool if it is better than the worst
+// puzzle in the pool, and stop the search once the pool is full of
+// puzzles at the target
+static void pool_offer(search_ctx *ctx, sudoku *puzzle, sudoku *solution, int hints)
+{
+  elite_pool *pool = &ctx->pool;
+  pthread_mutex_lock(&pool->lock);
+
+  size_t worst = 0;
+  bool duplicate = false;
+  for (size_t i = 0; i < pool->size; i++) {
+    duplicate = duplicate || memcmp(&pool->entries[i].puzzle, puzzle, sizeof(sudoku)) == 0;
+    if (pool->entries[i].hints > pool->entries[worst].hints) {
+      worst = i;
+    }
+  }
+
+  lowclue_result *entry = NULL;
+  if (duplicate) {
+    entry = NULL;
+  } else if (pool->size < pool->capacity) {
+    entry = &pool->entries[pool->size++];
+  } else if (hints < pool->entries[worst].hints) {
+    entry = &pool->entries[worst];
+  }
+  if (entry != NULL) {
+    memcpy(&entry->puzzle, puzzle, sizeof(sudoku));
+    memcpy(&entry->solution, solution, sizeof(sudoku));
+    entry->hints = hints;
+    if (pool_done(ctx)) {
+      __atomic_store_n(&ctx->stop, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// Copy a random puzzle out of the elite pool. Return false if the pool
+// is empty.
+static bool pool_sample(elite_pool *pool, sudoku *puzzle, sudoku *solution)
+{
+  pthread_mutex_lock(&pool->lock);
+  bool found = pool->size > 0;
+  if (found) {
+    lowclue_result *entry = &pool->entries[rng_int(pool->size)];
+    memcpy(puzzle, &entry->puzzle, sizeof(sudoku));
+    memcpy(solution, &entry->solution, sizeof(sudoku));
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return found;
+}
+
+// Check whether every puzzle in a full pool is at the target. The
+// pool lock should be held.
+static bool pool_done(search_ctx *ctx)
+{
+  elite_pool *pool = &ctx->pool;
+  if (pool->size < pool->capacity) {
+    return false;
+  }
+  for (size_t i = 0; i < pool->size; i++) {
+    if (pool->entries[i].hints > ctx->opts->target) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int compare_results(const void *a, const void *b)
+{
+  return ((const lowclue_result *) a)->hints - ((const lowclue_result *) b)->hints;
+}
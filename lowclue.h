@@ -0,0 +1,31 @@
+#ifndef __LOWCLUE_H__
+#define __LOWCLUE_H__
+
+#include <stddef.h>
+#include "sudoku.h"
+
+typedef struct {
+  int target;        // Clue count to search for
+  double time_limit; // Seconds to search for
+  int threads;       // Number of independent walkers
+  size_t count;      // Number of puzzles at the target to stop after
+  unsigned int seed;
+} lowclue_options;
+
+typedef struct {
+  sudoku puzzle;
+  sudoku solution;
+  int hints;
+} lowclue_result;
+
+typedef struct {
+  size_t moves;    // Clue swaps tried
+  size_t accepted; // Clue swaps that kept the puzzle unique
+  size_t restarts; // Walks started from a new or pooled puzzle
+  size_t probes;   // Uniqueness checks
+} lowclue_stats;
+
+size_t lowclue_search(const lowclue_options *opts, lowclue_result *results,
+                      lowclue_stats *stats);
+
+#endif
@@ -4,38 +4,946 @@
 #include <getopt.h>
 #include <errno.h>
 #include <limits.h>
+#include <string.h>
 #include "sudoku.h"
+#include "lowclue.h"
+#include "pattern.h"
+#include "rate.h"
+#include "batch.h"
+#include "audit.h"
+#include "play.h"
+#include "grid.h"
+#include "portfolio.h"
+#include "perf.h"
+#include "trace.h"
+#include "metrics.h"
+#include "slowlog.h"
+#include "corpus.h"
+#include "rank.h"
+#include "seedindex.h"
+#include "parallel.h"
 #include "util.h"
 
+// Values for options that only have a long form
+enum {
+  OPT_SYMMETRY = 256,
+  OPT_TARGET,
+  OPT_TIME,
+  OPT_THREADS,
+  OPT_COUNT,
+  OPT_PATTERN,
+  OPT_DIFFICULTY,
+  OPT_AUDIT,
+  OPT_SIZE,
+  OPT_SOLVE,
+  OPT_STATS,
+  OPT_TRACE,
+  OPT_METRICS_FILE,
+  OPT_METRICS_INTERVAL,
+  OPT_SLOW_LOG,
+  OPT_SLOW_MS,
+  OPT_REPLAY,
+  OPT_MAKE_CORPUS,
+  OPT_RANK,
+  OPT_UNRANK,
+  OPT_INDEX_SEEDS,
+  OPT_SHARD,
+  OPT_CLUES,
+};
+
+// Formats of the --stats output
+typedef enum {
+  STATS_NONE,
+  STATS_TEXT,
+  STATS_JSON,
+} stats_format;
+
 static void usage(void)
 {
   printf("Usage: gensudoku [options]\n\n"
          "Options:\n"
          "  -s SEED, --seed=SEED      Use a specific seed\n"
          "  -a NUM, --add-hints=NUM   Add NUM extra hints to the puzzle\n"
+         "  --symmetry=SYM            Make the clue layout symmetric, where SYM is\n"
+         "                            one of rot180, rot90, diag or mirror, or\n"
+         "                            none (the default)\n"
+         "  --difficulty=MIN[..MAX]   Only generate puzzles whose difficulty is in\n"
+         "                            the range, see below, trying new grids for\n"
+         "                            up to --time seconds (default 10)\n"
+         "  --singles-only            Only generate puzzles that can be solved with\n"
+         "                            naked and hidden singles\n"
+         "  --size=N                  Generate an NxN puzzle, where N is one of 4, 6,\n"
+         "                            9 (the default), 12, 16 or 25. Sizes other\n"
+         "                            than 9 only support --add-hints, --solution,\n"
+         "                            --probes, --threads and --time, which limits\n"
+         "                            the seconds spent removing hints\n"
+         "  --size-benchmark          Generate --count puzzles (default 3) of each\n"
+         "                            size and print the seconds per puzzle\n"
+         "  --probes                  Print the number of uniqueness checks run, or\n"
+         "                            of propagation checks with --singles-only\n"
          "  --solution                Print the solution\n"
+         "  --count=NUM               Generate NUM puzzles, printing one per line,\n"
+         "                            where puzzle i uses the seed SEED+i\n"
+         "  --stats[=FORMAT]          Print the work done generating to stderr:\n"
+         "                            probes, probes avoided by deduction, and the\n"
+         "                            DLX search counters. FORMAT is text (the\n"
+         "                            default) or json\n"
+         "  --timings                 Print percentiles of the time taken by each\n"
+         "                            phase of generation to stderr. With --count,\n"
+         "                            they are also printed on SIGUSR1\n"
+         "  --perf-counters           Count cycles, instructions, cache misses,\n"
+         "                            branch misses and LLC loads while building\n"
+         "                            DLX graphs, searching them and minimizing,\n"
+         "                            and print them to stderr. Without access to\n"
+         "                            the counters, only the time is printed\n"
+         "  --trace=FILE              Write the time spent on each puzzle, phase,\n"
+         "                            uniqueness probe and wait to write output to\n"
+         "                            FILE, in the Chrome trace event format. With\n"
+         "                            --solve, each puzzle and backend run is traced\n"
+         "  --metrics-file=PATH       With --count or --solve, keep PATH updated with\n"
+         "                            counters, queue depths, phase time histograms\n"
+         "                            and memory use, in the Prometheus text format\n"
+         "  --metrics-interval=S      Rewrite the metrics file every S seconds\n"
+         "                            (default 10)\n"
+         "  --slow-log=FILE           Append a record of each generation or solve\n"
+         "                            that takes longer than --slow-ms to FILE\n"
+         "  --slow-ms=MS              Threshold of the slow log (default 100)\n"
+         "  --replay=RECORD           Redo the work of a slow log record, --count\n"
+         "                            times (default 1), and compare the result\n"
+         "\n"
+         "Benchmark corpus:\n"
+         "  --make-corpus=DIR         Write --count puzzles (default 100) of each\n"
+         "                            set, easy, minimal, lowclue, near-empty,\n"
+         "                            invalid and unsolvable, to DIR as SET.txt and\n"
+         "                            SET.bin. They are made from the seeds from\n"
+         "                            --seed (default 1) on, whatever --threads is\n"
+         "\n"
+         "Solution grid ranks:\n"
+         "  --rank[=FORMAT]           Print the rank of each solution grid read from\n"
+         "                            stdin, one per line or in the binary corpus\n"
+         "                            format. FORMAT is text (the default), for a\n"
+         "                            decimal rank per line, or binary, for 10 bytes\n"
+         "                            per rank\n"
+         "  --unrank[=FORMAT]         Print the solution grid of each rank read from\n"
+         "                            stdin, in the FORMAT --rank writes\n"
+         "  --random-grids            Print --count (default 1) uniformly random\n"
+         "                            solution grids, one per line\n"
+         "\n"
+         "Seed index:\n"
+         "  --index-seeds=FILE        Generate the puzzles of --count seeds from\n"
+         "                            --seed (default 1) on, with the other options\n"
+         "                            given, and write the clues, difficulty and\n"
+         "                            generation time of each to FILE\n"
+         "  --shard=K/N               Only index the Kth of N equal parts of the\n"
+         "                            seeds, counting from 0\n"
+         "  --lookup                  Print the seeds of the index files given after\n"
+         "                            the options that match --clues and\n"
+         "                            --difficulty, at most --count of them\n"
+         "  --clues=MIN[..MAX]        Range of clues to look up\n"
+         "  --regenerate              With --lookup, generate each seed's puzzle\n"
+         "                            again and print it\n"
+         "\n"
+         "Corpus audit:\n"
+         "  --audit[=CHECK]           Check the puzzles read from stdin, one per line.\n"
+         "                            CHECK is unique, to check that each puzzle has\n"
+         "                            one solution, or minimal (the default), to also\n"
+         "                            list the hints each puzzle can do without\n"
+         "\n"
+         "Interactive play:\n"
+         "  --play                    Read a puzzle from the first line of stdin, then\n"
+         "                            one move per line: rRcC=V places V at row R and\n"
+         "                            column C, and rRcC=0 erases it. Each move is\n"
+         "                            checked for conflicts, and the grid for\n"
+         "                            agreeing with the solution and being solvable\n"
+         "\n"
+         "Solving:\n"
+         "  --solve[=STRATEGY]        Solve the puzzles read from stdin, one per line\n"
+         "                            or in the binary corpus format,\n"
+         "                            and print the solve times. STRATEGY is dlx,\n"
+         "                            bitset or singles to use one solver, race to\n"
+         "                            run them all at once and take the first answer,\n"
+         "                            or learn (the default) to run the one that has\n"
+         "                            had the lowest p99 time on similar puzzles\n"
+         "\n"
+         "Difficulty rating:\n"
+         "  --rate                    Rate the puzzles read from stdin, one per line\n"
+         "  --steps                   Print the logical steps that solve the puzzles\n"
+         "                            read from stdin, one per line\n"
+         "\n"
+         "  Difficulties are named by the hardest technique needed: 1 singles,\n"
+         "  2 locked, 3 subsets, 4 fish, 5 chains or 6 guess.\n"
+         "\n"
+         "Low clue search:\n"
+         "  --search                  Search for puzzles with few clues by swapping\n"
+         "                            clues, printing one puzzle per line\n"
+         "  --target=NUM              Clue count to search for (default 22)\n"
+         "\n"
+         "Pattern generation:\n"
+         "  --pattern=FILE            Generate puzzles with clues exactly on the\n"
+         "                            cells marked in FILE, printing one per line\n"
+         "\n"
+         "Search options:\n"
+         "  --time=SECONDS            Time to search for (default 10)\n"
+         "  --count=NUM               Number of puzzles to find (default 10 for\n"
+         "                            --search, 1 for --pattern)\n"
+         "  --threads=NUM             Number of threads for searches, --count and\n"
+         "                            --audit\n"
+         "                            (default: one per CPU)\n"
+         "  --pin                     Keep each thread on a CPU of its own\n"
+         "  --numa                    Deal the threads out to the NUMA nodes in turn,\n"
+         "                            keeping each on its node's CPUs and memory,\n"
+         "                            with the work handed out per node. It does\n"
+         "                            nothing on a machine with one node\n"
          );
 }
 
+// Parse a number from an option argument, exiting with a message if
+// it isn't a valid number of at least min
+static long parse_number(const char *name, const char *arg, long min)
+{
+  char *end;
+  errno = 0;
+  long val = strtol(arg, &end, 0);
+  if (*end != '\0' || errno == ERANGE || val < min) {
+    fatal("invalid value for %s: %s", name, arg);
+  }
+  return val;
+}
+
+// Search for low clue puzzles and print them one per line, preceded
+// by their clue count
+static void run_search(const lowclue_options *opts)
+{
+  lowclue_result *results = calloc(opts->count, sizeof(lowclue_result));
+  lowclue_stats stats;
+  if (results == NULL) {
+    fatal("failed to allocate memory for search results");
+  }
+
+  double start = get_time();
+  size_t n = lowclue_search(opts, results, &stats);
+  double elapsed = get_time() - start;
+  for (size_t i = 0; i < n; i++) {
+    printf("%d ", results[i].hints);
+    sudoku_print_line(&results[i].puzzle, stdout);
+  }
+  warn("%zu moves (%.0f/s), %zu accepted, %zu restarts, %zu probes in %.1fs",
+       stats.moves, stats.moves / elapsed, stats.accepted, stats.restarts,
+       stats.probes, elapsed);
+
+  free(results);
+}
+
+// Generate puzzles that fit the pattern and print them one per line
+static void run_pattern(const sudoku_pattern *pattern, const pattern_options *opts)
+{
+  int clues = 0;
+  for (int i = 0; i < GRID_SIZE; i++) {
+    clues += pattern->clue[i];
+  }
+  if (clues < 17) {
+    fatal("pattern has %d clues, no sudoku is unique with fewer than 17", clues);
+  }
+
+  sudoku *puzzles = calloc(opts->count, sizeof(sudoku));
+  pattern_stats stats;
+  if (puzzles == NULL) {
+    fatal("failed to allocate memory for pattern puzzles");
+  }
+
+  double start = get_time();
+  size_t n = pattern_search(pattern, opts, puzzles, &stats);
+  double elapsed = get_time() - start;
+  for (size_t i = 0; i < n; i++) {
+    sudoku_print_line(&puzzles[i], stdout);
+  }
+  warn("%zu trials (%.0f/s), %zu filtered, %zu probes, %zu unique "
+       "(%.4f%% success) in %.1fs",
+       stats.trials, stats.trials / elapsed, stats.filtered, stats.probes,
+       stats.found, stats.trials ? 100.0 * stats.found / stats.trials : 0.0,
+       elapsed);
+  if (n < opts->count) {
+    warn("found %zu of %zu puzzles before the time limit", n, opts->count);
+  }
+
+  free(puzzles);
+}
+
+// Print a solver's counters, as text or as the members of a JSON object
+static void print_solver_stats(const char *name, const solver_stats *stats,
+                               stats_format format, FILE *fp)
+{
+  if (format == STATS_JSON) {
+    fprintf(fp, "\"%s\":{\"runs\":%zu,\"nodes\":%zu,\"backtracks\":%zu,"
+            "\"max_depth\":%zu,\"links\":%zu,\"solutions\":%zu}", name, stats->runs,
+            stats->nodes, stats->backtracks, stats->max_depth, stats->links,
+            stats->solutions);
+  } else {
+    fprintf(fp, "%-6s %zu runs, %zu nodes, %zu backtracks, max depth %zu, "
+            "%zu links, %zu solutions\n", name, stats->runs, stats->nodes,
+            stats->backtracks, stats->max_depth, stats->links, stats->solutions);
+  }
+}
+
+// Print the counters of generating puzzles, with the search work split
+// into solving the seeded grids and checking uniqueness
+static void print_stats(const sudoku_stats *stats, size_t puzzles, stats_format format,
+                        FILE *fp)
+{
+  if (format == STATS_JSON) {
+    fprintf(fp, "{\"puzzles\":%zu,\"attempts\":%zu,\"abandoned\":%zu,"
+            "\"probes\":%zu,\"deduced\":%zu,\"propagations\":%zu,", puzzles,
+            stats->attempts, stats->abandoned, stats->probes, stats->deduced,
+            stats->propagations);
+    print_solver_stats("fill", &stats->fill, format, fp);
+    fputc(',', fp);
+    print_solver_stats("probe", &stats->probe, format, fp);
+    fprintf(fp, "}\n");
+  } else if (format == STATS_TEXT) {
+    fprintf(fp, "puzzles: %zu, attempts: %zu (%zu abandoned)\n", puzzles,
+            stats->attempts, stats->abandoned);
+    fprintf(fp, "probes: %zu, avoided by deduction: %zu, propagations: %zu\n",
+            stats->probes, stats->deduced, stats->propagations);
+    print_solver_stats("fill:", &stats->fill, format, fp);
+    print_solver_stats("probe:", &stats->probe, format, fp);
+  }
+}
+
+// Generate a batch of puzzles and report the throughput
+static void run_batch(const batch_options *opts, stats_format format, bool perf_counters)
+{
+  batch_stats stats;
+  batch_generate(opts, &stats);
+
+  const sudoku_stats *gen = &stats.gen;
+  warn("generated %zu puzzles in %.3fs (%.0f/s) with %d threads%s",
+       stats.puzzles, stats.seconds, stats.puzzles / stats.seconds, opts->threads,
+       opts->gen.singles_only ? ", singles only" : "");
+  warn("  %.1f probes, %.1f propagations, %.2f attempts per puzzle",
+       (double) gen->probes / stats.puzzles, (double) gen->propagations / stats.puzzles,
+       (double) gen->attempts / stats.puzzles);
+  print_stats(gen, stats.puzzles, format, stderr);
+  if (opts->timings) {
+    batch_print_timings(stats.timings, stderr);
+  }
+  if (perf_counters) {
+    perf_report(stderr, gen->fill.nodes + gen->probe.nodes);
+  }
+}
+
+// Audit the puzzles on stdin and print a summary
+static void run_audit(const audit_options *opts)
+{
+  audit_stats stats;
+  audit_corpus(opts, &stats);
+  warn("audited %zu puzzles in %.3fs (%.0f/s) with %d threads",
+       stats.puzzles, stats.seconds, stats.puzzles / stats.seconds, opts->threads);
+  warn("  %zu unique (%s%zu minimal), %zu multiple, %zu invalid, %zu malformed",
+       stats.unique, opts->minimality ? "" : "not checked: ", stats.minimal,
+       stats.multiple, stats.invalid, stats.malformed);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+// Solve the puzzles on stdin, printing the solutions one per line, and
+// print the distribution of the solve times
+static void run_solve(portfolio_strategy strategy)
+{
+  corpus_reader reader;
+  sudoku puzzle;
+  portfolio_stats stats;
+  if (!corpus_reader_init(&reader, stdin)) {
+    exit(EXIT_FAILURE);
+  }
+  portfolio *pf = portfolio_create(strategy);
+  metrics_shard *metrics = metrics_get_shard(0);
+  size_t count = 0, times_size = 1024;
+  double *times = malloc(times_size*sizeof(double)), elapsed = 0;
+  if (times == NULL) {
+    fatal("failed to allocate memory for solve times");
+  }
+
+  while (corpus_read(&reader, &puzzle)) {
+    sudoku unsolved = puzzle;
+    double start = get_time();
+    trace_begin("puzzle", count);
+    bool solved = portfolio_solve(pf, &puzzle);
+    trace_end();
+    double seconds = get_time() - start;
+    slowlog_solve(portfolio_last_backend(pf), &unsolved, seconds * 1e9);
+    if (metrics != NULL) {
+      metrics_record_solve(metrics, solved, seconds * 1e9);
+    }
+    if (solved) {
+      sudoku_print_line(&puzzle, stdout);
+    } else {
+      printf("unsolvable\n");
+    }
+
+    if (count == times_size) {
+      times_size *= 2;
+      if ((times = realloc(times, times_size*sizeof(double))) == NULL) {
+        fatal("failed to allocate memory for solve times");
+      }
+    }
+    times[count++] = seconds;
+    elapsed += seconds;
+  }
+
+  portfolio_get_stats(pf, &stats);
+  qsort(times, count, sizeof(double), compare_doubles);
+  warn("solved %zu of %zu puzzles in %.3fs", stats.solved, count, elapsed);
+  if (count > 0) {
+    warn("  mean %.1fus, p50 %.1fus, p99 %.1fus, max %.1fus", elapsed * 1e6 / count,
+         times[count / 2] * 1e6, times[(count - 1) * 99 / 100] * 1e6,
+         times[count - 1] * 1e6);
+  }
+  for (int b = 0; b < PORTFOLIO_BACKENDS; b++) {
+    if (stats.runs[b] > 0) {
+      warn("  %s: %zu runs, %zu answers", portfolio_backend_name(b), stats.runs[b],
+           stats.wins[b]);
+    }
+  }
+  if (strategy == STRATEGY_LEARN) {
+    portfolio_print_table(pf, stderr);
+  }
+  free(times);
+  portfolio_destroy(pf);
+}
+
+// Parse a range of clues, either a single number or MIN..MAX. Return
+// false if the range is not valid.
+static bool parse_clues(const char *arg, int *min, int *max)
+{
+  char *end;
+  long lo = strtol(arg, &end, 10), hi = lo;
+  if (end == arg) {
+    return false;
+  }
+  if (strncmp(end, "..", 2) == 0) {
+    const char *start = end + 2;
+    hi = strtol(start, &end, 10);
+    if (end == start) {
+      return false;
+    }
+  }
+  if (*end != '\0' || lo < 0 || lo > hi || hi > GRID_SIZE) {
+    return false;
+  }
+  *min = lo;
+  *max = hi;
+  return true;
+}
+
+// Rate the puzzles read from stdin, printing each one preceded by its
+// difficulty
+static void run_rate(void)
+{
+  char line[256];
+  sudoku puzzle;
+  size_t count = 0, counts[DIFFICULTY_MAX+1] = { 0 };
+  double elapsed = 0;
+
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    if (!sudoku_parse(line, &puzzle)) {
+      warn("skipping line that is not a puzzle: %s", line);
+      continue;
+    }
+    double start = get_time();
+    sudoku_difficulty level = rate_puzzle(&puzzle, DIFFICULTY_ANY);
+    elapsed += get_time() - start;
+    counts[level]++;
+    count++;
+    printf("%d %-7s ", level, rate_name(level));
+    sudoku_print_line(&puzzle, stdout);
+  }
+
+  warn("rated %zu puzzles in %.3fs (%.0f/s)", count, elapsed,
+       elapsed > 0 ? count / elapsed : 0.0);
+  for (int i = DIFFICULTY_SINGLES; i <= DIFFICULTY_MAX; i++) {
+    warn("  %-7s %zu", rate_name(i), counts[i]);
+  }
+}
+
+// Print the logical steps that solve each puzzle on stdin, one line
+// per puzzle, taking the next step each time until none is left
+static void run_steps(void)
+{
+  char line[256], text[RATE_STEP_TEXT];
+  sudoku puzzle;
+  rate_state state;
+  rate_step step;
+  size_t count = 0, steps = 0;
+  double elapsed = 0;
+
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    if (!sudoku_parse(line, &puzzle)) {
+      warn("skipping line that is not a puzzle: %s", line);
+      continue;
+    }
+    sudoku_print_line(&puzzle, stdout);
+    count++;
+    if (!rate_state_init(&state, &puzzle)) {
+      printf("  broken\n");
+      continue;
+    }
+
+    for (;;) {
+      double start = get_time();
+      bool found = rate_next_step(&state, &step);
+      elapsed += get_time() - start;
+      if (!found) {
+        break;
+      }
+      rate_format_step(&step, text);
+      printf("  %s\n", text);
+      rate_apply_step(&state, &step);
+      steps++;
+    }
+    printf("  %s\n", state.grid.unsolved == 0 ? "solved" :
+           state.grid.broken ? "broken" : "stuck");
+  }
+
+  warn("found %zu steps for %zu puzzles in %.3fs (%.2fus per step)", steps, count,
+       elapsed, steps > 0 ? elapsed * 1e6 / steps : 0.0);
+}
+
+// Play the puzzle on the first line of stdin with the moves on the
+// following lines, printing the outcome of each
+static void run_play(void)
+{
+  static const char *results[] = { "ok", "given", "conflict", "invalid" };
+  char line[256];
+  sudoku puzzle;
+  play_state state;
+  size_t moves = 0;
+  double elapsed = 0;
+
+  if (fgets(line, sizeof(line), stdin) == NULL || !sudoku_parse(line, &puzzle)) {
+    fatal("the first line of input should be a puzzle");
+  }
+  if (!play_init(&state, &puzzle)) {
+    fatal("the puzzle's hints conflict");
+  }
+  printf("puzzle %s\n", state.solutions == 0 ? "invalid" :
+         state.solutions == 1 ? "unique" : "multiple");
+
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    int row, col;
+    char value;
+    if (sscanf(line, "r%dc%d=%c", &row, &col, &value) != 3 ||
+        value < '0' || value > '9') {
+      warn("skipping line that is not a move: %s", line);
+      continue;
+    }
+
+    int idx = (row - 1)*SUDOKU_SIZE + (col - 1);
+    if (row < 1 || row > SUDOKU_SIZE || col < 1 || col > SUDOKU_SIZE) {
+      idx = -1;
+    }
+    double start = get_time();
+    play_result result = value == '0' ? play_erase(&state, idx) :
+      play_place(&state, idx, value - '0');
+    bool consistent = play_consistent(&state);
+    bool solvable = play_solvable(&state);
+    elapsed += get_time() - start;
+    moves++;
+
+    printf("r%dc%d=%c %s %s %s%s\n", row, col, value, results[result],
+           consistent ? "consistent" : "inconsistent",
+           solvable ? "solvable" : "unsolvable",
+           play_solved(&state) ? " solved" : "");
+  }
+
+  warn("checked %zu moves in %.6fs (%.2fus per move), %zu searches",
+       moves, elapsed, moves > 0 ? elapsed * 1e6 / moves : 0.0, state.searches);
+  play_free(&state);
+}
+
+// Generate a puzzle with the generator for another grid size
+static void run_size(const grid_kernel *kernel, const grid_options *opts,
+                     bool show_solution, bool show_probes)
+{
+  sudoku_value puzzle[GRID_MAX_CELLS], solution[GRID_MAX_CELLS];
+  grid_stats stats;
+
+  if (!kernel->generate(puzzle, solution, opts, &stats)) {
+    fatal("could not find a %dx%d solution grid in %.1fs", kernel->size, kernel->size,
+          opts->time_limit);
+  }
+  if (show_probes) {
+    printf("probes: %zu (%zu propagations)\n", stats.gen.probes, stats.gen.propagations);
+  }
+  if (stats.stopped) {
+    warn("stopped at the time limit, so some hints may not be needed");
+  } else if (stats.timeouts > 0) {
+    warn("gave up on %zu uniqueness checks that took too long, so some hints may "
+         "not be needed", stats.timeouts);
+  }
+  kernel->print(show_solution ? solution : puzzle, stdout);
+}
+
+// Generate count puzzles of each grid size, printing the time taken
+// per puzzle and the work done. Puzzle i of each size uses the seed
+// seed+i.
+static void run_size_benchmark(const grid_options *opts, unsigned int seed, size_t count)
+{
+  static const int sizes[] = { 4, 6, 9, 12, 16, 25 };
+  sudoku_value puzzle[GRID_MAX_CELLS], solution[GRID_MAX_CELLS];
+
+  printf("size  puzzles  s/puzzle    hints   probes  propagations  minimal\n");
+  for (int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+    const grid_kernel *kernel = grid_kernel_find(sizes[i]);
+    size_t generated = 0, hints = 0, probes = 0, propagations = 0, minimal = 0;
+    double start = get_time();
+    for (size_t j = 0; j < count; j++) {
+      grid_stats stats;
+      rng_seed(seed + j);
+      if (!kernel->generate(puzzle, solution, opts, &stats)) {
+        continue;
+      }
+      generated++;
+      probes += stats.gen.probes;
+      propagations += stats.gen.propagations;
+      minimal += stats.minimal;
+      for (int k = 0; k < sizes[i]*sizes[i]; k++) {
+        hints += puzzle[k] != 0;
+      }
+    }
+    double elapsed = get_time() - start;
+    double n = generated > 0 ? generated : 1;
+    printf("%4d  %7zu  %8.3f  %7.1f  %7.1f  %12.1f  %6.0f%%\n", sizes[i], generated,
+           elapsed / (count > 0 ? count : 1), hints / n, probes / n, propagations / n,
+           100.0 * minimal / n);
+    fflush(stdout);
+  }
+}
+
+// Write each corpus set to dir, in text and binary files
+static void run_make_corpus(const char *dir, unsigned int seed, size_t count, int threads)
+{
+  sudoku *puzzles = malloc(count*sizeof(sudoku));
+  char *path = malloc(strlen(dir) + 32);
+  if (puzzles == NULL || path == NULL) {
+    fatal("failed to allocate memory for corpus");
+  }
+  if (!corpus_make_dir(dir)) {
+    exit(EXIT_FAILURE);
+  }
+
+  for (int set = 0; set < CORPUS_SETS; set++) {
+    double start = get_time();
+    corpus_make(set, seed, count, threads, puzzles);
+    double seconds = get_time() - start;
+
+    size_t hints = 0;
+    for (size_t i = 0; i < count; i++) {
+      hints += sudoku_count_hints(&puzzles[i]);
+    }
+    sprintf(path, "%s/%s.txt", dir, corpus_set_name(set));
+    bool written = corpus_write(path, CORPUS_TEXT, puzzles, count);
+    sprintf(path, "%s/%s.bin", dir, corpus_set_name(set));
+    if (!written || !corpus_write(path, CORPUS_BINARY, puzzles, count)) {
+      exit(EXIT_FAILURE);
+    }
+    warn("%-10s %zu puzzles, %.1f hints on average, made in %.3fs", corpus_set_name(set),
+         count, (double) hints / count, seconds);
+  }
+
+  free(path);
+  free(puzzles);
+}
+
+// Print the rank of each solution grid on stdin, as text or packed
+static void run_rank(bool binary)
+{
+  corpus_reader reader;
+  sudoku s;
+  size_t count = 0, invalid = 0;
+  if (!corpus_reader_init(&reader, stdin)) {
+    exit(EXIT_FAILURE);
+  }
+
+  while (corpus_read(&reader, &s)) {
+    grid_rank rank;
+    count++;
+    if (!rank_grid(&s, &rank)) {
+      warn("grid %zu is not a solution grid", count);
+      invalid++;
+      continue;
+    }
+    if (binary) {
+      uint8_t bytes[RANK_BYTES];
+      rank_pack(rank, bytes);
+      fwrite(bytes, 1, RANK_BYTES, stdout);
+    } else {
+      char digits[RANK_DIGITS];
+      rank_format(rank, digits);
+      printf("%s\n", digits);
+    }
+  }
+  if (invalid > 0) {
+    fatal("%zu of %zu grids are not solution grids", invalid, count);
+  }
+}
+
+// Print the solution grid of each rank on stdin, read as text or packed
+static void run_unrank(bool binary)
+{
+  char line[256];
+  size_t count = 0, invalid = 0;
+  for (;;) {
+    grid_rank rank;
+    if (binary) {
+      uint8_t bytes[RANK_BYTES];
+      size_t got = fread(bytes, 1, RANK_BYTES, stdin);
+      if (got != RANK_BYTES) {
+        if (got != 0) {
+          warn("ignoring %zu trailing bytes", got);
+        }
+        break;
+      }
+      rank = rank_unpack(bytes);
+    } else {
+      if (fgets(line, sizeof(line), stdin) == NULL) {
+        break;
+      }
+      if (!rank_parse(line, &rank)) {
+        warn("skipping line %zu, which is not a rank: %s", count + 1, line);
+        count++;
+        continue;
+      }
+    }
+    count++;
+
+    sudoku s;
+    if (rank_unrank(rank, &s)) {
+      sudoku_print_line(&s, stdout);
+    } else {
+      printf("invalid\n");
+      invalid++;
+    }
+  }
+  if (invalid > 0) {
+    warn("%zu of %zu ranks are not the rank of a grid", invalid, count);
+  }
+}
+
+// Print count solution grids drawn uniformly, grid i from the seed
+// seed+i
+static void run_random_grids(unsigned int seed, size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    sudoku s;
+    rng_seed(seed + i);
+    rank_sample(&s);
+    sudoku_print_line(&s, stdout);
+  }
+}
+
+// Index the seeds of a shard of count seeds from seed on, writing the
+// index to path
+static void run_index_seeds(const char *path, const sudoku_options *opts, unsigned int seed,
+                            size_t count, int shard, int shards, int threads)
+{
+  size_t begin = count * shard / shards, end = count * (shard + 1) / shards;
+  seedindex_entry *entries = malloc((end - begin)*sizeof(seedindex_entry));
+  if (entries == NULL) {
+    fatal("failed to allocate memory for seed index");
+  }
+
+  double start = get_time();
+  seedindex_sweep(opts, seed + begin, end - begin, threads, entries);
+  double seconds = get_time() - start;
+  if (!seedindex_write(path, opts, entries, end - begin)) {
+    exit(EXIT_FAILURE);
+  }
+  warn("indexed seeds %zu to %zu in %.3fs (%.0f/s) with %d threads", seed + begin,
+       seed + end - 1, seconds, seconds > 0 ? (end - begin) / seconds : 0.0, threads);
+  if (end > begin) {
+    // Sorted by clues, so the first entry has the fewest
+    warn("  fewest clues %d, from seed %u", entries[0].clues, entries[0].seed);
+  }
+  free(entries);
+}
+
+// Print the seeds of the index files whose clues and difficulty are in
+// range, at most limit of them, and the puzzle of each if regenerate
+// is set
+static void run_lookup(char **paths, int npaths, int min_clues, int max_clues,
+                       const sudoku_options *opts, size_t limit, bool regenerate)
+{
+  size_t found = 0;
+  for (int i = 0; i < npaths && found < limit; i++) {
+    seedindex idx;
+    if (!seedindex_open(&idx, paths[i])) {
+      exit(EXIT_FAILURE);
+    }
+    seedindex_entry e;
+    for (size_t pos = seedindex_find(&idx, min_clues);
+         found < limit && seedindex_read(&idx, pos, &e) && e.clues <= max_clues; pos++) {
+      if ((opts->min_difficulty != DIFFICULTY_ANY && e.difficulty < opts->min_difficulty) ||
+          (opts->max_difficulty != DIFFICULTY_ANY && e.difficulty > opts->max_difficulty)) {
+        continue;
+      }
+      found++;
+      printf("%u %d %d %-7s %.2fms", e.seed, e.clues, e.difficulty,
+             rate_name(e.difficulty), e.time * (SEEDINDEX_TIME_NS / 1e6));
+      if (!regenerate) {
+        printf("\n");
+        continue;
+      }
+      sudoku puzzle, solution;
+      rng_seed(e.seed);
+      sudoku_generate(&puzzle, &solution, &idx.opts, NULL);
+      printf(" ");
+      sudoku_print_line(&puzzle, stdout);
+      if (sudoku_count_hints(&puzzle) != e.clues) {
+        fatal("seed %u gave %d clues, but the index has %d", e.seed,
+              sudoku_count_hints(&puzzle), e.clues);
+      }
+    }
+    seedindex_close(&idx);
+  }
+  warn("found %zu seeds", found);
+}
+
+// Redo the work of a slow log record repeat times, printing the result
+// and the time each run took, and check that it gives the same puzzle
+// or solution each time
+static void run_replay(const char *line, size_t repeat)
+{
+  slowlog_record rec;
+  if (!slowlog_parse(line, &rec)) {
+    fatal("invalid slow log record: %s", line);
+  }
+
+  bool same = true;
+  sudoku puzzle, solution;
+  if (rec.kind == SLOW_GENERATE) {
+    for (size_t i = 0; i < repeat; i++) {
+      sudoku_stats stats;
+      rng_seed(rec.seed);
+      uint64_t start = get_time_ns();
+      sudoku_generate(&puzzle, &solution, &rec.opts, &stats);
+      uint64_t elapsed = get_time_ns() - start;
+      same = same && memcmp(&puzzle, &rec.puzzle, sizeof(sudoku)) == 0;
+      warn("generated seed %u in %.3fms (recorded %.3fms): solve %.3fms, deduce %.3fms, "
+           "unique %.3fms, extra %.3fms, %zu probes, %zu nodes", rec.seed, elapsed / 1e6,
+           rec.ms, stats.phase_ns[PHASE_SOLVE] / 1e6, stats.phase_ns[PHASE_DEDUCE] / 1e6,
+           stats.phase_ns[PHASE_UNIQUE] / 1e6, stats.phase_ns[PHASE_EXTRA] / 1e6,
+           stats.probes, stats.fill.nodes + stats.probe.nodes);
+    }
+  } else {
+    portfolio *pf = portfolio_create((portfolio_strategy) rec.backend);
+    sudoku first;
+    for (size_t i = 0; i < repeat; i++) {
+      puzzle = rec.puzzle;
+      double start = get_time();
+      bool solved = portfolio_solve(pf, &puzzle);
+      double elapsed = get_time() - start;
+      if (i == 0) {
+        first = puzzle;
+      }
+      same = same && memcmp(&puzzle, &first, sizeof(sudoku)) == 0;
+      warn("%s %s in %.3fms (recorded %.3fms)", solved ? "solved" : "failed to solve",
+           portfolio_backend_name(rec.backend), elapsed * 1e3, rec.ms);
+    }
+    portfolio_destroy(pf);
+  }
+
+  sudoku_print_line(&puzzle, stdout);
+  if (!same) {
+    fatal("replay doesn't match the record");
+  }
+}
+
 int main(int argc, char **argv)
 {
   sudoku puzzle, solution;
-  int c, show_solution = 0, extra_hints = 0;
+  sudoku_options opts = { 0, SYMMETRY_NONE };
+  sudoku_stats stats;
+  sudoku_difficulty min_difficulty, max_difficulty;
+  int c, show_solution = 0, show_probes = 0, search = 0, rate = 0, singles_only = 0;
+  int play = 0, steps = 0, benchmark = 0, timings = 0, perf_counters = 0;
+  int rank = 0, unrank = 0, random_grids = 0, lookup = 0, regenerate = 0;
+  int pin = 0, numa = 0;
+  int shard = 0, shards = 1, min_clues = 0, max_clues = GRID_SIZE;
+  const char *index_file = NULL;
+  bool rank_binary = false;
+  int target = 22, threads = 0, size = SUDOKU_SIZE;
+  size_t count = 0;
+  double time_limit = 10.0;
+  const char *pattern_file = NULL;
+  const char *audit = NULL;
+  const char *trace_file = NULL;
+  const char *metrics_file = NULL;
+  int metrics_interval = 10;
+  const char *slow_log = NULL;
+  const char *replay = NULL;
+  const char *corpus_dir = NULL;
+  long slow_ms = 100;
+  int solve = 0;
+  stats_format format = STATS_NONE;
+  portfolio_strategy strategy = STRATEGY_LEARN;
   unsigned int seed = time(NULL);
+  bool seed_given = false;
   char *end;
   long val;
+  int n;
 
   const struct option long_options[] = {
     { "solution",  no_argument,       &show_solution, 1   },
     { "seed",      required_argument, 0,              's' },
     { "add-hints", required_argument, 0,              'a' },
+    { "symmetry",  required_argument, 0,              OPT_SYMMETRY },
+    { "probes",    no_argument,       &show_probes,   1   },
+    { "search",    no_argument,       &search,        1   },
+    { "target",    required_argument, 0,              OPT_TARGET },
+    { "time",      required_argument, 0,              OPT_TIME },
+    { "threads",   required_argument, 0,              OPT_THREADS },
+    { "pin",       no_argument,       &pin,           1   },
+    { "numa",      no_argument,       &numa,          1   },
+    { "count",     required_argument, 0,              OPT_COUNT },
+    { "pattern",   required_argument, 0,              OPT_PATTERN },
+    { "difficulty", required_argument, 0,             OPT_DIFFICULTY },
+    { "rate",      no_argument,       &rate,          1   },
+    { "singles-only", no_argument,    &singles_only,  1   },
+    { "audit",     optional_argument, 0,              OPT_AUDIT },
+    { "solve",     optional_argument, 0,              OPT_SOLVE },
+    { "stats",     optional_argument, 0,              OPT_STATS },
+    { "timings",   no_argument,       &timings,       1   },
+    { "perf-counters", no_argument,   &perf_counters, 1   },
+    { "trace",     required_argument, 0,              OPT_TRACE },
+    { "metrics-file", required_argument, 0,           OPT_METRICS_FILE },
+    { "metrics-interval", required_argument, 0,       OPT_METRICS_INTERVAL },
+    { "slow-log",  required_argument, 0,              OPT_SLOW_LOG },
+    { "slow-ms",   required_argument, 0,              OPT_SLOW_MS },
+    { "replay",    required_argument, 0,              OPT_REPLAY },
+    { "make-corpus", required_argument, 0,            OPT_MAKE_CORPUS },
+    { "rank",      optional_argument, 0,              OPT_RANK },
+    { "unrank",    optional_argument, 0,              OPT_UNRANK },
+    { "random-grids", no_argument,    &random_grids,  1   },
+    { "index-seeds", required_argument, 0,            OPT_INDEX_SEEDS },
+    { "shard",     required_argument, 0,              OPT_SHARD },
+    { "lookup",    no_argument,       &lookup,        1   },
+    { "clues",     required_argument, 0,              OPT_CLUES },
+    { "regenerate", no_argument,      &regenerate,    1   },
+    { "play",      no_argument,       &play,          1   },
+    { "size",      required_argument, 0,              OPT_SIZE },
+    { "size-benchmark", no_argument,  &benchmark,     1   },
+    { "steps",     no_argument,       &steps,         1   },
     { 0,           0,                 0,              0   },
   };
 
   while ((c = getopt_long(argc, argv, "s:a:", long_options, NULL)) != -1) {
     switch (c) {
     case 0:
-      // getopt_long already set show_solution
+      // getopt_long already set the flag
       break;
     case 's':
       val = strtol(optarg, &end, 0);
@@ -45,10 +953,122 @@ int main(int argc, char **argv)
         warn("warning: seed does not fit into unsigned int");
       } else {
         seed = val;
+        seed_given = true;
       }
       break;
     case 'a':
-      extra_hints = atoi(optarg);
+      opts.extra_hints = atoi(optarg);
+      break;
+    case OPT_SYMMETRY:
+      if (!sudoku_parse_symmetry(optarg, &opts.symmetry)) {
+        warn("unknown symmetry: %s", optarg);
+        usage();
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OPT_TARGET:
+      target = parse_number("target", optarg, 17);
+      break;
+    case OPT_TIME:
+      time_limit = parse_number("time", optarg, 0);
+      break;
+    case OPT_THREADS:
+      threads = parse_number("threads", optarg, 1);
+      break;
+    case OPT_COUNT:
+      count = parse_number("count", optarg, 1);
+      break;
+    case OPT_PATTERN:
+      pattern_file = optarg;
+      break;
+    case OPT_SIZE:
+      size = parse_number("size", optarg, 1);
+      if (grid_kernel_find(size) == NULL) {
+        warn("unsupported size: %s", optarg);
+        usage();
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OPT_AUDIT:
+      audit = optarg != NULL ? optarg : "minimal";
+      if (strcmp(audit, "minimal") != 0 && strcmp(audit, "unique") != 0) {
+        warn("unknown audit check: %s", audit);
+        usage();
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OPT_SOLVE:
+      solve = 1;
+      if (optarg != NULL && !portfolio_parse_strategy(optarg, &strategy)) {
+        warn("unknown solve strategy: %s", optarg);
+        usage();
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OPT_STATS:
+      if (optarg == NULL || strcmp(optarg, "text") == 0) {
+        format = STATS_TEXT;
+      } else if (strcmp(optarg, "json") == 0) {
+        format = STATS_JSON;
+      } else {
+        warn("unknown stats format: %s", optarg);
+        usage();
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case OPT_TRACE:
+      trace_file = optarg;
+      break;
+    case OPT_METRICS_FILE:
+      metrics_file = optarg;
+      break;
+    case OPT_METRICS_INTERVAL:
+      metrics_interval = parse_number("metrics interval", optarg, 1);
+      break;
+    case OPT_SLOW_LOG:
+      slow_log = optarg;
+      break;
+    case OPT_SLOW_MS:
+      slow_ms = parse_number("slow-ms", optarg, 0);
+      break;
+    case OPT_REPLAY:
+      replay = optarg;
+      break;
+    case OPT_MAKE_CORPUS:
+      corpus_dir = optarg;
+      break;
+    case OPT_RANK:
+    case OPT_UNRANK:
+      *(c == OPT_RANK ? &rank : &unrank) = 1;
+      if (optarg != NULL && strcmp(optarg, "text") != 0 && strcmp(optarg, "binary") != 0) {
+        warn("unknown rank format: %s", optarg);
+        usage();
+        exit(EXIT_FAILURE);
+      }
+      rank_binary = optarg != NULL && strcmp(optarg, "binary") == 0;
+      break;
+    case OPT_INDEX_SEEDS:
+      index_file = optarg;
+      break;
+    case OPT_SHARD:
+      if (sscanf(optarg, "%d/%d%n", &shard, &shards, &n) != 2 || optarg[n] != '\0' ||
+          shards < 1 || shard < 0 || shard >= shards) {
+        fatal("invalid shard: %s", optarg);
+      }
+      break;
+    case OPT_CLUES:
+      if (!parse_clues(optarg, &min_clues, &max_clues)) {
+        fatal("invalid clue range: %s", optarg);
+      }
+      break;
+    case OPT_DIFFICULTY:
+      if (!rate_parse_range(optarg, &min_difficulty, &max_difficulty)) {
+        warn("invalid difficulty range: %s", optarg);
+        usage();
+        exit(EXIT_FAILURE);
+      }
+      opts.min_difficulty = min_difficulty;
+      opts.max_difficulty = max_difficulty;
       break;
     default:
       usage();
@@ -56,14 +1076,185 @@ int main(int argc, char **argv)
     }
   }
 
+  if (threads == 0) {
+    threads = parallel_default_threads();
+  }
+  opts.time_limit = time_limit;
+  if (pin || numa) {
+    parallel_set_placement(pin, numa);
+  }
+
+  if (benchmark) {
+    grid_options grid_opts = { opts.extra_hints, time_limit, threads };
+    printf("seed: %u\n", seed);
+    run_size_benchmark(&grid_opts, seed, count ? count : 3);
+    return 0;
+  } else if (size != SUDOKU_SIZE) {
+    // Other sizes have no other modes, reports or generator options
+    bool other_mode = rate || audit != NULL || steps || play || solve || search ||
+      pattern_file != NULL || corpus_dir != NULL || replay != NULL || rank ||
+      unrank || random_grids || index_file != NULL || lookup;
+    bool reports = format != STATS_NONE || timings || perf_counters ||
+      trace_file != NULL || metrics_file != NULL || slow_log != NULL;
+    bool generator_opts = count > 0 || singles_only || opts.symmetry != SYMMETRY_NONE ||
+      opts.min_difficulty != DIFFICULTY_ANY || opts.max_difficulty != DIFFICULTY_ANY;
+    if (other_mode || reports || generator_opts) {
+      fatal("--size other than 9 only supports --add-hints, --solution, --probes, "
+            "--threads and --time");
+    }
+    printf("seed: %u\n", seed);
+    rng_seed(seed);
+    grid_options grid_opts = { opts.extra_hints, time_limit, threads };
+    run_size(grid_kernel_find(size), &grid_opts, show_solution, show_probes);
+    return 0;
+  }
+
+  // The trace is closed on exit, once every thread is done with it
+  if (trace_file != NULL) {
+    if (!trace_open(trace_file)) {
+      exit(EXIT_FAILURE);
+    }
+    atexit(trace_close);
+  }
+
+  if (metrics_file != NULL) {
+    if (!solve && (count == 0 || search || pattern_file != NULL || audit != NULL ||
+                   rate || steps || play)) {
+      fatal("--metrics-file needs --count or --solve");
+    }
+    if (!metrics_start(metrics_file, metrics_interval, solve ? 1 : threads)) {
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (slow_log != NULL && !slowlog_open(slow_log, slow_ms * 1000000)) {
+    exit(EXIT_FAILURE);
+  }
+
+  if (singles_only) {
+    if (opts.min_difficulty > DIFFICULTY_SINGLES) {
+      fatal("--singles-only can't be combined with a difficulty above singles");
+    }
+    opts.singles_only = true;
+  }
+
+  if (replay != NULL) {
+    run_replay(replay, count ? count : 1);
+    return 0;
+  } else if (corpus_dir != NULL) {
+    run_make_corpus(corpus_dir, seed_given ? seed : 1, count ? count : 100, threads);
+    return 0;
+  } else if (index_file != NULL) {
+    run_index_seeds(index_file, &opts, seed_given ? seed : 1, count ? count : 1000, shard,
+                    shards, threads);
+    return 0;
+  } else if (lookup) {
+    if (optind >= argc) {
+      fatal("--lookup needs the index files to search");
+    }
+    run_lookup(argv + optind, argc - optind, min_clues, max_clues, &opts,
+               count ? count : SIZE_MAX, regenerate);
+    return 0;
+  } else if (rank) {
+    run_rank(rank_binary);
+    return 0;
+  } else if (unrank) {
+    run_unrank(rank_binary);
+    return 0;
+  } else if (random_grids) {
+    printf("seed: %u\n", seed);
+    run_random_grids(seed, count ? count : 1);
+    return 0;
+  } else if (rate) {
+    run_rate();
+    return 0;
+  } else if (audit != NULL) {
+    audit_options audit_opts = {
+      strcmp(audit, "minimal") == 0, threads, stdin, stdout
+    };
+    run_audit(&audit_opts);
+    return 0;
+  } else if (steps) {
+    run_steps();
+    return 0;
+  } else if (play) {
+    run_play();
+    return 0;
+  } else if (solve) {
+    run_solve(strategy);
+    metrics_stop();
+    return 0;
+  }
+
   printf("seed: %u\n", seed);
-  srand(seed);
-  sudoku_generate(&puzzle, &solution, extra_hints);
+  if (search) {
+    lowclue_options search_opts = {
+      target, time_limit, threads, count ? count : 10, seed
+    };
+    run_search(&search_opts);
+    return 0;
+  } else if (pattern_file != NULL) {
+    sudoku_pattern pattern;
+    pattern_options pattern_opts = {
+      time_limit, threads, count ? count : 1, seed
+    };
+    if (!pattern_read(pattern_file, &pattern)) {
+      exit(EXIT_FAILURE);
+    }
+    run_pattern(&pattern, &pattern_opts);
+    return 0;
+  }
+
+  if (perf_counters) {
+    perf_enable();
+  }
+  if (count > 0) {
+    batch_options batch_opts = {
+      opts, seed, count, threads, show_solution, timings, stdout
+    };
+    run_batch(&batch_opts, format, perf_counters);
+    metrics_stop();
+    return 0;
+  }
+
+  rng_seed(seed);
+  uint64_t start = get_time_ns();
+  trace_begin("puzzle", seed);
+  if (!sudoku_generate(&puzzle, &solution, &opts, &stats)) {
+    warn("no puzzle in the difficulty range after %zu attempts", stats.attempts);
+  }
+  trace_end();
+  uint64_t elapsed = get_time_ns() - start;
+  slowlog_generate(&opts, seed, &solution, &puzzle, &stats, elapsed);
+  if (show_probes) {
+    if (opts.singles_only) {
+      printf("propagations: %zu\n", stats.propagations);
+    } else {
+      printf("probes: %zu\n", stats.probes);
+    }
+    if (opts.min_difficulty != DIFFICULTY_ANY || opts.max_difficulty != DIFFICULTY_ANY) {
+      printf("attempts: %zu (%zu abandoned)\n", stats.attempts, stats.abandoned);
+    }
+  }
   if (show_solution) {
     sudoku_print(&solution, stdout);
   } else {
     sudoku_print(&puzzle, stdout);
   }
+  print_stats(&stats, 1, format, stderr);
+  if (timings) {
+    histogram *phases = calloc(BATCH_TIMINGS, sizeof(histogram));
+    if (phases == NULL) {
+      fatal("failed to allocate memory for timings");
+    }
+    batch_record_timings(phases, &stats, elapsed);
+    batch_print_timings(phases, stderr);
+    free(phases);
+  }
+  if (perf_counters) {
+    perf_thread_done();
+    perf_report(stderr, stats.fill.nodes + stats.probe.nodes);
+  }
 
   return 0;
 }
@@ -0,0 +1,323 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include "util.h"
+#include "histogram.h"
+#include "metrics.h"
+
+// Metrics of a long run, written to a file in the Prometheus text
+// exposition format for a scraper to pick up while the run goes on.
+//
+// Each worker counts into a shard of its own, storing each counter
+// with a plain atomic store as the histograms do, so recording takes
+// no locks. A writer thread wakes every interval, adds up the shards
+// and rewrites the file. It writes a temporary file and renames it
+// over the old one, so a scrape never reads half a file.
+
+typedef enum {
+  COUNT_GENERATED,
+  COUNT_SOLVED,
+  COUNT_UNSOLVABLE,
+  COUNT_PROBES,
+  COUNT_AVOIDED,
+  COUNT_NODES,
+  COUNTERS,
+} counter;
+
+// A histogram for each phase of generation, then one for whole
+// generations and one for solves
+#define HIST_GENERATE SUDOKU_PHASES
+#define HIST_SOLVE (SUDOKU_PHASES+1)
+#define HISTOGRAMS (SUDOKU_PHASES+2)
+
+struct metrics_shard {
+  uint64_t counters[COUNTERS];
+  histogram timings[HISTOGRAMS];
+};
+
+static const struct { const char *name, *help; } counter_info[] = {
+  { "gensudoku_puzzles_generated_total", "Puzzles generated." },
+  { "gensudoku_puzzles_solved_total", "Puzzles solved." },
+  { "gensudoku_puzzles_unsolvable_total", "Puzzles found to have no solution." },
+  { "gensudoku_probes_total", "Uniqueness checks run by the DLX solver." },
+  { "gensudoku_probes_avoided_total",
+    "Hint orbits removed by deduction without a uniqueness check." },
+  { "gensudoku_dlx_nodes_total", "DLX search nodes visited while generating." },
+};
+
+static const struct { const char *name, *help; } gauge_info[] = {
+  { "gensudoku_queued_puzzles", "Puzzles not yet handed to a worker." },
+  { "gensudoku_waiting_workers", "Workers waiting for their turn to write out." },
+};
+
+// The bucket bounds written out, in nanoseconds, from 10us to 10s
+static const uint64_t bounds[] = {
+  10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000,
+  10000000, 25000000, 50000000, 100000000, 250000000, 500000000, 1000000000,
+  2500000000, 5000000000, 10000000000
+};
+
+static bool started = false;
+static char *file_path, *temp_path;
+static int write_interval;
+static metrics_shard *shards;
+static int nshards;
+static int64_t gauges[METRIC_GAUGES];
+
+static pthread_t writer;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_wake = PTHREAD_COND_INITIALIZER;
+static bool writer_stop;
+
+static void *writer_main(void *arg);
+static bool write_metrics(void);
+static void print_histogram(FILE *fp, const char *name, const char *label,
+                            const histogram *h);
+static bool get_resident_bytes(uint64_t *bytes);
+
+// Start writing the metrics to the file at path every interval
+// seconds, counted into the given number of shards. Return false if
+// the file can't be written.
+bool metrics_start(const char *path, int interval, int count)
+{
+  assert(path);
+  assert(interval > 0);
+  assert(count > 0);
+  assert(!started);
+
+  size_t len = strlen(path);
+  file_path = malloc(len + 1);
+  temp_path = malloc(len + 5);
+  shards = calloc(count, sizeof(metrics_shard));
+  if (file_path == NULL || temp_path == NULL || shards == NULL) {
+    fatal("failed to allocate memory for metrics");
+  }
+  strcpy(file_path, path);
+  sprintf(temp_path, "%s.tmp", path);
+  nshards = count;
+  write_interval = interval;
+  memset(gauges, 0, sizeof(gauges));
+
+  // Write the file once up front, so a bad path is caught at the start
+  // of a run rather than an interval into it
+  started = true;
+  if (!write_metrics()) {
+    started = false;
+    free(shards);
+    free(temp_path);
+    free(file_path);
+    return false;
+  }
+
+  writer_stop = false;
+  if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+    fatal("failed to create metrics writer thread");
+  }
+  return true;
+}
+
+// Write the final metrics and stop the writer. The workers should be
+// done recording by now.
+void metrics_stop(void)
+{
+  if (!started) {
+    return;
+  }
+  pthread_mutex_lock(&writer_lock);
+  writer_stop = true;
+  pthread_cond_signal(&writer_wake);
+  pthread_mutex_unlock(&writer_lock);
+  pthread_join(writer, NULL);
+
+  write_metrics();
+  started = false;
+  free(shards);
+  free(temp_path);
+  free(file_path);
+}
+
+// Get the shard a worker records into, or NULL if metrics aren't being
+// written
+metrics_shard *metrics_get_shard(int id)
+{
+  if (!started) {
+    return NULL;
+  }
+  assert(id >= 0 && id < nshards);
+  return &shards[id];
+}
+
+// Record a generated puzzle. Only the shard's worker may do this.
+void metrics_record_generate(metrics_shard *m, const sudoku_stats *stats, uint64_t total_ns)
+{
+  assert(m);
+  assert(stats);
+
+  histogram_add(&m->counters[COUNT_GENERATED], 1);
+  histogram_add(&m->counters[COUNT_PROBES], stats->probes);
+  histogram_add(&m->counters[COUNT_AVOIDED], stats->deduced);
+  histogram_add(&m->counters[COUNT_NODES], stats->fill.nodes + stats->probe.nodes);
+  for (int i = 0; i < SUDOKU_PHASES; i++) {
+    histogram_record(&m->timings[i], stats->phase_ns[i]);
+  }
+  histogram_record(&m->timings[HIST_GENERATE], total_ns);
+}
+
+// Record a solved, or unsolvable, puzzle. Only the shard's worker may
+// do this.
+void metrics_record_solve(metrics_shard *m, bool solved, uint64_t ns)
+{
+  assert(m);
+
+  histogram_add(&m->counters[solved ? COUNT_SOLVED : COUNT_UNSOLVABLE], 1);
+  histogram_record(&m->timings[HIST_SOLVE], ns);
+}
+
+// Set a gauge. This does nothing unless metrics are being written.
+void metrics_set_gauge(metrics_gauge gauge, int64_t value)
+{
+  assert(gauge >= 0 && gauge < METRIC_GAUGES);
+  if (started) {
+    __atomic_store_n(&gauges[gauge], value, __ATOMIC_RELAXED);
+  }
+}
+
+// Add to a gauge, which any thread may do at once
+void metrics_add_gauge(metrics_gauge gauge, int64_t delta)
+{
+  assert(gauge >= 0 && gauge < METRIC_GAUGES);
+  if (started) {
+    __atomic_fetch_add(&gauges[gauge], delta, __ATOMIC_RELAXED);
+  }
+}
+
+static void *writer_main(void *arg)
+{
+  pthread_mutex_lock(&writer_lock);
+  while (!writer_stop) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += write_interval;
+    while (!writer_stop &&
+           pthread_cond_timedwait(&writer_wake, &writer_lock, &deadline) != ETIMEDOUT) {
+    }
+    if (!writer_stop) {
+      pthread_mutex_unlock(&writer_lock);
+      write_metrics();
+      pthread_mutex_lock(&writer_lock);
+    }
+  }
+  pthread_mutex_unlock(&writer_lock);
+  return NULL;
+}
+
+// Add up the shards and replace the file with their totals. A failed
+// write is reported and left for the next interval to try again.
+// Return whether the file was replaced.
+static bool write_metrics(void)
+{
+  uint64_t counters[COUNTERS];
+  histogram *timings = calloc(HISTOGRAMS, sizeof(histogram));
+  if (timings == NULL) {
+    fatal("failed to allocate memory for metrics");
+  }
+  memset(counters, 0, sizeof(counters));
+  for (int i = 0; i < nshards; i++) {
+    for (int c = 0; c < COUNTERS; c++) {
+      counters[c] += __atomic_load_n(&shards[i].counters[c], __ATOMIC_RELAXED);
+    }
+    for (int h = 0; h < HISTOGRAMS; h++) {
+      histogram_merge(&timings[h], &shards[i].timings[h]);
+    }
+  }
+
+  FILE *fp = fopen(temp_path, "w");
+  if (fp == NULL) {
+    warn("unable to write metrics file %s: %s", temp_path, strerror(errno));
+    free(timings);
+    return false;
+  }
+
+  for (int c = 0; c < COUNTERS; c++) {
+    fprintf(fp, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counter_info[c].name,
+            counter_info[c].help, counter_info[c].name, counter_info[c].name,
+            (unsigned long long) counters[c]);
+  }
+  for (int g = 0; g < METRIC_GAUGES; g++) {
+    fprintf(fp, "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n", gauge_info[g].name,
+            gauge_info[g].help, gauge_info[g].name, gauge_info[g].name,
+            (long long) __atomic_load_n(&gauges[g], __ATOMIC_RELAXED));
+  }
+  uint64_t rss;
+  if (get_resident_bytes(&rss)) {
+    fprintf(fp, "# HELP gensudoku_resident_memory_bytes Resident memory size in bytes.\n"
+            "# TYPE gensudoku_resident_memory_bytes gauge\n"
+            "gensudoku_resident_memory_bytes %llu\n", (unsigned long long) rss);
+  }
+
+  fprintf(fp, "# HELP gensudoku_phase_seconds Time spent in each phase of generation.\n"
+          "# TYPE gensudoku_phase_seconds histogram\n");
+  for (int i = 0; i < SUDOKU_PHASES; i++) {
+    char label[32];
+    snprintf(label, sizeof(label), "phase=\"%s\"", sudoku_phase_name(i));
+    print_histogram(fp, "gensudoku_phase_seconds", label, &timings[i]);
+  }
+  fprintf(fp, "# HELP gensudoku_puzzle_seconds Time spent on each puzzle.\n"
+          "# TYPE gensudoku_puzzle_seconds histogram\n");
+  print_histogram(fp, "gensudoku_puzzle_seconds", "mode=\"generate\"",
+                  &timings[HIST_GENERATE]);
+  print_histogram(fp, "gensudoku_puzzle_seconds", "mode=\"solve\"", &timings[HIST_SOLVE]);
+  free(timings);
+
+  bool failed = ferror(fp);
+  if (fclose(fp) != 0 || failed) {
+    warn("unable to write metrics file %s", temp_path);
+    remove(temp_path);
+    return false;
+  } else if (rename(temp_path, file_path) != 0) {
+    warn("unable to replace metrics file %s: %s", file_path, strerror(errno));
+    remove(temp_path);
+    return false;
+  }
+  return true;
+}
+
+// Print the buckets, sum and count of a histogram of nanoseconds in
+// seconds. The buckets are cumulative, as Prometheus expects, and the
+// count is taken from them so that it can't fall behind the buckets of
+// a histogram being recorded into.
+static void print_histogram(FILE *fp, const char *name, const char *label,
+                            const histogram *h)
+{
+  uint64_t count = histogram_count_below(h, UINT64_MAX);
+  for (int i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++) {
+    fprintf(fp, "%s_bucket{%s,le=\"%g\"} %llu\n", name, label, bounds[i] / 1e9,
+            (unsigned long long) histogram_count_below(h, bounds[i]));
+  }
+  fprintf(fp, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, label, (unsigned long long) count);
+  fprintf(fp, "%s_sum{%s} %.9f\n", name, label, h->sum / 1e9);
+  fprintf(fp, "%s_count{%s} %llu\n", name, label, (unsigned long long) count);
+}
+
+// Get the resident memory of the process. Return false where
+// /proc/self/statm isn't available.
+static bool get_resident_bytes(uint64_t *bytes)
+{
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp == NULL) {
+    return false;
+  }
+  unsigned long long size, resident;
+  bool found = fscanf(fp, "%llu %llu", &size, &resident) == 2;
+  fclose(fp);
+  if (found) {
+    *bytes = resident * sysconf(_SC_PAGESIZE);
+  }
+  return found;
+}
@@ -0,0 +1,25 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sudoku.h"
+
+// Gauges set by the batch modes as they go
+typedef enum {
+  METRIC_QUEUED,  // Puzzles not yet handed to a worker
+  METRIC_WAITING, // Workers waiting for their turn to write out
+  METRIC_GAUGES,
+} metrics_gauge;
+
+typedef struct metrics_shard metrics_shard;
+
+bool metrics_start(const char *path, int interval, int shards);
+void metrics_stop(void);
+metrics_shard *metrics_get_shard(int id);
+void metrics_record_generate(metrics_shard *m, const sudoku_stats *stats, uint64_t total_ns);
+void metrics_record_solve(metrics_shard *m, bool solved, uint64_t ns);
+void metrics_set_gauge(metrics_gauge gauge, int64_t value);
+void metrics_add_gauge(metrics_gauge gauge, int64_t delta);
+
+#endif
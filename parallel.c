@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "util.h"
+#include "parallel.h"
+
+// Workers can be placed on the CPUs the process may run on. With
+// pinning, each worker is kept on one CPU. With NUMA placement,
+// workers are dealt out to the nodes in turn and kept on their node's
+// CPUs, so the memory they allocate is first touched, and so placed,
+// on their own node, and work is handed out from a counter per node.
+// On a machine with one node, NUMA placement does nothing.
+
+typedef struct {
+  int id;
+  int nthreads;
+  bool placed;     // Whether to place the worker's thread on its CPUs
+  parallel_fn fn;
+  void *arg;
+} worker;
+
+// Whether workers are pinned to a CPU each
+static bool pin_workers = false;
+// Nodes workers are dealt out to, and the CPUs of each that the
+// process may use
+static int nnodes = 1;
+static cpu_set_t node_cpus[PARALLEL_MAX_NODES];
+
+static void *worker_main(void *arg);
+static bool place_worker(int id, int nthreads);
+static int worker_node(int id, int nthreads);
+static bool read_cpulist(const char *path, cpu_set_t *set);
+
+// Get the number of worker threads to use when none is given: one
+// per online processor.
+int parallel_default_threads(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int) n : 1;
+}
+
+// Set how the workers of later runs are placed on CPUs
+void parallel_set_placement(bool pin, bool numa)
+{
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    warn("unable to get the CPUs to place workers on");
+    return;
+  }
+
+  pin_workers = pin;
+  nnodes = 0;
+  for (int node = 0; numa && node < PARALLEL_MAX_NODES; node++) {
+    char path[64];
+    cpu_set_t cpus;
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+    if (read_cpulist(path, &cpus)) {
+      CPU_AND(&cpus, &cpus, &allowed);
+      if (CPU_COUNT(&cpus) > 0) {
+        node_cpus[nnodes++] = cpus;
+      }
+    }
+  }
+  if (nnodes <= 1) {
+    nnodes = 1;
+    node_cpus[0] = allowed;
+  }
+}
+
+// Run fn on nthreads threads and wait for all of them to finish. Each
+// thread is passed its id, from 0 to nthreads-1, and the shared
+// arg. The calling thread runs the worker with id 0.
+void parallel_run(int nthreads, parallel_fn fn, void *arg)
+{
+  assert(fn);
+
+  if (nthreads < 1) {
+    nthreads = 1;
+  }
+
+  worker *workers = calloc(nthreads, sizeof(worker));
+  pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+  if (workers == NULL || threads == NULL) {
+    fatal("failed to allocate memory for worker threads");
+  }
+
+  // The calling thread is placed as worker 0 for the run, then put
+  // back where it was
+  bool placed = pin_workers || nnodes > 1;
+  cpu_set_t saved;
+  if (placed && pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) != 0) {
+    placed = false;
+  }
+  for (int i = 0; i < nthreads; i++) {
+    workers[i].id = i;
+    workers[i].nthreads = nthreads;
+    workers[i].placed = placed;
+    workers[i].fn = fn;
+    workers[i].arg = arg;
+  }
+  for (int i = 1; i < nthreads; i++) {
+    if (pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0) {
+      fatal("failed to create worker thread");
+    }
+  }
+  worker_main(&workers[0]);
+  for (int i = 1; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  if (placed) {
+    pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+  }
+
+  free(threads);
+  free(workers);
+}
+
+// Take the next chunk of work for worker id of nthreads, from the
+// counter of its node. Chunks are dealt out to the nodes in turn, so
+// with one node they are taken in order.
+size_t parallel_next_chunk(parallel_counter *counters, int id, int nthreads)
+{
+  assert(counters);
+  int node = worker_node(id, nthreads), used = nnodes < nthreads ? nnodes : nthreads;
+  size_t k = __atomic_fetch_add(&counters[node].next, 1, __ATOMIC_RELAXED);
+  return k*used + node;
+}
+
+static void *worker_main(void *arg)
+{
+  worker *w = arg;
+  // Placed before running, so the worker's memory is first touched
+  // where it runs
+  if (w->placed && !place_worker(w->id, w->nthreads)) {
+    warn("unable to place worker %d", w->id);
+  }
+  w->fn(w->id, w->arg);
+  return NULL;
+}
+
+// Keep the calling thread, worker id of nthreads, on its node's CPUs,
+// or the CPU it is pinned to. Return false if its affinity can't be
+// set.
+static bool place_worker(int id, int nthreads)
+{
+  int node = worker_node(id, nthreads), used = nnodes < nthreads ? nnodes : nthreads;
+  const cpu_set_t *cpus = &node_cpus[node];
+  cpu_set_t set = *cpus;
+  if (pin_workers) {
+    // The workers of a node take its CPUs in turn
+    int k = id / used % CPU_COUNT(cpus);
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, cpus) && k-- == 0) {
+        CPU_SET(cpu, &set);
+        break;
+      }
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// Get the node worker id of nthreads is placed on. With fewer workers
+// than nodes, only the first nthreads nodes are used, so every node in
+// use has a worker to take its chunks.
+static int worker_node(int id, int nthreads)
+{
+  return id % (nnodes < nthreads ? nnodes : nthreads);
+}
+
+// Read a list of CPUs such as "0-3,8-11" from the file at path. Return
+// false if it can't be read.
+static bool read_cpulist(const char *path, cpu_set_t *set)
+{
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    return false;
+  }
+  char line[4096];
+  bool ok = fgets(line, sizeof(line), fp) != NULL;
+  fclose(fp);
+
+  CPU_ZERO(set);
+  for (char *c = line; ok && *c != '\0' && *c != '\n'; ) {
+    char *end;
+    long first = strtol(c, &end, 10), last = first;
+    if (end == c) {
+      return false;
+    }
+    if (*end == '-') {
+      c = end + 1;
+      last = strtol(c, &end, 10);
+    }
+    for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, set);
+    }
+    c = *end == ',' ? end + 1 : end;
+  }
+  return ok;
+}
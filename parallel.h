@@ -0,0 +1,25 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Most NUMA nodes workers are spread over
+#define PARALLEL_MAX_NODES 64
+#define PARALLEL_CACHE_LINE 64
+
+typedef void (*parallel_fn)(int id, void *arg);
+
+// A counter of the chunks of work a node's workers have taken, alone
+// in its cache line so that nodes don't share it
+typedef struct {
+  size_t next;
+  char pad[PARALLEL_CACHE_LINE - sizeof(size_t)];
+} parallel_counter;
+
+int parallel_default_threads(void);
+void parallel_set_placement(bool pin, bool numa);
+void parallel_run(int nthreads, parallel_fn fn, void *arg);
+size_t parallel_next_chunk(parallel_counter *counters, int id, int nthreads);
+
+#endif
@@ -0,0 +1,222 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "util.h"
+#include "parallel.h"
+#include "pattern.h"
+
+// Generation of puzzles whose clues sit exactly on a given pattern of
+// cells. Each trial fills a random solution grid and keeps the values
+// under the pattern; most grids give a puzzle with several solutions,
+// so many trials are needed. Before running the solver, two cheap
+// filters reject grids that can't work:
+//
+//  1. All the values but one must appear among the clues, otherwise
+//     two missing values can be swapped everywhere.
+//  2. An unavoidable rectangle, four cells in two rows, two columns
+//     and two sections holding a b / b a, can be swapped to b a / a b
+//     without breaking any rule. At least one of its cells must be a
+//     clue.
+//
+// Which rectangles are free of clues only depends on the pattern, so
+// they are found once up front and only their values are checked for
+// each grid.
+
+typedef struct {
+  int cells[4]; // Top left, top right, bottom left, bottom right
+} rectangle;
+
+typedef struct {
+  const sudoku_pattern *pattern;
+  const pattern_options *opts;
+  rectangle *rects;    // Rectangles with no clue in them
+  size_t nrects;
+  sudoku *puzzles;
+  size_t found;
+  double deadline;
+  pattern_stats *stats; // One per thread
+} pattern_ctx;
+
+static void trial_worker(int id, void *arg);
+static bool passes_filters(pattern_ctx *ctx, sudoku *grid);
+static size_t find_empty_rectangles(const sudoku_pattern *pattern, rectangle *rects);
+
+// Read a pattern from a file. Cells holding a clue are written as a
+// digit or one of xX*#, and empty cells as . or 0. Whitespace and the
+// |, - and + characters are ignored, so a puzzle printed by gensudoku
+// can be used as a pattern. Return false if the file can't be read.
+bool pattern_read(const char *path, sudoku_pattern *pattern)
+{
+  assert(path);
+  assert(pattern);
+
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    warn("unable to open pattern file: %s", path);
+    return false;
+  }
+
+  int c, n = 0;
+  bool ok = true;
+  while (ok && (c = fgetc(fp)) != EOF) {
+    if (strchr(" \t\r\n|-+", c) != NULL) {
+      continue;
+    } else if (n == GRID_SIZE) {
+      warn("pattern has more than %d cells", GRID_SIZE);
+      ok = false;
+    } else if (c == '.' || c == '0') {
+      pattern->clue[n++] = false;
+    } else if ((c >= '1' && c <= '9') || strchr("xX*#", c) != NULL) {
+      pattern->clue[n++] = true;
+    } else {
+      warn("unexpected character in pattern: %c", c);
+      ok = false;
+    }
+  }
+  fclose(fp);
+
+  if (ok && n < GRID_SIZE) {
+    warn("pattern has only %d cells", n);
+    ok = false;
+  }
+  return ok;
+}
+
+// Search for puzzles with clues exactly on the pattern until
+// opts->count of them are found or the time limit runs out. The
+// puzzles array should have room for opts->count puzzles. Return the
+// number of puzzles found.
+size_t pattern_search(const sudoku_pattern *pattern, const pattern_options *opts,
+                      sudoku *puzzles, pattern_stats *stats)
+{
+  assert(pattern);
+  assert(opts);
+  assert(puzzles);
+
+  rectangle rects[GRID_SIZE*GRID_SIZE];
+  pattern_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.pattern = pattern;
+  ctx.opts = opts;
+  ctx.rects = rects;
+  ctx.nrects = find_empty_rectangles(pattern, rects);
+  ctx.puzzles = puzzles;
+  ctx.deadline = get_time() + opts->time_limit;
+  if ((ctx.stats = calloc(opts->threads, sizeof(pattern_stats))) == NULL) {
+    fatal("failed to allocate memory for pattern stats");
+  }
+
+  parallel_run(opts->threads, trial_worker, &ctx);
+
+  if (stats != NULL) {
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < opts->threads; i++) {
+      stats->trials += ctx.stats[i].trials;
+      stats->filtered += ctx.stats[i].filtered;
+      stats->probes += ctx.stats[i].probes;
+      stats->found += ctx.stats[i].found;
+    }
+  }
+  free(ctx.stats);
+
+  return ctx.found < opts->count ? ctx.found : opts->count;
+}
+
+// Run trials on one thread until enough puzzles are found or the time
+// runs out
+static void trial_worker(int id, void *arg)
+{
+  pattern_ctx *ctx = arg;
+  pattern_stats *stats = &ctx->stats[id];
+  sudoku grid, puzzle;
+
+  rng_seed(ctx->opts->seed + id);
+  sudoku_checker *checker = sudoku_checker_create();
+
+  while (__atomic_load_n(&ctx->found, __ATOMIC_RELAXED) < ctx->opts->count &&
+         get_time() < ctx->deadline) {
+    sudoku_checker_fill(checker, &grid);
+    stats->trials++;
+    if (!passes_filters(ctx, &grid)) {
+      stats->filtered++;
+      continue;
+    }
+
+    for (int i = 0; i < GRID_SIZE; i++) {
+      puzzle.grid[i] = ctx->pattern->clue[i] ? grid.grid[i] : 0;
+    }
+    stats->probes++;
+    if (sudoku_checker_unique(checker, &puzzle)) {
+      stats->found++;
+      size_t n = __atomic_fetch_add(&ctx->found, 1, __ATOMIC_RELAXED);
+      if (n < ctx->opts->count) {
+        memcpy(&ctx->puzzles[n], &puzzle, sizeof(sudoku));
+      }
+    }
+  }
+
+  sudoku_checker_destroy(checker);
+}
+
+// Check whether the solution grid could possibly give a unique puzzle
+// under the pattern
+static bool passes_filters(pattern_ctx *ctx, sudoku *grid)
+{
+  const sudoku_pattern *pattern = ctx->pattern;
+  const sudoku_value *g = grid->grid;
+
+  int used = 0;
+  for (int i = 0; i < GRID_SIZE; i++) {
+    if (pattern->clue[i]) {
+      used |= 1 << g[i];
+    }
+  }
+  // Count the values missing from the clues
+  int missing = 0;
+  for (int v = 1; v <= SUDOKU_SIZE; v++) {
+    missing += (used & (1 << v)) == 0;
+  }
+  if (missing > 1) {
+    return false;
+  }
+
+  for (size_t i = 0; i < ctx->nrects; i++) {
+    int *c = ctx->rects[i].cells;
+    if (g[c[0]] == g[c[3]] && g[c[1]] == g[c[2]]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Find the rectangles that could be unavoidable and have no clues in
+// the pattern: the corners of any two rows and two columns where the
+// rows are in the same band of sections or the columns are in the
+// same stack, so that each section holds two of the corners or
+// none. Return the number of rectangles stored in rects.
+static size_t find_empty_rectangles(const sudoku_pattern *pattern, rectangle *rects)
+{
+  size_t n = 0;
+  for (int y1 = 0; y1 < SUDOKU_SIZE; y1++) {
+    for (int y2 = y1+1; y2 < SUDOKU_SIZE; y2++) {
+      for (int x1 = 0; x1 < SUDOKU_SIZE; x1++) {
+        for (int x2 = x1+1; x2 < SUDOKU_SIZE; x2++) {
+          if (y1/3 != y2/3 && x1/3 != x2/3) {
+            continue;
+          }
+          int cells[4] = {
+            y1*SUDOKU_SIZE + x1, y1*SUDOKU_SIZE + x2,
+            y2*SUDOKU_SIZE + x1, y2*SUDOKU_SIZE + x2,
+          };
+          if (!pattern->clue[cells[0]] && !pattern->clue[cells[1]] &&
+              !pattern->clue[cells[2]] && !pattern->clue[cells[3]]) {
+            memcpy(rects[n++].cells, cells, sizeof(cells));
+          }
+        }
+      }
+    }
+  }
+  return n;
+}
@@ -0,0 +1,30 @@
+#ifndef __PATTERN_H__
+#define __PATTERN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "sudoku.h"
+
+typedef struct {
+  bool clue[GRID_SIZE]; // Cells that must hold a clue
+} sudoku_pattern;
+
+typedef struct {
+  double time_limit; // Seconds to search for
+  int threads;
+  size_t count;      // Number of puzzles to find
+  unsigned int seed;
+} pattern_options;
+
+typedef struct {
+  size_t trials;   // Solution grids tried against the pattern
+  size_t filtered; // Grids rejected without running the solver
+  size_t probes;   // Uniqueness checks
+  size_t found;    // Grids that gave a unique puzzle
+} pattern_stats;
+
+bool pattern_read(const char *path, sudoku_pattern *pattern);
+size_t pattern_search(const sudoku_pattern *pattern, const pattern_options *opts,
+                      sudoku *puzzles, pattern_stats *stats);
+
+#endif
@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "util.h"
+#include "perf.h"
+
+// Hardware performance counters, split between the phases of
+// generation.
+//
+// Each thread opens its own group of counters with perf_event_open the
+// first time it enters a phase, and reads the group whenever it enters
+// or leaves one, charging the counts since the last read to the phase
+// it was in. The totals are kept per thread and added to the shared
+// ones when the thread is done, so the threads don't contend.
+//
+// Containers and perf_event_paranoid often don't allow the counters.
+// Then only the time of each phase is kept, and the report says why.
+
+// Phases can start inside others, up to this depth
+#define MAX_DEPTH 8
+
+// A read of a thread's counters: the raw counts, and how long the
+// group was enabled and actually running on the hardware
+typedef struct {
+  uint64_t ns;
+  uint64_t enabled_ns;
+  uint64_t running_ns;
+  uint64_t counts[PERF_COUNTERS];
+} perf_sample;
+
+static const char *phase_names[] = { "other", "build", "search", "minimize" };
+
+static bool enabled = false;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static perf_totals totals[PERF_PHASES];
+static bool counted[PERF_COUNTERS]; // Whether any thread had the counter
+static int open_error = 0;          // Why a thread couldn't open its counters
+
+static __thread bool thread_ready = false;
+static __thread int leader = -1;
+static __thread int fds[PERF_COUNTERS];   // -1 if not open
+static __thread int slots[PERF_COUNTERS]; // Position in the group
+static __thread int nslots;
+static __thread perf_phase stack[MAX_DEPTH];
+static __thread int depth;
+static __thread perf_sample last;   // The counts and time at the last read
+static __thread perf_totals thread_totals[PERF_PHASES];
+
+static void thread_init(void);
+static void open_counters(void);
+static void read_counters(perf_sample *now);
+static void charge(void);
+
+// Start counting. This should be called before any thread enters a
+// phase; until then entering and leaving phases does nothing.
+void perf_enable(void)
+{
+  enabled = true;
+}
+
+// Enter a phase, until the matching perf_end
+void perf_begin(perf_phase phase)
+{
+  if (!enabled) {
+    return;
+  }
+  if (!thread_ready) {
+    thread_init();
+  }
+  charge();
+  if (depth < MAX_DEPTH) {
+    stack[depth] = phase;
+  }
+  depth++;
+}
+
+// Leave the phase entered last
+void perf_end(void)
+{
+  if (!enabled) {
+    return;
+  }
+  assert(thread_ready && depth > 0);
+  charge();
+  depth--;
+}
+
+// Add the calling thread's counts to the totals and close its
+// counters. Each thread that entered a phase should call this before
+// the report.
+void perf_thread_done(void)
+{
+  if (!enabled || !thread_ready) {
+    return;
+  }
+  charge();
+
+  pthread_mutex_lock(&totals_lock);
+  for (int p = 0; p < PERF_PHASES; p++) {
+    totals[p].ns += thread_totals[p].ns;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+      totals[p].counts[c] += thread_totals[p].counts[c];
+    }
+  }
+  for (int c = 0; c < PERF_COUNTERS; c++) {
+    counted[c] = counted[c] || fds[c] >= 0;
+  }
+  pthread_mutex_unlock(&totals_lock);
+
+  for (int c = 0; c < PERF_COUNTERS; c++) {
+    if (fds[c] >= 0) {
+      close(fds[c]);
+    }
+  }
+  leader = -1;
+  thread_ready = false;
+}
+
+// Print the time and counts of each phase, with the instructions per
+// cycle, and the search phase's counts per DLX node
+void perf_report(FILE *fp, uint64_t nodes)
+{
+  static const char *names[] = {
+    "cycles", "instructions", "cache-misses", "branch-misses", "LLC-loads"
+  };
+
+  assert(fp);
+
+  bool any = false;
+  for (int c = 0; c < PERF_COUNTERS; c++) {
+    any = any || counted[c];
+  }
+  if (!any) {
+    fprintf(fp, "hardware counters unavailable (%s), timings only\n",
+            strerror(open_error ? open_error : ENOSYS));
+  }
+
+  fprintf(fp, "%-9s %9s", "phase", "seconds");
+  for (int c = 0; any && c < PERF_COUNTERS; c++) {
+    fprintf(fp, " %14s", names[c]);
+  }
+  fprintf(fp, any ? " %6s\n" : "\n", "IPC");
+  for (int p = 0; p < PERF_PHASES; p++) {
+    const perf_totals *t = &totals[p];
+    fprintf(fp, "%-9s %9.3f", phase_names[p], t->ns / 1e9);
+    for (int c = 0; any && c < PERF_COUNTERS; c++) {
+      if (counted[c]) {
+        fprintf(fp, " %14llu", (unsigned long long) t->counts[c]);
+      } else {
+        fprintf(fp, " %14s", "n/a");
+      }
+    }
+    if (any) {
+      uint64_t cycles = t->counts[PERF_CYCLES];
+      fprintf(fp, " %6.2f", cycles ? (double) t->counts[PERF_INSTRUCTIONS] / cycles : 0.0);
+    }
+    fputc('\n', fp);
+  }
+
+  if (nodes > 0) {
+    const perf_totals *t = &totals[PERF_SEARCH];
+    fprintf(fp, "DLX nodes: %llu, %.1fns per node", (unsigned long long) nodes,
+            (double) t->ns / nodes);
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+      if (counted[c] && c != PERF_INSTRUCTIONS) {
+        fprintf(fp, ", %.2f %s", (double) t->counts[c] / nodes, names[c]);
+      }
+    }
+    fputc('\n', fp);
+  }
+}
+
+// Open the calling thread's counters and start charging to PERF_OTHER
+static void thread_init(void)
+{
+  memset(thread_totals, 0, sizeof(thread_totals));
+  memset(&last, 0, sizeof(last));
+  depth = 0;
+  open_counters();
+  read_counters(&last);
+  thread_ready = true;
+}
+
+// Open the counters as one group led by the cycles counter, so they
+// are scheduled together. A counter the CPU doesn't have is left out;
+// without the leader, there are none.
+static void open_counters(void)
+{
+  leader = -1;
+  nslots = 0;
+  for (int c = 0; c < PERF_COUNTERS; c++) {
+    fds[c] = -1;
+  }
+
+#ifdef __linux__
+  static const struct { uint32_t type; uint64_t config; } events[] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16) },
+  };
+
+  for (int c = 0; c < PERF_COUNTERS; c++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[c].type;
+    attr.config = events[c].config;
+    attr.disabled = leader < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+      PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    if (fd < 0) {
+      if (leader < 0) {
+        __atomic_store_n(&open_error, errno, __ATOMIC_RELAXED);
+        return;
+      }
+      continue;
+    }
+    if (leader < 0) {
+      leader = fd;
+    }
+    fds[c] = fd;
+    slots[c] = nslots++;
+  }
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+  open_error = ENOSYS;
+#endif
+}
+
+// Read the time, and the raw counts of the open counters. If the
+// counters can't be read, the counts are left as they were at the last
+// read.
+static void read_counters(perf_sample *now)
+{
+  *now = last;
+  now->ns = get_time_ns();
+  if (leader < 0) {
+    return;
+  }
+
+  uint64_t buf[3 + PERF_COUNTERS];
+  if (read(leader, buf, sizeof(buf)) < (ssize_t) ((3 + nslots) * sizeof(uint64_t))) {
+    return;
+  }
+  now->enabled_ns = buf[1];
+  now->running_ns = buf[2];
+  for (int c = 0; c < PERF_COUNTERS; c++) {
+    if (fds[c] >= 0) {
+      now->counts[c] = buf[3 + slots[c]];
+    }
+  }
+}
+
+// Charge the time and counts since the last read to the current phase.
+// When the kernel had to share the hardware between groups since then,
+// the counts are scaled up to the whole time the group was enabled in
+// that interval. Scaling the totals instead would apply the ratio of
+// the whole run to counts of just this interval.
+static void charge(void)
+{
+  perf_sample now;
+  read_counters(&now);
+  perf_phase phase = depth == 0 ? PERF_OTHER : stack[depth < MAX_DEPTH ? depth-1 : MAX_DEPTH-1];
+  perf_totals *t = &thread_totals[phase];
+  t->ns += now.ns - last.ns;
+  uint64_t enabled_ns = now.enabled_ns - last.enabled_ns;
+  uint64_t running_ns = now.running_ns - last.running_ns;
+  for (int c = 0; c < PERF_COUNTERS; c++) {
+    uint64_t count = now.counts[c] - last.counts[c];
+    if (running_ns > 0 && running_ns < enabled_ns) {
+      count = (double) count * enabled_ns / running_ns;
+    }
+    t->counts[c] += count;
+  }
+  last = now;
+}
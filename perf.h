@@ -0,0 +1,39 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Hardware counters read for each phase
+typedef enum {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_LLC_LOADS,
+  PERF_COUNTERS,
+} perf_counter;
+
+// The phases the counters are split between. A phase that starts
+// inside another is taken out of the outer one's counts.
+typedef enum {
+  PERF_OTHER,    // Anything outside the phases below
+  PERF_BUILD,    // Building DLX graphs
+  PERF_SEARCH,   // Searching DLX graphs
+  PERF_MINIMIZE, // Removing and adding hints, apart from its DLX work
+  PERF_PHASES,
+} perf_phase;
+
+typedef struct {
+  uint64_t ns;
+  uint64_t counts[PERF_COUNTERS];
+} perf_totals;
+
+void perf_enable(void);
+void perf_begin(perf_phase phase);
+void perf_end(void);
+void perf_thread_done(void);
+void perf_report(FILE *fp, uint64_t nodes);
+
+#endif
@@ -0,0 +1,184 @@
+#include <string.h>
+#include <assert.h>
+#include "util.h"
+#include "play.h"
+
+// Incremental checks for a puzzle being played, one move at a time.
+//
+// A move only adds or removes one value, so the masks are updated with
+// a couple of bit operations rather than being recomputed from the
+// grid. Solvability is tracked with a witness: while every placed
+// value agrees with a known solution, the grid is solvable. Placing a
+// value only removes solutions, so a grid with no solution stays that
+// way until a value is erased, and erasing a value only adds
+// solutions, so a witness stays valid.
+//
+// The grid always keeps the puzzle's hints, so its solutions are
+// solutions of the puzzle. With a unique solution, the grid is
+// solvable exactly when it agrees with it, and no search is needed.
+// Otherwise a new witness is searched for in a persistent DLX graph of
+// the empty grid, with the grid's values selected, so no graph is
+// built per move.
+
+static void set_value(play_state *p, int idx, sudoku_value v);
+static void clear_value(play_state *p, int idx);
+static bool find_witness(play_state *p);
+
+// Start playing the puzzle. Return false if its hints conflict. The
+// state should be freed with play_free if it was started.
+bool play_init(play_state *p, const sudoku *puzzle)
+{
+  assert(p);
+  assert(puzzle);
+
+  memset(p, 0, sizeof(*p));
+  if (!sudoku_state_init(&p->state, puzzle)) {
+    return false;
+  }
+  for (int i = 0; i < GRID_SIZE; i++) {
+    p->given[i] = puzzle->grid[i] != 0;
+  }
+
+  // Count the solutions of the puzzle, up to 2. The first one found is
+  // the witness, and with a unique solution, also the solution.
+  p->checker = sudoku_checker_create();
+  p->solutions = 0;
+  if (find_witness(p)) {
+    sudoku copy = *puzzle;
+    p->solution = p->witness;
+    p->solutions = sudoku_checker_unique(p->checker, &copy) ? 1 : 2;
+  }
+  return true;
+}
+
+void play_free(play_state *p)
+{
+  assert(p);
+  sudoku_checker_destroy(p->checker);
+  p->checker = NULL;
+}
+
+// Check whether the value v can be placed at the grid index idx
+// without conflicting with the values already placed. Placing a value
+// over the cell's current value is allowed.
+play_result play_check(const play_state *p, int idx, sudoku_value v)
+{
+  assert(p);
+
+  if (idx < 0 || idx >= GRID_SIZE || v < 1 || v > SUDOKU_SIZE) {
+    return PLAY_INVALID;
+  } else if (p->given[idx]) {
+    return PLAY_GIVEN;
+  } else if (p->state.grid.grid[idx] == v) {
+    return PLAY_OK;
+  }
+
+  // The candidates leave out the cell's own value, which is being
+  // replaced, so check the value's units directly
+  int x = GRID_X(idx), y = GRID_Y(idx);
+  int used = p->state.rows[y] | p->state.cols[x] | p->state.secs[SEC_IDX(x, y)];
+  return (used & (1 << v)) ? PLAY_CONFLICT : PLAY_OK;
+}
+
+// Place the value v at the grid index idx, replacing any value
+// already there. The move is only made if play_check allows it.
+play_result play_place(play_state *p, int idx, sudoku_value v)
+{
+  play_result result = play_check(p, idx, v);
+  if (result != PLAY_OK || p->state.grid.grid[idx] == v) {
+    return result;
+  }
+
+  // Replacing a value erases it first, which may make an unsolvable
+  // grid solvable again
+  if (p->state.grid.grid[idx] != 0) {
+    clear_value(p, idx);
+    if (p->witness_state == WITNESS_NONE) {
+      p->witness_state = WITNESS_UNKNOWN;
+    }
+  }
+  set_value(p, idx, v);
+  if (p->witness_state == WITNESS_FOUND && p->witness.grid[idx] != v) {
+    p->witness_state = WITNESS_UNKNOWN;
+  }
+  return PLAY_OK;
+}
+
+// Erase the value at the grid index idx, if there is one
+play_result play_erase(play_state *p, int idx)
+{
+  assert(p);
+
+  if (idx < 0 || idx >= GRID_SIZE) {
+    return PLAY_INVALID;
+  } else if (p->given[idx]) {
+    return PLAY_GIVEN;
+  }
+
+  if (p->state.grid.grid[idx] != 0) {
+    clear_value(p, idx);
+    if (p->witness_state == WITNESS_NONE) {
+      p->witness_state = WITNESS_UNKNOWN;
+    }
+  }
+  return PLAY_OK;
+}
+
+// Whether every value placed so far agrees with the puzzle's unique
+// solution. Always false if the puzzle doesn't have one.
+bool play_consistent(const play_state *p)
+{
+  assert(p);
+  return p->solutions == 1 && p->wrong == 0;
+}
+
+// Whether the grid can still be completed. A search is only run when
+// the last move made the previous answer unknown, and the puzzle has
+// more than one solution: the grid keeps the puzzle's hints, so its
+// solutions also solve the puzzle, and with a unique solution the grid
+// is solvable exactly when it agrees with it.
+bool play_solvable(play_state *p)
+{
+  assert(p);
+
+  if (p->witness_state == WITNESS_UNKNOWN && p->solutions == 1) {
+    p->witness = p->solution;
+    p->witness_state = play_consistent(p) ? WITNESS_FOUND : WITNESS_NONE;
+  } else if (p->witness_state == WITNESS_UNKNOWN) {
+    p->searches++;
+    find_witness(p);
+  }
+  return p->witness_state == WITNESS_FOUND;
+}
+
+// Whether every cell has been filled. As the grid never holds a
+// conflict, a full grid is a solution.
+bool play_solved(const play_state *p)
+{
+  assert(p);
+  return p->state.empty == 0;
+}
+
+// Put the value v in the empty cell at idx, counting it if it's wrong
+static void set_value(play_state *p, int idx, sudoku_value v)
+{
+  sudoku_state_place(&p->state, idx, v);
+  p->wrong += p->solutions == 1 && p->solution.grid[idx] != v;
+}
+
+// Empty the cell at idx, uncounting its value if it was wrong
+static void clear_value(play_state *p, int idx)
+{
+  sudoku_value v = sudoku_state_remove(&p->state, idx);
+  p->wrong -= p->solutions == 1 && p->solution.grid[idx] != v;
+}
+
+// Search for a solution of the current grid, keeping it as the witness
+// if there is one. Return whether there is.
+static bool find_witness(play_state *p)
+{
+  p->witness = p->state.grid;
+  bool found = sudoku_checker_solve(p->checker, &p->witness);
+  p->witness_state = found ? WITNESS_FOUND : WITNESS_NONE;
+  return found;
+}
@@ -0,0 +1,54 @@
+#ifndef __PLAY_H__
+#define __PLAY_H__
+
+#include <stdbool.h>
+#include "sudoku.h"
+
+// The outcome of checking or making a move
+typedef enum {
+  PLAY_OK,
+  PLAY_GIVEN,    // The cell holds a hint of the puzzle
+  PLAY_CONFLICT, // The value is already in the cell's row, column or section
+  PLAY_INVALID,  // The cell or value is out of range
+} play_result;
+
+// Whether play_state's witness is a solution of the current grid
+typedef enum {
+  WITNESS_UNKNOWN, // A search is needed to tell
+  WITNESS_FOUND,   // The witness solves the grid
+  WITNESS_NONE,    // The grid has no solution
+} play_witness;
+
+// The state of a puzzle being played. The grid's sudoku_state keeps
+// the masks of the values used in each row, column and section up to
+// date as moves are made, so checking a move for conflicts is O(1).
+// Moves that conflict are rejected, so the grid never holds a
+// conflict.
+//
+// Whether the grid can still be solved is also tracked incrementally:
+// the puzzle's solution, or the last solution found for the grid, is
+// kept as a witness, and only a move that disagrees with the witness
+// needs a new search, run on a DLX graph kept for the game. Nothing is
+// allocated after play_init.
+typedef struct {
+  sudoku_state state;       // The grid and its masks
+  sudoku solution;          // The puzzle's solution, if it is unique
+  sudoku witness;           // A solution of the current grid, if known
+  bool given[GRID_SIZE];
+  int solutions;            // Solutions of the puzzle: 0, 1 or 2 for two or more
+  int wrong;                // Placed values that differ from the solution
+  play_witness witness_state;
+  size_t searches;          // Searches run to find a new witness
+  sudoku_checker *checker;  // The graph the searches are run on
+} play_state;
+
+bool play_init(play_state *p, const sudoku *puzzle);
+void play_free(play_state *p);
+play_result play_check(const play_state *p, int idx, sudoku_value v);
+play_result play_place(play_state *p, int idx, sudoku_value v);
+play_result play_erase(play_state *p, int idx);
+bool play_consistent(const play_state *p);
+bool play_solvable(play_state *p);
+bool play_solved(const play_state *p);
+
+#endif
@@ -0,0 +1,590 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "util.h"
+#include "histogram.h"
+#include "portfolio.h"
+#include "trace.h"
+
+// Solving with a portfolio of backends, for a lower tail latency than
+// any one of them gives.
+//
+// The backends are good at different puzzles: the DLX graph costs the
+// same whatever the puzzle, backtracking on the masks is fastest when
+// the hints leave little to search, and propagating singles at every
+// step cuts down the search of hard puzzles at a cost per step.
+//
+// Racing runs every backend on its own thread and takes the answer of
+// the first to finish, which cancels the others. The threads are kept
+// between puzzles and meet at barriers, so a race doesn't start any.
+//
+// Learning puts each puzzle in a class by its features, and runs the
+// backend with the lowest 99th percentile time on the class so far,
+// as the rare slow runs of a backend are what make the tail. Each
+// backend is tried a few times on a class first, and a backend other
+// than the best is still run every so often, so the table follows the
+// puzzles as they change. Those runs are cut off at a few times the
+// best backend's percentile, and the best one answers instead, so
+// trying a backend that is slow on the class costs little.
+
+// Runs of each backend on a class before the table is trusted
+#define LEARN_WARMUP 4
+// Run another backend than the best on one in this many puzzles
+#define LEARN_EXPLORE 32
+// The percentile of the times backends are picked by
+#define LEARN_TAIL 0.99
+// Times of the best backend's percentile another backend may take
+#define LEARN_CAP 4
+// Times kept of a backend on a class before the older ones are halved
+#define LEARN_WINDOW 256
+// Search steps between checks of the cancel flag
+#define CANCEL_STEPS 256
+
+static const char *names[] = { "dlx", "bitset", "singles", "race", "learn" };
+
+typedef struct {
+  size_t samples;
+  histogram times; // The times to solve, in nanoseconds
+} table_entry;
+
+struct portfolio {
+  portfolio_strategy strategy;
+  sudoku_checker *checker;    // The DLX backend's graph
+  table_entry table[PORTFOLIO_CLASSES][PORTFOLIO_BACKENDS];
+  size_t class_solves[PORTFOLIO_CLASSES];
+  portfolio_stats stats;
+  portfolio_backend last;     // The backend that answered the last puzzle
+
+  // The race. The calling thread runs the first backend, and a thread
+  // for each of the others waits at the start barrier.
+  pthread_t threads[PORTFOLIO_BACKENDS];
+  pthread_barrier_t start, done;
+  sudoku puzzle;              // The puzzle being raced
+  sudoku solution;            // The winner's grid
+  int winner;                 // The backend that finished first, or -1
+  bool solved;                // Whether the winner solved the puzzle
+  int cancel;                 // Set once there is a winner
+  bool quit;                  // Set to end the threads
+};
+
+// The state of a backtracking search
+typedef struct {
+  const int *cancel;
+  double deadline; // When to give up, or 0 for never
+  size_t steps;
+  bool cancelled;
+} search_ctx;
+
+// What a race thread is started with
+typedef struct {
+  portfolio *pf;
+  portfolio_backend backend;
+} race_arg;
+
+static bool run_backend(portfolio *pf, portfolio_backend backend, sudoku *s,
+                        const int *cancel, double deadline, bool *gave_up);
+static void race(portfolio *pf, portfolio_backend backend);
+static void *race_thread(void *arg);
+static portfolio_backend choose_backend(portfolio *pf, int class, int *best);
+static void learn(portfolio *pf, int class, portfolio_backend backend, double seconds);
+static double tail_seconds(const table_entry *e);
+static bool bitset_search(sudoku_state *st, search_ctx *ctx);
+static bool singles_search(sudoku_state *st, search_ctx *ctx);
+static bool propagate(sudoku_state *st, int *trail, int *ntrail);
+static int fewest_candidates(const sudoku_state *st, int *cand);
+static bool check_cancel(search_ctx *ctx);
+static inline int unit_cell(int unit, int i);
+static inline int unit_used(const sudoku_state *st, int unit);
+
+// Create a portfolio that solves puzzles with the given strategy. A
+// racing portfolio starts a thread for each backend but the first.
+portfolio *portfolio_create(portfolio_strategy strategy)
+{
+  portfolio *pf = calloc(1, sizeof(portfolio));
+  if (pf == NULL) {
+    fatal("failed to allocate memory for portfolio");
+  }
+  pf->strategy = strategy;
+  pf->checker = sudoku_checker_create();
+
+  if (strategy == STRATEGY_RACE) {
+    sudoku_checker_set_cancel(pf->checker, &pf->cancel);
+    pthread_barrier_init(&pf->start, NULL, PORTFOLIO_BACKENDS);
+    pthread_barrier_init(&pf->done, NULL, PORTFOLIO_BACKENDS);
+    for (int b = 1; b < PORTFOLIO_BACKENDS; b++) {
+      race_arg *arg = malloc(sizeof(race_arg));
+      if (arg == NULL) {
+        fatal("failed to allocate memory for race thread");
+      }
+      arg->pf = pf;
+      arg->backend = b;
+      if (pthread_create(&pf->threads[b], NULL, race_thread, arg) != 0) {
+        fatal("failed to create race thread");
+      }
+    }
+  }
+  return pf;
+}
+
+void portfolio_destroy(portfolio *pf)
+{
+  assert(pf);
+
+  if (pf->strategy == STRATEGY_RACE) {
+    pf->quit = true;
+    pthread_barrier_wait(&pf->start);
+    for (int b = 1; b < PORTFOLIO_BACKENDS; b++) {
+      pthread_join(pf->threads[b], NULL);
+    }
+    pthread_barrier_destroy(&pf->start);
+    pthread_barrier_destroy(&pf->done);
+  }
+  sudoku_checker_destroy(pf->checker);
+  free(pf);
+}
+
+// Solve the puzzle and fill in the solution, the way sudoku_solve
+// does, with the backend the portfolio's strategy picks. Return false
+// if the puzzle has no solution.
+bool portfolio_solve(portfolio *pf, sudoku *s)
+{
+  assert(pf);
+  assert(s);
+
+  bool solved;
+  pf->stats.puzzles++;
+  pf->last = BACKEND_DLX;
+  if (pf->strategy == STRATEGY_RACE) {
+    pf->puzzle = *s;
+    pf->winner = -1;
+    pf->cancel = 0;
+    pthread_barrier_wait(&pf->start);
+    race(pf, 0);
+    pthread_barrier_wait(&pf->done);
+
+    for (int b = 0; b < PORTFOLIO_BACKENDS; b++) {
+      pf->stats.runs[b]++;
+    }
+    pf->stats.wins[pf->winner]++;
+    pf->last = pf->winner;
+    solved = pf->solved;
+    if (solved) {
+      *s = pf->solution;
+    }
+  } else if (pf->strategy == STRATEGY_LEARN) {
+    sudoku_state st;
+    portfolio_features f;
+    if (!sudoku_state_init(&st, s)) {
+      return false;
+    }
+    portfolio_features_get(&st, &f);
+    int best;
+    portfolio_backend backend = choose_backend(pf, f.class, &best);
+
+    // A backend other than the best gives up at LEARN_CAP times the
+    // best one's percentile, and the best one answers instead
+    double start = get_time(), deadline = 0;
+    if (best >= 0 && backend != best) {
+      deadline = start + LEARN_CAP * tail_seconds(&pf->table[f.class][best]);
+    }
+    bool gave_up = false;
+    solved = run_backend(pf, backend, s, NULL, deadline, &gave_up);
+    learn(pf, f.class, backend, get_time() - start);
+    pf->stats.runs[backend]++;
+    if (gave_up) {
+      backend = best;
+      start = get_time();
+      solved = run_backend(pf, backend, s, NULL, 0, NULL);
+      learn(pf, f.class, backend, get_time() - start);
+      pf->stats.runs[backend]++;
+    }
+    pf->stats.wins[backend]++;
+    pf->last = backend;
+  } else {
+    portfolio_backend backend = (portfolio_backend) pf->strategy;
+    solved = run_backend(pf, backend, s, NULL, 0, NULL);
+    pf->stats.runs[backend]++;
+    pf->stats.wins[backend]++;
+    pf->last = backend;
+  }
+
+  pf->stats.solved += solved;
+  return solved;
+}
+
+// Get the backend that answered the last puzzle. Running that backend
+// alone gives the same answer again, even after a race.
+portfolio_backend portfolio_last_backend(const portfolio *pf)
+{
+  assert(pf);
+  return pf->last;
+}
+
+void portfolio_get_stats(const portfolio *pf, portfolio_stats *stats)
+{
+  assert(pf);
+  assert(stats);
+  *stats = pf->stats;
+}
+
+// Print the learned percentile times of the backends on each class
+// that has been seen, with the backend picked for it
+void portfolio_print_table(const portfolio *pf, FILE *fp)
+{
+  static const char *hint_classes[] = { "<24", "24-27", "28-35", ">35" };
+  static const char *tight_classes[] = { "<1/8", "<1/4", ">=1/4" };
+
+  assert(pf);
+  assert(fp);
+
+  fprintf(fp, "hints  tight  puzzles");
+  for (int b = 0; b < PORTFOLIO_BACKENDS; b++) {
+    fprintf(fp, " %9s", names[b]);
+  }
+  fprintf(fp, "  choice\n");
+
+  for (int c = 0; c < PORTFOLIO_CLASSES; c++) {
+    if (pf->class_solves[c] == 0) {
+      continue;
+    }
+    int best = -1;
+    fprintf(fp, "%-6s %-6s %7zu", hint_classes[c / PORTFOLIO_TIGHT_CLASSES],
+            tight_classes[c % PORTFOLIO_TIGHT_CLASSES], pf->class_solves[c]);
+    for (int b = 0; b < PORTFOLIO_BACKENDS; b++) {
+      const table_entry *e = &pf->table[c][b];
+      if (e->samples == 0) {
+        fprintf(fp, " %9s", "-");
+      } else {
+        fprintf(fp, " %7.1fus", tail_seconds(e) * 1e6);
+      }
+      if (e->samples > 0 && (best < 0 || tail_seconds(e) < tail_seconds(&pf->table[c][best]))) {
+        best = b;
+      }
+    }
+    fprintf(fp, "  %s\n", best < 0 ? "-" : names[best]);
+  }
+}
+
+// Get the features of the puzzle in the state
+void portfolio_features_get(const sudoku_state *st, portfolio_features *f)
+{
+  assert(st);
+  assert(f);
+
+  memset(f, 0, sizeof(*f));
+  f->hints = GRID_SIZE - st->empty;
+  for (int i = 0; i < GRID_SIZE; i++) {
+    if (st->grid.grid[i] == 0) {
+      int count = 0;
+      for (int m = sudoku_state_candidates(st, i); m != 0; m &= m - 1) {
+        count++;
+      }
+      f->candidates[count]++;
+    }
+  }
+
+  int tight = f->candidates[0] + f->candidates[1] + f->candidates[2];
+  int hint_class = f->hints < 24 ? 0 : f->hints < 28 ? 1 : f->hints < 36 ? 2 : 3;
+  int tight_class = 8*tight < st->empty ? 0 : 4*tight < st->empty ? 1 : 2;
+  f->class = hint_class*PORTFOLIO_TIGHT_CLASSES + tight_class;
+}
+
+const char *portfolio_backend_name(portfolio_backend backend)
+{
+  assert(backend >= 0 && backend < PORTFOLIO_BACKENDS);
+  return names[backend];
+}
+
+// Parse the name of a strategy: dlx, bitset, singles, race or learn
+bool portfolio_parse_strategy(const char *name, portfolio_strategy *strategy)
+{
+  assert(name);
+  assert(strategy);
+
+  for (int i = 0; i < sizeof(names)/sizeof(names[0]); i++) {
+    if (strcmp(name, names[i]) == 0) {
+      *strategy = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Solve the puzzle with one backend, filling in the solution. The
+// search gives up, and fails, once *cancel is set or at the deadline,
+// unless it is 0. If gave_up isn't NULL, it is set to whether it did.
+static bool run_backend(portfolio *pf, portfolio_backend backend, sudoku *s,
+                        const int *cancel, double deadline, bool *gave_up)
+{
+  trace_begin(portfolio_backend_name(backend), -1);
+  bool found = false, stopped = false;
+  if (backend == BACKEND_DLX) {
+    sudoku_checker_set_deadline(pf->checker, deadline);
+    found = sudoku_checker_solve(pf->checker, s);
+    stopped = sudoku_checker_timed_out(pf->checker);
+  } else {
+    sudoku_state st;
+    search_ctx ctx = { cancel, deadline, 0, false };
+    if (sudoku_state_init(&st, s)) {
+      found = backend == BACKEND_BITSET ? bitset_search(&st, &ctx) :
+                                          singles_search(&st, &ctx);
+      if (found) {
+        *s = st.grid;
+      }
+    }
+    stopped = ctx.cancelled;
+  }
+  trace_end();
+  if (gave_up != NULL) {
+    *gave_up = stopped;
+  }
+  return found;
+}
+
+// Run a backend on the puzzle being raced. The first to finish, with
+// or without a solution, is the winner and cancels the others. Those
+// only see the flag once the winner is set, so their answers are
+// never taken.
+static void race(portfolio *pf, portfolio_backend backend)
+{
+  sudoku grid = pf->puzzle;
+  bool solved = run_backend(pf, backend, &grid, &pf->cancel, 0, NULL);
+  int none = -1;
+  if (__atomic_compare_exchange_n(&pf->winner, &none, backend, false,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    pf->solved = solved;
+    pf->solution = grid;
+    __atomic_store_n(&pf->cancel, 1, __ATOMIC_RELEASE);
+  }
+}
+
+// Race one backend on each puzzle until the portfolio is destroyed
+static void *race_thread(void *arg)
+{
+  race_arg *ra = arg;
+  portfolio *pf = ra->pf;
+  portfolio_backend backend = ra->backend;
+  free(ra);
+
+  for (;;) {
+    pthread_barrier_wait(&pf->start);
+    if (pf->quit) {
+      break;
+    }
+    race(pf, backend);
+    pthread_barrier_wait(&pf->done);
+  }
+  return NULL;
+}
+
+// Pick the backend to run on a puzzle of the class. best is set to the
+// backend with the lowest percentile time so far, or -1 if none has
+// been run on the class.
+static portfolio_backend choose_backend(portfolio *pf, int class, int *best)
+{
+  table_entry *entries = pf->table[class];
+  size_t n = pf->class_solves[class]++;
+
+  *best = -1;
+  for (int b = 0; b < PORTFOLIO_BACKENDS; b++) {
+    if (entries[b].samples > 0 &&
+        (*best < 0 || tail_seconds(&entries[b]) < tail_seconds(&entries[*best]))) {
+      *best = b;
+    }
+  }
+
+  for (int b = 0; b < PORTFOLIO_BACKENDS; b++) {
+    if (entries[b].samples < LEARN_WARMUP) {
+      return b;
+    }
+  }
+  if (n % LEARN_EXPLORE == 0) {
+    return (n / LEARN_EXPLORE) % PORTFOLIO_BACKENDS;
+  }
+  return *best;
+}
+
+// Add the time a backend took on a puzzle of the class to its times.
+// Once there are LEARN_WINDOW of them, their counts are halved, so the
+// percentile follows the recent times.
+static void learn(portfolio *pf, int class, portfolio_backend backend, double seconds)
+{
+  table_entry *e = &pf->table[class][backend];
+  e->samples++;
+  histogram_record(&e->times, seconds * 1e9);
+  if (e->times.count >= LEARN_WINDOW) {
+    histogram_halve(&e->times);
+  }
+}
+
+// Get the percentile of a backend's times on a class, in seconds
+static double tail_seconds(const table_entry *e)
+{
+  return histogram_percentile(&e->times, LEARN_TAIL) / 1e9;
+}
+
+// Search for a solution, trying the values of the cell with the fewest
+// candidates first. The solution is left in the state.
+static bool bitset_search(sudoku_state *st, search_ctx *ctx)
+{
+  if (check_cancel(ctx)) {
+    return false;
+  }
+
+  int cand, best = fewest_candidates(st, &cand);
+  if (best < 0) {
+    return true;
+  }
+  for (; cand != 0; cand &= cand - 1) {
+    sudoku_state_place(st, best, __builtin_ctz(cand));
+    if (bitset_search(st, ctx)) {
+      return true;
+    }
+    sudoku_state_remove(st, best);
+  }
+  return false;
+}
+
+// Search like bitset_search, but place the naked and hidden singles
+// before each step. The singles are undone if the step fails.
+static bool singles_search(sudoku_state *st, search_ctx *ctx)
+{
+  int trail[GRID_SIZE], ntrail = 0;
+
+  if (!check_cancel(ctx) && propagate(st, trail, &ntrail)) {
+    int cand, best = fewest_candidates(st, &cand);
+    if (best < 0) {
+      return true;
+    }
+    for (; cand != 0; cand &= cand - 1) {
+      sudoku_state_place(st, best, __builtin_ctz(cand));
+      if (singles_search(st, ctx)) {
+        return true;
+      }
+      sudoku_state_remove(st, best);
+    }
+  }
+
+  while (ntrail > 0) {
+    sudoku_state_remove(st, trail[--ntrail]);
+  }
+  return false;
+}
+
+// Place naked and hidden singles until there are none left, adding the
+// cells filled to the trail. Return false if a cell has no candidates
+// or a unit has no place for a value.
+static bool propagate(sudoku_state *st, int *trail, int *ntrail)
+{
+  bool changed = true;
+  while (changed && st->empty > 0) {
+    changed = false;
+
+    for (int i = 0; i < GRID_SIZE; i++) {
+      if (st->grid.grid[i] == 0) {
+        int cand = sudoku_state_candidates(st, i);
+        if (cand == 0) {
+          return false;
+        } else if ((cand & (cand - 1)) == 0) {
+          sudoku_state_place(st, i, __builtin_ctz(cand));
+          trail[(*ntrail)++] = i;
+          changed = true;
+        }
+      }
+    }
+
+    // Find the values that are a candidate of exactly one cell of a
+    // unit, from the values seen once and those seen more than once
+    for (int u = 0; u < 3*SUDOKU_SIZE; u++) {
+      int once = 0, twice = 0;
+      for (int i = 0; i < SUDOKU_SIZE; i++) {
+        int idx = unit_cell(u, i);
+        int cand = st->grid.grid[idx] == 0 ? sudoku_state_candidates(st, idx) : 0;
+        twice |= once & cand;
+        once |= cand;
+      }
+      if ((once | unit_used(st, u)) != SUDOKU_ALL_VALUES) {
+        return false;
+      }
+
+      for (int hidden = once & ~twice; hidden != 0; hidden &= hidden - 1) {
+        int v = __builtin_ctz(hidden), i = 0;
+        while (i < SUDOKU_SIZE) {
+          int idx = unit_cell(u, i);
+          if (st->grid.grid[idx] == 0 && (sudoku_state_candidates(st, idx) & (1 << v))) {
+            sudoku_state_place(st, idx, v);
+            trail[(*ntrail)++] = idx;
+            changed = true;
+            break;
+          }
+          i++;
+        }
+        // The one cell the value could go in took another value
+        if (i == SUDOKU_SIZE) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Find the empty cell with the fewest candidates, storing its
+// candidates in cand. Return -1 if the grid is full.
+static int fewest_candidates(const sudoku_state *st, int *cand)
+{
+  int best = -1, best_count = SUDOKU_SIZE+1;
+  *cand = 0;
+  for (int i = 0; i < GRID_SIZE && best_count > 1; i++) {
+    if (st->grid.grid[i] == 0) {
+      int c = sudoku_state_candidates(st, i), count = 0;
+      for (int m = c; m != 0; m &= m - 1) {
+        count++;
+      }
+      if (count < best_count) {
+        best = i;
+        best_count = count;
+        *cand = c;
+      }
+    }
+  }
+  return best;
+}
+
+// Whether the search should give up, checking the cancel flag and the
+// deadline every so often
+static bool check_cancel(search_ctx *ctx)
+{
+  if ((ctx->cancel != NULL || ctx->deadline > 0) && !ctx->cancelled &&
+      ++ctx->steps % CANCEL_STEPS == 0) {
+    ctx->cancelled = (ctx->cancel != NULL && __atomic_load_n(ctx->cancel, __ATOMIC_RELAXED)) ||
+      (ctx->deadline > 0 && get_time() > ctx->deadline);
+  }
+  return ctx->cancelled;
+}
+
+// Get the grid index of cell i of a unit. Units 0-8 are rows, 9-17
+// columns and 18-26 sections.
+static inline int unit_cell(int unit, int i)
+{
+  if (unit < SUDOKU_SIZE) {
+    return GRID_IDX(i, unit);
+  } else if (unit < 2*SUDOKU_SIZE) {
+    return GRID_IDX(unit - SUDOKU_SIZE, i);
+  }
+  int sec = unit - 2*SUDOKU_SIZE;
+  return GRID_IDX((sec % 3)*3 + i % 3, (sec / 3)*3 + i / 3);
+}
+
+// Get the mask of the values a unit already holds
+static inline int unit_used(const sudoku_state *st, int unit)
+{
+  if (unit < SUDOKU_SIZE) {
+    return st->rows[unit];
+  } else if (unit < 2*SUDOKU_SIZE) {
+    return st->cols[unit - SUDOKU_SIZE];
+  }
+  return st->secs[unit - 2*SUDOKU_SIZE];
+}
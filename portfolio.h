@@ -0,0 +1,59 @@
+#ifndef __PORTFOLIO_H__
+#define __PORTFOLIO_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "sudoku.h"
+
+// The solvers a portfolio chooses between
+typedef enum {
+  BACKEND_DLX,     // Dancing links on a persistent graph
+  BACKEND_BITSET,  // Backtracking on the candidate masks
+  BACKEND_SINGLES, // Backtracking that propagates singles at each step
+  PORTFOLIO_BACKENDS,
+} portfolio_backend;
+
+// How a portfolio picks the backend for a puzzle. The first strategies
+// always use the backend of the same number.
+typedef enum {
+  STRATEGY_DLX,
+  STRATEGY_BITSET,
+  STRATEGY_SINGLES,
+  STRATEGY_RACE,  // Run every backend at once, and cancel the losers
+  STRATEGY_LEARN, // Run the backend with the lowest p99 time on the class
+} portfolio_strategy;
+
+// Puzzles are put in classes by their hints and by the share of empty
+// cells with at most 2 candidates, which tells how much propagation
+// has to work with
+#define PORTFOLIO_HINT_CLASSES 4
+#define PORTFOLIO_TIGHT_CLASSES 3
+#define PORTFOLIO_CLASSES (PORTFOLIO_HINT_CLASSES*PORTFOLIO_TIGHT_CLASSES)
+
+// Features of a puzzle that are cheap to compute from its masks
+typedef struct {
+  int hints;
+  int candidates[SUDOKU_SIZE+1]; // Empty cells by their number of candidates
+  int class;
+} portfolio_features;
+
+typedef struct {
+  size_t puzzles;
+  size_t solved;
+  size_t runs[PORTFOLIO_BACKENDS]; // Puzzles each backend was run on
+  size_t wins[PORTFOLIO_BACKENDS]; // Puzzles each backend answered
+} portfolio_stats;
+
+typedef struct portfolio portfolio;
+
+portfolio *portfolio_create(portfolio_strategy strategy);
+void portfolio_destroy(portfolio *pf);
+bool portfolio_solve(portfolio *pf, sudoku *s);
+portfolio_backend portfolio_last_backend(const portfolio *pf);
+void portfolio_get_stats(const portfolio *pf, portfolio_stats *stats);
+void portfolio_print_table(const portfolio *pf, FILE *fp);
+void portfolio_features_get(const sudoku_state *st, portfolio_features *f);
+const char *portfolio_backend_name(portfolio_backend backend);
+bool portfolio_parse_strategy(const char *name, portfolio_strategy *strategy);
+
+#endif
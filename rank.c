@@ -0,0 +1,649 @@
+#include <string.h>
+#include <assert.h>
+#include "util.h"
+#include "rank.h"
+
+// Ranks of solution grids: numbers that a grid can be rebuilt from,
+// so that a grid can be stored in RANK_BYTES rather than 81, and grids
+// can be picked uniformly at random by drawing ranks.
+//
+// A rank is a mixed radix number made from the band and stack
+// structure of the grid. Its digits are:
+//
+//  - the order of the values in the top left box, one of 9!
+//  - how the values of each row of that box are split among the rows
+//    of the other two boxes of the top band, one of 56, and the order
+//    of the values in each of those six rows, one of 6^6
+//  - the same for the columns of the left stack
+//  - the index of the rest of the grid among the ways to complete it,
+//    below MAX_COMPLETIONS
+//
+// Every choice of the first six digits gives a valid top band and left
+// stack, and the completions are walked in a fixed order to find the
+// last one, so ranking and unranking take microseconds. A completion
+// is walked by filling the center box, which has at most MAX_CENTERS
+// ways. After that each row of the box right of the center, and each
+// column of the box below it, has at most 2 orders that fit, and the
+// bottom right box is fixed.
+//
+// Only the last digit can be out of range for its band and stack, so a
+// rank takes 76 bits rather than the 72.5 bits of the number of grids,
+// and about 1 rank in 10 is of a grid. Since every grid has exactly one
+// rank, drawing ranks until one is of a grid picks grids uniformly.
+
+// Orders of the values in a box, 9!
+#define BOX_ORDERS 362880
+// Ways to split the values of the lines of the top left box among the
+// lines of the next box of its band or stack
+#define SPLITS 56
+// Orders of the values in the six lines of the two boxes, 6^6
+#define LINE_ORDERS 46656
+// Most ways to fill the center box given the top band and left stack,
+// found by trying every split of its values among its rows and columns
+#define MAX_CENTERS 448
+#define MAX_COMPLETIONS (MAX_CENTERS*8*8)
+// A mask of the nine cells of a box
+#define ALL_CELLS 0x1ff
+
+// A mask with the bit of each value in a box, bit v-1 for the value v
+#define VALUE_BIT(v) (1 << ((v)-1))
+// Three masks packed 10 bits apart, so that all three can be tested at
+// once
+#define PACK3(a, b, c) ((uint32_t) (a) | (uint32_t) (b) << 10 | (uint32_t) (c) << 20)
+#define FIELD(packed, i) ((packed) >> 10*(i) & ALL_CELLS)
+#define ONES3 PACK3(ALL_CELLS, ALL_CELLS, ALL_CELLS)
+#define TOPS3 PACK3(0x200, 0x200, 0x200)
+
+// The ways a split of the values of the center among its rows (or its
+// columns) goes on into the box right of the center (below it): the
+// orders of the lines of that box that fit, and the column (row) of the
+// bottom right box that each leaves each value
+typedef struct {
+  int n;                        // Combinations of orders that fit, at most 8
+  int orders[3];                // Orders of each line that fit, at most 2
+  sudoku_value values[3][2][3]; // The values of each line in each order
+  uint32_t lines[8];            // The values of each line of the bottom right box, packed
+  uint32_t spread[8][3];        // And each of those lines three times
+} split_ways;
+
+// The completions of a top band and left stack. The center box is made
+// from a split of its values among its rows and one among its columns,
+// and fits if every cell gets a value. The boxes right of and below the
+// center follow from the ways of those splits, and the bottom right box
+// fits if every cell gets a value.
+typedef struct {
+  int rows[SPLITS][3];      // Splits of the center's values among its rows
+  int cols[SPLITS][3];      // And among its columns
+  uint32_t packed_rows[SPLITS];    // The rows of each split, packed
+  uint32_t spread_cols[SPLITS][3]; // Each column of each split, three times
+  split_ways right[SPLITS]; // The ways of each split among the rows
+  split_ways below[SPLITS]; // The ways of each split among the columns
+} completions;
+
+static int box0_pos(int idx);
+static int line_cell(bool stack, int line, int box, int k);
+static int order_of_three(const int *p);
+static void sort_three(int *p, int order);
+static int get_triples(int mask, int *triples);
+static void get_splits(const int *lines, int splits[SPLITS][3]);
+static void get_box0_splits(bool stack, int splits[SPLITS][3]);
+static int find_split(int splits[SPLITS][3], const int *masks);
+static void rank_side(const sudoku *s, bool stack, int *split, int *orders);
+static void unrank_side(sudoku *s, bool stack, int split, int orders);
+static void get_completions(const sudoku *s, completions *c);
+static void get_split_ways(const int *split, const int *outer, const int *far, split_ways *w);
+static bool all_fields(uint32_t packed);
+static bool center_fits(const completions *c, int row, int col);
+static bool corner_fits(uint32_t cols, const uint32_t *rows);
+static void way_orders(const split_ways *w, int way, int *which);
+static int find_way(const split_ways *w, const sudoku *s, bool below);
+static void fill_completion(const completions *c, int row, int col, int right, int below,
+                            sudoku *s);
+static bool walk_completions(sudoku *s, bool ranking, uint32_t *index);
+
+// Get the number of ranks. Every grid's rank is below it.
+grid_rank rank_limit(void)
+{
+  grid_rank limit = BOX_ORDERS;
+  limit = limit*SPLITS*LINE_ORDERS;
+  limit = limit*SPLITS*LINE_ORDERS;
+  return limit*MAX_COMPLETIONS;
+}
+
+// Get the rank of a solution grid. Return false if the grid isn't
+// filled in, or breaks the rules.
+bool rank_grid(const sudoku *s, grid_rank *rank)
+{
+  assert(s);
+  assert(rank);
+
+  sudoku_state st;
+  if (!sudoku_state_init(&st, s) || st.empty != 0) {
+    return false;
+  }
+
+  int box = 0, used = 0;
+  for (int p = 0; p < SUDOKU_SIZE; p++) {
+    sudoku_value v = s->grid[GRID_IDX(p%3, p/3)];
+    box = box*(SUDOKU_SIZE-p) + __builtin_popcount(~used & ((1 << v) - 1) & SUDOKU_ALL_VALUES);
+    used |= 1 << v;
+  }
+  int band_split, band_orders, stack_split, stack_orders;
+  rank_side(s, false, &band_split, &band_orders);
+  rank_side(s, true, &stack_split, &stack_orders);
+
+  sudoku grid = *s;
+  uint32_t completion;
+  walk_completions(&grid, true, &completion);
+
+  grid_rank r = box;
+  r = (r*SPLITS + band_split)*LINE_ORDERS + band_orders;
+  r = (r*SPLITS + stack_split)*LINE_ORDERS + stack_orders;
+  *rank = r*MAX_COMPLETIONS + completion;
+  return true;
+}
+
+// Rebuild the grid with the given rank. Return false if the rank isn't
+// of a grid, which is the case for most numbers below rank_limit.
+bool rank_unrank(grid_rank rank, sudoku *s)
+{
+  assert(s);
+
+  if (rank >= rank_limit()) {
+    return false;
+  }
+  uint32_t completion = rank % MAX_COMPLETIONS;
+  rank /= MAX_COMPLETIONS;
+  int stack_orders = rank % LINE_ORDERS;
+  rank /= LINE_ORDERS;
+  int stack_split = rank % SPLITS;
+  rank /= SPLITS;
+  int band_orders = rank % LINE_ORDERS;
+  rank /= LINE_ORDERS;
+  int band_split = rank % SPLITS;
+  rank /= SPLITS;
+  int box = rank;
+
+  // Take the digits of the order of the top left box from the last
+  memset(s, 0, sizeof(sudoku));
+  int digits[SUDOKU_SIZE];
+  for (int p = SUDOKU_SIZE-1; p >= 0; p--) {
+    digits[p] = box % (SUDOKU_SIZE-p);
+    box /= SUDOKU_SIZE-p;
+  }
+  int used = 0;
+  for (int p = 0; p < SUDOKU_SIZE; p++) {
+    sudoku_value v = 1;
+    for (int skip = digits[p]; skip > 0 || (used & 1 << v); v++) {
+      if (!(used & 1 << v)) {
+        skip--;
+      }
+    }
+    s->grid[GRID_IDX(p%3, p/3)] = v;
+    used |= 1 << v;
+  }
+  unrank_side(s, false, band_split, band_orders);
+  unrank_side(s, true, stack_split, stack_orders);
+
+  return walk_completions(s, false, &completion);
+}
+
+// Pick a solution grid uniformly at random with the calling thread's
+// generator, by drawing ranks until one is of a grid
+void rank_sample(sudoku *s)
+{
+  assert(s);
+
+  // The digits are drawn one at a time, as rng_int's range is an int
+  grid_rank rank;
+  do {
+    rank = rng_int(BOX_ORDERS);
+    rank = (rank*SPLITS + rng_int(SPLITS))*LINE_ORDERS + rng_int(LINE_ORDERS);
+    rank = (rank*SPLITS + rng_int(SPLITS))*LINE_ORDERS + rng_int(LINE_ORDERS);
+    rank = rank*MAX_COMPLETIONS + rng_int(MAX_COMPLETIONS);
+  } while (!rank_unrank(rank, s));
+}
+
+// Store a rank in RANK_BYTES bytes, least significant first
+void rank_pack(grid_rank rank, uint8_t *bytes)
+{
+  assert(bytes);
+  assert(rank < rank_limit());
+  for (int i = 0; i < RANK_BYTES; i++) {
+    bytes[i] = rank >> 8*i;
+  }
+}
+
+grid_rank rank_unpack(const uint8_t *bytes)
+{
+  assert(bytes);
+  grid_rank rank = 0;
+  for (int i = RANK_BYTES-1; i >= 0; i--) {
+    rank = rank << 8 | bytes[i];
+  }
+  return rank;
+}
+
+// Write a rank in decimal into buf, which has room for RANK_DIGITS
+void rank_format(grid_rank rank, char *buf)
+{
+  assert(buf);
+
+  char digits[RANK_DIGITS];
+  int n = 0;
+  do {
+    digits[n++] = '0' + rank % 10;
+    rank /= 10;
+  } while (rank > 0);
+  for (int i = 0; i < n; i++) {
+    buf[i] = digits[n-1-i];
+  }
+  buf[n] = '\0';
+}
+
+// Parse a rank in decimal, with no other characters than trailing
+// white space. Return false if it isn't below rank_limit.
+bool rank_parse(const char *str, grid_rank *rank)
+{
+  assert(str);
+  assert(rank);
+
+  grid_rank r = 0, limit = rank_limit();
+  const char *c = str;
+  for (; *c >= '0' && *c <= '9'; c++) {
+    r = r*10 + (*c - '0');
+    if (r >= limit) {
+      return false;
+    }
+  }
+  if (c == str || strspn(c, " \t\r\n") != strlen(c)) {
+    return false;
+  }
+  *rank = r;
+  return true;
+}
+
+// Get the position in the top left box of the cell at the grid index
+static int box0_pos(int idx)
+{
+  return 3*GRID_Y(idx) + GRID_X(idx);
+}
+
+// Get the grid index of cell k of line i of box b of the top band, or
+// of the left stack. The lines of the band are its rows, and its boxes
+// go right from the top left one. The lines of the stack are its
+// columns, and its boxes go down.
+static int line_cell(bool stack, int line, int box, int k)
+{
+  return stack ? GRID_IDX(line, 3*box + k) : GRID_IDX(3*box + k, line);
+}
+
+// Get the index of the order of three distinct numbers among the six
+// orders of them, in lexicographic order
+static int order_of_three(const int *p)
+{
+  int first = (p[1] < p[0]) + (p[2] < p[0]);
+  return 2*first + (p[2] < p[1]);
+}
+
+// Put three numbers in increasing order into the order with the given
+// index, the inverse of order_of_three
+static void sort_three(int *p, int order)
+{
+  int sorted[3] = { p[0], p[1], p[2] };
+  for (int i = 0; i < 2; i++) {
+    for (int j = i+1; j < 3; j++) {
+      if (sorted[j] < sorted[i]) {
+        int tmp = sorted[i];
+        sorted[i] = sorted[j];
+        sorted[j] = tmp;
+      }
+    }
+  }
+  int first = order / 2, second = order % 2 < first ? order % 2 : order % 2 + 1;
+  p[0] = sorted[first];
+  p[1] = sorted[second];
+  p[2] = sorted[3 - first - second];
+}
+
+// Get the masks of every three of the bits set in mask, in a fixed
+// order. mask has at most six bits set, so there are at most 20.
+static int get_triples(int mask, int *triples)
+{
+  int bits[SUDOKU_SIZE], nbits = 0, n = 0;
+  for (; mask != 0; mask &= mask - 1) {
+    bits[nbits++] = 1 << __builtin_ctz(mask);
+  }
+  for (int i = 0; i < nbits; i++) {
+    for (int j = i+1; j < nbits; j++) {
+      for (int k = j+1; k < nbits; k++) {
+        triples[n++] = bits[i] | bits[j] | bits[k];
+      }
+    }
+  }
+  return n;
+}
+
+// Get every split of the values of three lines of a box among the
+// lines of the next box, in a fixed order. The lines are masks of three
+// values each that make up the box, and so are those of the splits:
+// each line takes three values from the other two lines, and the box
+// after the next takes the rest.
+static void get_splits(const int *lines, int splits[SPLITS][3])
+{
+  int firsts[20], seconds[20], n = 0;
+  int nfirsts = get_triples(ALL_CELLS & ~lines[0], firsts);
+  for (int i = 0; i < nfirsts; i++) {
+    int a = firsts[i];
+    int nseconds = get_triples(ALL_CELLS & ~(a | lines[1]), seconds);
+    for (int j = 0; j < nseconds; j++) {
+      int b = seconds[j], c = ALL_CELLS & ~(a | b);
+      if (c & lines[2]) {
+        continue;
+      }
+      assert(n < SPLITS);
+      splits[n][0] = a;
+      splits[n][1] = b;
+      splits[n][2] = c;
+      n++;
+    }
+  }
+  assert(n == SPLITS);
+}
+
+// Get the splits of the values of the top left box among the lines of
+// the next box in the band or stack, as masks of their positions in the
+// top left box
+static void get_box0_splits(bool stack, int splits[SPLITS][3])
+{
+  int lines[3];
+  for (int line = 0; line < 3; line++) {
+    lines[line] = 0;
+    for (int k = 0; k < 3; k++) {
+      lines[line] |= 1 << box0_pos(line_cell(stack, line, 0, k));
+    }
+  }
+  get_splits(lines, splits);
+}
+
+// Get the index of the split with the given masks
+static int find_split(int splits[SPLITS][3], const int *masks)
+{
+  int split = 0;
+  while (memcmp(splits[split], masks, 3*sizeof(int)) != 0) {
+    split++;
+    assert(split < SPLITS);
+  }
+  return split;
+}
+
+// Get the split and the orders of the lines of the top band, or the
+// left stack
+static void rank_side(const sudoku *s, bool stack, int *split, int *orders)
+{
+  int pos[SUDOKU_SIZE+1];
+  for (int p = 0; p < SUDOKU_SIZE; p++) {
+    pos[s->grid[GRID_IDX(p%3, p/3)]] = p;
+  }
+
+  int masks[3];
+  *orders = 0;
+  for (int box = 1; box < 3; box++) {
+    for (int line = 0; line < 3; line++) {
+      int p[3];
+      for (int k = 0; k < 3; k++) {
+        p[k] = pos[s->grid[line_cell(stack, line, box, k)]];
+      }
+      if (box == 1) {
+        masks[line] = 1 << p[0] | 1 << p[1] | 1 << p[2];
+      }
+      *orders = *orders*6 + order_of_three(p);
+    }
+  }
+
+  int splits[SPLITS][3];
+  get_box0_splits(stack, splits);
+  *split = find_split(splits, masks);
+}
+
+// Fill in the top band, or the left stack, from its split and orders.
+// The top left box should be filled in.
+static void unrank_side(sudoku *s, bool stack, int split, int orders)
+{
+  int splits[SPLITS][3];
+  get_box0_splits(stack, splits);
+
+  for (int box = 2; box >= 1; box--) {
+    for (int line = 2; line >= 0; line--) {
+      int mask = splits[split][line];
+      if (box == 2) {
+        // The values the line of the top left box and the next box
+        // don't have
+        mask = ALL_CELLS & ~mask;
+        for (int k = 0; k < 3; k++) {
+          mask &= ~(1 << box0_pos(line_cell(stack, line, 0, k)));
+        }
+      }
+
+      int p[3], n = 0;
+      for (int pos = 0; pos < SUDOKU_SIZE; pos++) {
+        if (mask & 1 << pos) {
+          p[n++] = pos;
+        }
+      }
+      sort_three(p, orders % 6);
+      orders /= 6;
+      for (int k = 0; k < 3; k++) {
+        s->grid[line_cell(stack, line, box, k)] = s->grid[GRID_IDX(p[k]%3, p[k]/3)];
+      }
+    }
+  }
+}
+
+// Get the completions of the top band and left stack of s
+static void get_completions(const sudoku *s, completions *c)
+{
+  int rows3[3] = { 0, 0, 0 }, cols1[3] = { 0, 0, 0 };
+  int col2[SUDOKU_SIZE+1], row6[SUDOKU_SIZE+1];
+  for (int line = 0; line < 3; line++) {
+    for (int k = 0; k < 3; k++) {
+      rows3[line] |= VALUE_BIT(s->grid[GRID_IDX(k, 3 + line)]);
+      cols1[line] |= VALUE_BIT(s->grid[GRID_IDX(3 + line, k)]);
+      col2[s->grid[GRID_IDX(6 + line, k)]] = line;
+      row6[s->grid[GRID_IDX(k, 6 + line)]] = line;
+    }
+  }
+
+  get_splits(rows3, c->rows);
+  get_splits(cols1, c->cols);
+  for (int i = 0; i < SPLITS; i++) {
+    get_split_ways(c->rows[i], rows3, col2, &c->right[i]);
+    get_split_ways(c->cols[i], cols1, row6, &c->below[i]);
+    c->packed_rows[i] = PACK3(c->rows[i][0], c->rows[i][1], c->rows[i][2]);
+    for (int j = 0; j < 3; j++) {
+      c->spread_cols[i][j] = PACK3(c->cols[i][j], c->cols[i][j], c->cols[i][j]);
+    }
+  }
+}
+
+// Get the ways of a split of the center's values among its rows, given
+// the values of the rows of the box left of the center (outer) and the
+// column of each value in the top right box (far). The same goes for a
+// split among its columns, with the box above the center and the rows
+// of the bottom left box.
+static void get_split_ways(const int *split, const int *outer, const int *far, split_ways *w)
+{
+  // Each line of the box right of the center takes the values its row
+  // lacks, in an order that keeps them out of their columns of the top
+  // right box. The orders are tried in lexicographic order.
+  static const int perms[6][3] = {
+    { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 },
+  };
+  uint32_t leaves[3][2];
+  for (int line = 0; line < 3; line++) {
+    int missing = ALL_CELLS & ~(outer[line] | split[line]), p[3];
+    for (int m = 0; m < 3; m++) {
+      p[m] = __builtin_ctz(missing) + 1;
+      missing &= missing - 1;
+    }
+    assert(missing == 0);
+
+    // Each order leaves each value the one column of the bottom right
+    // box that its column of the right stack lacks
+    int n = 0;
+    for (int order = 0; order < 6; order++) {
+      int q[3] = { p[perms[order][0]], p[perms[order][1]], p[perms[order][2]] };
+      if (far[q[0]] != 0 && far[q[1]] != 1 && far[q[2]] != 2) {
+        assert(n < 2);
+        leaves[line][n] = 0;
+        for (int k = 0; k < 3; k++) {
+          w->values[line][n][k] = q[k];
+          leaves[line][n] |= (uint32_t) VALUE_BIT(q[k]) << 10*(3 - far[q[k]] - k);
+        }
+        n++;
+      }
+    }
+    w->orders[line] = n;
+  }
+
+  w->n = w->orders[0]*w->orders[1]*w->orders[2];
+  for (int i = 0; i < w->n; i++) {
+    int which[3];
+    way_orders(w, i, which);
+    w->lines[i] = leaves[0][which[0]] | leaves[1][which[1]] | leaves[2][which[2]];
+    for (int j = 0; j < 3; j++) {
+      w->spread[i][j] = FIELD(w->lines[i], j) * PACK3(1, 1, 1);
+    }
+  }
+}
+
+// Get the order of each line in a way of a split
+static void way_orders(const split_ways *w, int way, int *which)
+{
+  for (int line = 2; line >= 0; line--) {
+    which[line] = way % w->orders[line];
+    way /= w->orders[line];
+  }
+}
+
+// Whether none of the three packed masks is empty
+static bool all_fields(uint32_t packed)
+{
+  return ((packed + ONES3) & TOPS3) == TOPS3;
+}
+
+// Whether a split of the center's values among its rows and one among
+// its columns put a value in every cell
+static bool center_fits(const completions *c, int row, int col)
+{
+  uint32_t rows = c->packed_rows[row];
+  return all_fields(rows & c->spread_cols[col][0]) &&
+    all_fields(rows & c->spread_cols[col][1]) && all_fields(rows & c->spread_cols[col][2]);
+}
+
+// Whether the values of the columns of the bottom right box, and of
+// each of its rows spread three times, put a value in every cell
+static bool corner_fits(uint32_t cols, const uint32_t *rows)
+{
+  uint32_t tops = (cols & rows[0]) + ONES3;
+  tops &= (cols & rows[1]) + ONES3;
+  tops &= (cols & rows[2]) + ONES3;
+  return (tops & TOPS3) == TOPS3;
+}
+
+// Get which of the ways of a split the box right of the center of s, or
+// below it, follows
+static int find_way(const split_ways *w, const sudoku *s, bool below)
+{
+  for (int i = 0; i < w->n; i++) {
+    int which[3];
+    way_orders(w, i, which);
+    bool same = true;
+    for (int line = 0; line < 3 && same; line++) {
+      for (int k = 0; k < 3; k++) {
+        int idx = below ? GRID_IDX(3 + line, 6 + k) : GRID_IDX(6 + k, 3 + line);
+        same = same && s->grid[idx] == w->values[line][which[line]][k];
+      }
+    }
+    if (same) {
+      return i;
+    }
+  }
+  assert(false);
+  return -1;
+}
+
+// Fill in the center and the boxes right of it, below it and in the
+// bottom right from the splits and ways of a completion
+static void fill_completion(const completions *c, int row, int col, int right, int below,
+                            sudoku *s)
+{
+  const split_ways *r = &c->right[row], *b = &c->below[col];
+  int right_orders[3], below_orders[3];
+  way_orders(r, right, right_orders);
+  way_orders(b, below, below_orders);
+  for (int j = 0; j < 3; j++) {
+    for (int k = 0; k < 3; k++) {
+      s->grid[GRID_IDX(3 + k, 3 + j)] = __builtin_ctz(c->rows[row][j] & c->cols[col][k]) + 1;
+      s->grid[GRID_IDX(6 + k, 3 + j)] = r->values[j][right_orders[j]][k];
+      s->grid[GRID_IDX(3 + j, 6 + k)] = b->values[j][below_orders[j]][k];
+      int corner = FIELD(b->lines[below], j) & FIELD(r->lines[right], k);
+      s->grid[GRID_IDX(6 + k, 6 + j)] = __builtin_ctz(corner) + 1;
+    }
+  }
+}
+
+// Walk the completions of the top band and left stack of s in order.
+// When ranking, s is the whole grid, and the completions before its
+// own are counted into index. Otherwise the completion at index is
+// filled in, and false is returned if there isn't one.
+static bool walk_completions(sudoku *s, bool ranking, uint32_t *index)
+{
+  completions c;
+  get_completions(s, &c);
+
+  int target_row = -1, target_col = -1, target_right = -1, target_below = -1;
+  if (ranking) {
+    int rows[3] = { 0, 0, 0 }, cols[3] = { 0, 0, 0 };
+    for (int line = 0; line < 3; line++) {
+      for (int k = 0; k < 3; k++) {
+        rows[line] |= VALUE_BIT(s->grid[GRID_IDX(3 + k, 3 + line)]);
+        cols[line] |= VALUE_BIT(s->grid[GRID_IDX(3 + line, 3 + k)]);
+      }
+    }
+    target_row = find_split(c.rows, rows);
+    target_col = find_split(c.cols, cols);
+    target_right = find_way(&c.right[target_row], s, false);
+    target_below = find_way(&c.below[target_col], s, true);
+  }
+
+  uint32_t n = 0;
+  for (int row = 0; row < SPLITS; row++) {
+    const split_ways *right = &c.right[row];
+    for (int col = 0; col < SPLITS; col++) {
+      const split_ways *below = &c.below[col];
+      if (right->n == 0 || below->n == 0 || !center_fits(&c, row, col)) {
+        continue;
+      }
+      for (int i = 0; i < right->n; i++) {
+        for (int j = 0; j < below->n; j++) {
+          if (!corner_fits(right->lines[i], below->spread[j])) {
+            continue;
+          }
+          if (ranking && row == target_row && col == target_col && i == target_right &&
+              j == target_below) {
+            *index = n;
+            return true;
+          }
+          if (!ranking && n == *index) {
+            fill_completion(&c, row, col, i, j, s);
+            return true;
+          }
+          n++;
+        }
+      }
+    }
+  }
+  assert(!ranking);
+  return false;
+}
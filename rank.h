@@ -0,0 +1,27 @@
+#ifndef __RANK_H__
+#define __RANK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sudoku.h"
+
+// The rank of a solution grid, a number below rank_limit() that the
+// grid can be rebuilt from, see rank.c. Ranks take 76 bits, so they
+// are held in GCC's 128 bit integers.
+typedef unsigned __int128 grid_rank;
+
+// Bytes a packed rank takes
+#define RANK_BYTES 10
+// Longest rank in decimal, with the terminating null
+#define RANK_DIGITS 40
+
+grid_rank rank_limit(void);
+bool rank_grid(const sudoku *s, grid_rank *rank);
+bool rank_unrank(grid_rank rank, sudoku *s);
+void rank_sample(sudoku *s);
+void rank_pack(grid_rank rank, uint8_t *bytes);
+grid_rank rank_unpack(const uint8_t *bytes);
+void rank_format(grid_rank rank, char *buf);
+bool rank_parse(const char *str, grid_rank *rank);
+
+#endif
@@ -0,0 +1,750 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <pthread.h>
+#include "util.h"
+#include "rate.h"
+
+// A difficulty rater that solves the puzzle the way a person would,
+// applying the easiest technique that makes progress until the puzzle
+// is solved. The puzzle's difficulty is the hardest technique that had
+// to be used.
+//
+// Candidates are kept as bitmasks, with bit v set if the value v could
+// still go in the cell, so most of the techniques come down to ANDs,
+// ORs and population counts over the 27 units (rows, columns and
+// sections) of the grid.
+//
+// The same techniques give the next step for a grid being played: they
+// are run on a copy of the candidates, recording the first change
+// made, and the technique that made it.
+
+#define NUM_UNITS (3*SUDOKU_SIZE)
+#define NUM_PEERS 20
+
+// Units 0-8 are rows, 9-17 columns and 18-26 sections
+static int units[NUM_UNITS][SUDOKU_SIZE];
+static int cell_units[GRID_SIZE][3];
+static int peers[GRID_SIZE][NUM_PEERS];
+// Number of bits set in each candidate or position mask. Without a
+// hardware popcount instruction enabled a table is much faster than
+// __builtin_popcount.
+static uint8_t bit_counts[1 << (SUDOKU_SIZE+1)];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static const char *names[] = {
+  "any", "singles", "locked", "subsets", "fish", "chains", "guess",
+};
+
+static void init_tables(void);
+static inline int count_bits(int mask);
+static bool grid_init(rate_grid *g, sudoku *s);
+static void place(rate_grid *g, int idx, int v);
+static bool eliminate(rate_grid *g, int idx, cand_mask bits);
+static bool sees(int a, int b);
+static bool apply_singles(rate_grid *g);
+static bool apply_locked(rate_grid *g);
+static bool apply_subsets(rate_grid *g);
+static bool apply_fish(rate_grid *g);
+static bool apply_chains(rate_grid *g);
+static bool apply_xy_wing(rate_grid *g);
+static bool apply_coloring(rate_grid *g, int v);
+static void record_step(rate_grid *g, rate_step_kind kind, int idx, int v,
+                        cand_mask bits);
+
+// The techniques of each difficulty level, easiest first
+static bool (*const techniques[])(rate_grid *) = {
+  NULL, apply_singles, apply_locked, apply_subsets, apply_fish, apply_chains,
+};
+
+// Rate the difficulty of the puzzle. Rating stops as soon as a
+// technique harder than limit would be needed, in which case the
+// next level up is returned, so passing a low limit makes it cheap to
+// check that a puzzle is easy enough. DIFFICULTY_ANY doesn't limit
+// the rating.
+sudoku_difficulty rate_puzzle(sudoku *s, sudoku_difficulty limit)
+{
+  assert(s);
+
+  pthread_once(&tables_once, init_tables);
+  if (limit == DIFFICULTY_ANY) {
+    limit = DIFFICULTY_MAX;
+  }
+
+  rate_grid g;
+  if (!grid_init(&g, s)) {
+    return DIFFICULTY_GUESS;
+  }
+
+  sudoku_difficulty level = DIFFICULTY_SINGLES;
+  while (g.unsolved > 0 && !g.broken) {
+    // Try the techniques from easiest to hardest, starting over with
+    // the easiest after any progress
+    sudoku_difficulty used = DIFFICULTY_SINGLES;
+    while (used < DIFFICULTY_GUESS && used <= limit && !techniques[used](&g)) {
+      used++;
+    }
+    if (used > level) {
+      level = used;
+    }
+    if (level > limit || level == DIFFICULTY_GUESS) {
+      return level;
+    }
+  }
+
+  return g.broken ? DIFFICULTY_GUESS : level;
+}
+
+// Get the name of a difficulty level
+const char *rate_name(sudoku_difficulty level)
+{
+  assert(level >= DIFFICULTY_ANY && level <= DIFFICULTY_MAX);
+  return names[level];
+}
+
+// Parse a difficulty level given either by name or by number. Return
+// false if it isn't a known level.
+bool rate_parse(const char *name, sudoku_difficulty *level)
+{
+  assert(name);
+  assert(level);
+
+  for (int i = 0; i <= DIFFICULTY_MAX; i++) {
+    if (strcasecmp(name, names[i]) == 0 || (name[0] == '0' + i && name[1] == '\0')) {
+      *level = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Parse a difficulty range, either a single level or MIN..MAX, where
+// the levels are given by name or number. Return false if the range
+// is not valid.
+bool rate_parse_range(const char *arg, sudoku_difficulty *min, sudoku_difficulty *max)
+{
+  assert(arg);
+  assert(min);
+  assert(max);
+
+  char buf[32];
+  const char *dots = strstr(arg, "..");
+  if (dots == NULL) {
+    return rate_parse(arg, min) && rate_parse(arg, max);
+  }
+  size_t len = dots - arg;
+  if (len >= sizeof(buf)) {
+    return false;
+  }
+  memcpy(buf, arg, len);
+  buf[len] = '\0';
+  return rate_parse(buf, min) && rate_parse(dots+2, max) && *min <= *max;
+}
+
+// Set up the candidates of a grid to be played. Return false if its
+// values break the rules.
+bool rate_state_init(rate_state *r, sudoku *s)
+{
+  assert(r);
+  assert(s);
+
+  pthread_once(&tables_once, init_tables);
+  r->known = false;
+  return grid_init(&r->grid, s);
+}
+
+// Place the value v at the grid index idx, removing it from the
+// candidates of the cell's peers. Return false if it isn't a
+// candidate of the cell.
+bool rate_state_place(rate_state *r, int idx, sudoku_value v)
+{
+  assert(r);
+  assert(idx >= 0 && idx < GRID_SIZE);
+
+  if (r->grid.value[idx] != 0 || (r->grid.cand[idx] & (1 << v)) == 0) {
+    return false;
+  }
+  place(&r->grid, idx, v);
+  r->known = false;
+  return true;
+}
+
+// Erase the value at the grid index idx. The candidates it and the
+// applied steps removed may be possible again, so they are worked out
+// again from the values left in the grid.
+void rate_state_erase(rate_state *r, int idx)
+{
+  assert(r);
+  assert(idx >= 0 && idx < GRID_SIZE);
+
+  if (r->grid.value[idx] == 0) {
+    return;
+  }
+  sudoku s;
+  memcpy(s.grid, r->grid.value, sizeof(s.grid));
+  s.grid[idx] = 0;
+  grid_init(&r->grid, &s);
+  r->known = false;
+}
+
+// Find the next logical step for the grid, using the easiest technique
+// that makes progress. Return false if there is none, because the grid
+// is solved, broken, or needs guessing. The step is remembered until
+// the grid changes, so asking again is cheap.
+bool rate_next_step(rate_state *r, rate_step *step)
+{
+  assert(r);
+  assert(step);
+
+  if (!r->known) {
+    rate_grid g = r->grid;
+    r->next.kind = STEP_NONE;
+    g.record = &r->next;
+    for (int t = DIFFICULTY_SINGLES; t < DIFFICULTY_GUESS &&
+           g.unsolved > 0 && !g.broken; t++) {
+      r->next.technique = t;
+      if (techniques[t](&g)) {
+        break;
+      }
+    }
+    r->known = true;
+  }
+
+  *step = r->next;
+  return step->kind != STEP_NONE;
+}
+
+// Apply a step given by rate_next_step to the grid
+void rate_apply_step(rate_state *r, const rate_step *step)
+{
+  assert(r);
+  assert(step);
+
+  if (step->kind == STEP_PLACE) {
+    rate_state_place(r, step->idx, step->value);
+  } else if (step->kind == STEP_ELIMINATE) {
+    eliminate(&r->grid, step->idx, step->eliminated);
+    r->known = false;
+  }
+}
+
+// Describe a step as rRcC=V for a placement or rRcC-VVV for an
+// elimination, followed by the technique. text should hold at least
+// RATE_STEP_TEXT characters.
+void rate_format_step(const rate_step *step, char *text)
+{
+  assert(step);
+  assert(text);
+
+  int n = sprintf(text, "r%dc%d", step->idx / SUDOKU_SIZE + 1,
+                  step->idx % SUDOKU_SIZE + 1);
+  if (step->kind == STEP_PLACE) {
+    n += sprintf(text + n, "=%d", step->value);
+  } else {
+    text[n++] = '-';
+    for (int v = 1; v <= SUDOKU_SIZE; v++) {
+      if (step->eliminated & (1 << v)) {
+        text[n++] = '0' + v;
+      }
+    }
+  }
+  sprintf(text + n, " %s", rate_name(step->technique));
+}
+
+static void init_tables(void)
+{
+  for (int i = 0; i < SUDOKU_SIZE; i++) {
+    for (int j = 0; j < SUDOKU_SIZE; j++) {
+      units[i][j] = i*SUDOKU_SIZE + j;
+      units[SUDOKU_SIZE+i][j] = j*SUDOKU_SIZE + i;
+      units[2*SUDOKU_SIZE+i][j] = ((i/3)*3 + j/3)*SUDOKU_SIZE + (i%3)*3 + j%3;
+    }
+  }
+  for (int u = 0; u < NUM_UNITS; u++) {
+    for (int j = 0; j < SUDOKU_SIZE; j++) {
+      cell_units[units[u][j]][u/SUDOKU_SIZE] = u;
+    }
+  }
+  for (int idx = 0; idx < GRID_SIZE; idx++) {
+    int n = 0;
+    for (int other = 0; other < GRID_SIZE; other++) {
+      if (other != idx && sees(idx, other)) {
+        peers[idx][n++] = other;
+      }
+    }
+    assert(n == NUM_PEERS);
+  }
+  for (int i = 1; i < sizeof(bit_counts); i++) {
+    bit_counts[i] = bit_counts[i >> 1] + (i & 1);
+  }
+}
+
+static inline int count_bits(int mask)
+{
+  return bit_counts[mask];
+}
+
+// Set up the candidates for the puzzle's hints. Return false if the
+// hints break the rules.
+static bool grid_init(rate_grid *g, sudoku *s)
+{
+  sudoku_state st;
+  if (!sudoku_state_init(&st, s)) {
+    return false;
+  }
+
+  // The candidates of the empty cells come straight from the masks
+  g->unsolved = st.empty;
+  g->broken = false;
+  g->record = NULL;
+  memcpy(g->value, s->grid, sizeof(g->value));
+  for (int i = 0; i < GRID_SIZE; i++) {
+    g->cand[i] = s->grid[i] != 0 ? 0 : sudoku_state_candidates(&st, i);
+    g->broken = g->broken || (s->grid[i] == 0 && g->cand[i] == 0);
+  }
+  return !g->broken;
+}
+
+// Fill in a cell and remove the value from the candidates of its peers
+static void place(rate_grid *g, int idx, int v)
+{
+  record_step(g, STEP_PLACE, idx, v, 0);
+  cand_mask bit = 1 << v;
+  g->value[idx] = v;
+  g->cand[idx] = 0;
+  g->unsolved--;
+  for (int i = 0; i < NUM_PEERS; i++) {
+    int p = peers[idx][i];
+    if (g->cand[p] & bit) {
+      g->cand[p] &= ~bit;
+      if (g->cand[p] == 0) {
+        g->broken = true;
+      }
+    }
+  }
+}
+
+// Remove candidates from a cell. Return true if any were removed.
+static bool eliminate(rate_grid *g, int idx, cand_mask bits)
+{
+  if ((g->cand[idx] & bits) == 0) {
+    return false;
+  }
+  record_step(g, STEP_ELIMINATE, idx, 0, g->cand[idx] & bits);
+  g->cand[idx] &= ~bits;
+  if (g->cand[idx] == 0) {
+    g->broken = true;
+  }
+  return true;
+}
+
+// Check whether two different cells share a row, column or section
+static bool sees(int a, int b)
+{
+  return a != b && (cell_units[a][0] == cell_units[b][0] ||
+                    cell_units[a][1] == cell_units[b][1] ||
+                    cell_units[a][2] == cell_units[b][2]);
+}
+
+// Place naked singles (cells with one candidate) and hidden singles
+// (values with one possible cell in a unit) until there are none left
+static bool apply_singles(rate_grid *g)
+{
+  bool progress = false, changed = true;
+  // When looking for a single step, one pass is enough
+  while (changed && !g->broken && (!progress || g->record == NULL)) {
+    changed = false;
+    for (int i = 0; i < GRID_SIZE; i++) {
+      cand_mask c = g->cand[i];
+      if (c != 0 && (c & (c-1)) == 0) {
+        place(g, i, __builtin_ctz(c));
+        changed = true;
+      }
+    }
+
+    for (int u = 0; u < NUM_UNITS && !g->broken; u++) {
+      // Values seen in exactly one cell of the unit are hidden singles
+      cand_mask once = 0, twice = 0, placed = 0;
+      for (int j = 0; j < SUDOKU_SIZE; j++) {
+        int idx = units[u][j];
+        placed |= 1 << g->value[idx];
+        twice |= once & g->cand[idx];
+        once |= g->cand[idx];
+      }
+      if ((once | placed) != (placed | SUDOKU_ALL_VALUES)) {
+        // A value can't go anywhere in the unit
+        g->broken = true;
+        break;
+      }
+      cand_mask hidden = once & ~twice;
+      while (hidden != 0) {
+        int v = __builtin_ctz(hidden);
+        hidden &= hidden - 1;
+        for (int j = 0; j < SUDOKU_SIZE; j++) {
+          int idx = units[u][j];
+          if (g->cand[idx] & (1 << v)) {
+            place(g, idx, v);
+            changed = true;
+            break;
+          }
+        }
+      }
+    }
+    progress = progress || changed;
+  }
+  return progress;
+}
+
+// Compute the positions of each value within a unit: bit j of
+// positions[v] is set if the value v is a candidate of the unit's jth
+// cell
+static void unit_positions(rate_grid *g, int u, int *positions)
+{
+  memset(positions, 0, (SUDOKU_SIZE+1)*sizeof(int));
+  for (int j = 0; j < SUDOKU_SIZE; j++) {
+    cand_mask c = g->cand[units[u][j]];
+    while (c != 0) {
+      positions[__builtin_ctz(c)] |= 1 << j;
+      c &= c - 1;
+    }
+  }
+}
+
+// If a value's candidates in a section all lie in one row or column,
+// the value can't go anywhere else in that row or column (pointing),
+// and if a value's candidates in a row or column all lie in one
+// section, it can't go anywhere else in the section (claiming)
+static bool apply_locked(rate_grid *g)
+{
+  // Masks of the positions in a unit that share another unit: for
+  // rows and columns, the three sections they cross, and for sections,
+  // their three rows and then their three columns
+  static const int line_groups[3] = { 0x007, 0x038, 0x1c0 };
+  static const int col_groups[3] = { 0x049, 0x092, 0x124 };
+
+  bool progress = false;
+  for (int u = 0; u < NUM_UNITS; u++) {
+    int type = u / SUDOKU_SIZE, positions[SUDOKU_SIZE+1];
+    unit_positions(g, u, positions);
+    for (int v = 1; v <= SUDOKU_SIZE; v++) {
+      int p = positions[v];
+      if ((p & (p-1)) == 0) {
+        continue;
+      }
+      for (int k = 0; k < 6; k++) {
+        int group, other_type;
+        if (k < 3) {
+          group = line_groups[k];
+          other_type = type == 2 ? 0 : 2;
+        } else if (type == 2) {
+          group = col_groups[k-3];
+          other_type = 1;
+        } else {
+          break;
+        }
+        if ((p & ~group) != 0) {
+          continue;
+        }
+        int other = cell_units[units[u][__builtin_ctz(p)]][other_type];
+        for (int j = 0; j < SUDOKU_SIZE; j++) {
+          int idx = units[other][j];
+          if (cell_units[idx][type] != u) {
+            progress |= eliminate(g, idx, 1 << v);
+          }
+        }
+      }
+    }
+  }
+  return progress;
+}
+
+// Call fn for each subset of 2 to 4 of the n masks where the union of
+// the masks has as many bits set as the subset has members, until fn
+// makes progress. members has bit i set for each mask i in the subset.
+typedef bool (*subset_fn)(rate_grid *g, const void *ctx, int members, int all);
+
+static bool find_subsets(rate_grid *g, const int *masks, int n, subset_fn fn,
+                         const void *ctx, int start, int members, int all, int size)
+{
+  for (int i = start; i < n; i++) {
+    if (masks[i] == 0) {
+      continue;
+    }
+    int next = all | masks[i];
+    int count = count_bits(next);
+    if (count > 4) {
+      continue;
+    }
+    if (size >= 1 && count == size+1 && fn(g, ctx, members | (1 << i), next)) {
+      return true;
+    }
+    if (size+1 < 4 &&
+        find_subsets(g, masks, n, fn, ctx, i+1, members | (1 << i), next, size+1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A naked subset: remove its values from the rest of the unit
+static bool naked_subset(rate_grid *g, const void *ctx, int members, int values)
+{
+  int u = *(const int *) ctx;
+  bool progress = false;
+  for (int j = 0; j < SUDOKU_SIZE; j++) {
+    if ((members & (1 << j)) == 0) {
+      progress |= eliminate(g, units[u][j], values);
+    }
+  }
+  return progress;
+}
+
+// A hidden subset: its cells can't hold any other value. The members
+// are numbered by value-1.
+static bool hidden_subset(rate_grid *g, const void *ctx, int members, int spots)
+{
+  int u = *(const int *) ctx;
+  bool progress = false;
+  for (int j = 0; j < SUDOKU_SIZE; j++) {
+    if (spots & (1 << j)) {
+      progress |= eliminate(g, units[u][j], ~(members << 1) & SUDOKU_ALL_VALUES);
+    }
+  }
+  return progress;
+}
+
+// Find naked subsets, n cells of a unit whose candidates together are
+// only n values, which can be removed from the rest of the unit, and
+// hidden subsets, n values that together only fit in n cells of a
+// unit, whose cells can't hold any other value
+static bool apply_subsets(rate_grid *g)
+{
+  for (int u = 0; u < NUM_UNITS; u++) {
+    int cands[SUDOKU_SIZE], positions[SUDOKU_SIZE+1];
+    for (int j = 0; j < SUDOKU_SIZE; j++) {
+      cands[j] = g->cand[units[u][j]];
+    }
+    if (find_subsets(g, cands, SUDOKU_SIZE, naked_subset, &u, 0, 0, 0, 0)) {
+      return true;
+    }
+    unit_positions(g, u, positions);
+    if (find_subsets(g, positions+1, SUDOKU_SIZE, hidden_subset, &u, 0, 0, 0, 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+typedef struct {
+  int v;
+  bool by_column; // Base lines are columns rather than rows
+} fish_ctx;
+
+// A fish: remove the value from the cover lines outside the base lines
+static bool fish(rate_grid *g, const void *ctx, int base, int cover)
+{
+  const fish_ctx *f = ctx;
+  bool progress = false;
+  for (int i = 0; i < SUDOKU_SIZE; i++) {
+    if (base & (1 << i)) {
+      continue;
+    }
+    for (int j = 0; j < SUDOKU_SIZE; j++) {
+      if (cover & (1 << j)) {
+        int idx = f->by_column ? j*SUDOKU_SIZE + i : i*SUDOKU_SIZE + j;
+        progress |= eliminate(g, idx, 1 << f->v);
+      }
+    }
+  }
+  return progress;
+}
+
+// Find fish: for one value, if its candidates in n rows all lie in the
+// same n columns, the value must go in those columns in those rows and
+// can be removed from the rest of the columns (or the same with rows
+// and columns switched). n is 2 for an X-wing, 3 for a swordfish and
+// 4 for a jellyfish.
+static bool apply_fish(rate_grid *g)
+{
+  for (int v = 1; v <= SUDOKU_SIZE; v++) {
+    for (int by_column = 0; by_column < 2; by_column++) {
+      // The positions of the value in each base line are the same as
+      // the value's positions in the unit for that line
+      fish_ctx f = { v, by_column };
+      int lines[SUDOKU_SIZE];
+      for (int i = 0; i < SUDOKU_SIZE; i++) {
+        int u = by_column ? SUDOKU_SIZE + i : i;
+        lines[i] = 0;
+        for (int j = 0; j < SUDOKU_SIZE; j++) {
+          if (g->cand[units[u][j]] & (1 << v)) {
+            lines[i] |= 1 << j;
+          }
+        }
+      }
+      if (find_subsets(g, lines, SUDOKU_SIZE, fish, &f, 0, 0, 0, 0)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Apply the chaining techniques
+static bool apply_chains(rate_grid *g)
+{
+  if (apply_xy_wing(g)) {
+    return true;
+  }
+  for (int v = 1; v <= SUDOKU_SIZE; v++) {
+    if (apply_coloring(g, v)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Find an XY-wing: a pivot cell with candidates xy that sees two
+// pincer cells with candidates xz and yz. Whichever value the pivot
+// takes, one of the pincers is z, so z can be removed from every cell
+// that sees both pincers.
+static bool apply_xy_wing(rate_grid *g)
+{
+  for (int pivot = 0; pivot < GRID_SIZE; pivot++) {
+    cand_mask pc = g->cand[pivot];
+    if (count_bits(pc) != 2) {
+      continue;
+    }
+    for (int i = 0; i < NUM_PEERS; i++) {
+      int a = peers[pivot][i];
+      cand_mask ac = g->cand[a];
+      if (count_bits(ac) != 2 || count_bits(ac & pc) != 1) {
+        continue;
+      }
+      cand_mask z = ac & ~pc;
+      for (int j = i+1; j < NUM_PEERS; j++) {
+        int b = peers[pivot][j];
+        cand_mask bc = g->cand[b];
+        // b has the pivot value a doesn't share, and z
+        if (bc != ((pc & ~ac) | z)) {
+          continue;
+        }
+        bool progress = false;
+        for (int k = 0; k < NUM_PEERS; k++) {
+          int c = peers[a][k];
+          if (c != b && sees(c, b)) {
+            progress |= eliminate(g, c, z);
+          }
+        }
+        if (progress) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// Simple coloring for one value. Units where the value has exactly two
+// candidates link those cells in a chain where exactly one of each
+// linked pair is the value. Color the chain in alternating colors: one
+// color is all true and the other all false. If two cells of the same
+// color see each other, that color is false. A cell outside the chain
+// that sees both colors can't hold the value.
+static bool apply_coloring(rate_grid *g, int v)
+{
+  cand_mask bit = 1 << v;
+  int links[GRID_SIZE][3], nlinks[GRID_SIZE] = { 0 };
+  for (int u = 0; u < NUM_UNITS; u++) {
+    int pair[2], n = 0;
+    for (int j = 0; j < SUDOKU_SIZE && n <= 2; j++) {
+      if (g->cand[units[u][j]] & bit) {
+        if (n < 2) {
+          pair[n] = units[u][j];
+        }
+        n++;
+      }
+    }
+    if (n == 2) {
+      links[pair[0]][nlinks[pair[0]]++] = pair[1];
+      links[pair[1]][nlinks[pair[1]]++] = pair[0];
+    }
+  }
+
+  // Color each chain of two or more linked cells with a breadth first
+  // search. color is 0 for uncolored cells, or 2*chain + 1 or 2.
+  int color[GRID_SIZE] = { 0 };
+  int queue[GRID_SIZE];
+  int chain = 0;
+  for (int start = 0; start < GRID_SIZE; start++) {
+    if (nlinks[start] == 0 || color[start] != 0) {
+      continue;
+    }
+    int head = 0, tail = 0, base = 2*chain++;
+    int members[GRID_SIZE], nmembers = 0;
+    color[start] = base + 1;
+    queue[tail++] = start;
+    while (head < tail) {
+      int idx = queue[head++];
+      members[nmembers++] = idx;
+      for (int i = 0; i < nlinks[idx]; i++) {
+        int next = links[idx][i];
+        if (color[next] == 0) {
+          color[next] = color[idx] == base + 1 ? base + 2 : base + 1;
+          queue[tail++] = next;
+        }
+      }
+    }
+
+    // Color wrap: two cells of the same color see each other
+    for (int i = 0; i < nmembers; i++) {
+      for (int j = i+1; j < nmembers; j++) {
+        if (color[members[i]] == color[members[j]] && sees(members[i], members[j])) {
+          int wrong = color[members[i]];
+          bool progress = false;
+          for (int k = 0; k < nmembers; k++) {
+            if (color[members[k]] == wrong) {
+              progress |= eliminate(g, members[k], bit);
+            }
+          }
+          return progress;
+        }
+      }
+    }
+
+    // Color trap: an outside cell sees both colors
+    bool progress = false;
+    for (int idx = 0; idx < GRID_SIZE; idx++) {
+      if ((g->cand[idx] & bit) == 0 || color[idx] != 0) {
+        continue;
+      }
+      bool seen[2] = { false, false };
+      for (int i = 0; i < nmembers; i++) {
+        if (sees(idx, members[i])) {
+          seen[color[members[i]] - base - 1] = true;
+        }
+      }
+      if (seen[0] && seen[1]) {
+        progress |= eliminate(g, idx, bit);
+      }
+    }
+    if (progress) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Record a change to the grid in g->record if this is the first one
+static void record_step(rate_grid *g, rate_step_kind kind, int idx, int v,
+                        cand_mask bits)
+{
+  if (g->record != NULL && g->record->kind == STEP_NONE) {
+    g->record->kind = kind;
+    g->record->idx = idx;
+    g->record->value = v;
+    g->record->eliminated = bits;
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef __RATE_H__
+#define __RATE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sudoku.h"
+
+// Difficulty levels, named after the hardest technique a human solver
+// needs. Each level includes the techniques of the levels below it.
+typedef enum {
+  DIFFICULTY_ANY = 0,
+  DIFFICULTY_SINGLES,  // Naked and hidden singles
+  DIFFICULTY_LOCKED,   // Locked candidates (pointing and claiming)
+  DIFFICULTY_SUBSETS,  // Naked and hidden pairs, triples and quads
+  DIFFICULTY_FISH,     // X-wing, swordfish and jellyfish
+  DIFFICULTY_CHAINS,   // Simple coloring and XY-wings
+  DIFFICULTY_GUESS,    // Needs guessing, or has no unique solution
+} sudoku_difficulty;
+
+#define DIFFICULTY_MAX DIFFICULTY_GUESS
+
+// Candidates of a cell, with bit v set if the value v could still go
+// in it
+typedef uint16_t cand_mask;
+
+typedef struct rate_step rate_step;
+
+// The candidates of a grid as a person solving it would see them
+typedef struct {
+  cand_mask cand[GRID_SIZE];     // Candidates of unsolved cells, 0 if solved
+  sudoku_value value[GRID_SIZE]; // Solved values, 0 if unsolved
+  int unsolved;
+  bool broken;                   // A contradiction was found
+  rate_step *record;             // Where to record the first change, if set
+} rate_grid;
+
+// A single logical step: either a value placed in a cell, or
+// candidates eliminated from a cell
+typedef enum {
+  STEP_NONE,
+  STEP_PLACE,
+  STEP_ELIMINATE,
+} rate_step_kind;
+
+struct rate_step {
+  rate_step_kind kind;
+  sudoku_difficulty technique; // The technique that justifies the step
+  int idx;                     // Grid index of the cell
+  sudoku_value value;          // The value placed
+  cand_mask eliminated;        // The candidates eliminated
+};
+
+// Space needed by rate_format_step
+#define RATE_STEP_TEXT 32
+
+// The candidates of a grid being played, kept between requests for the
+// next step. Placing a value updates the candidates of its peers, and
+// steps that are applied are kept, so later requests don't repeat the
+// work.
+typedef struct {
+  rate_grid grid;
+  rate_step next; // The next step, if already found
+  bool known;     // Whether next is up to date
+} rate_state;
+
+sudoku_difficulty rate_puzzle(sudoku *s, sudoku_difficulty limit);
+const char *rate_name(sudoku_difficulty level);
+bool rate_parse(const char *name, sudoku_difficulty *level);
+bool rate_parse_range(const char *arg, sudoku_difficulty *min, sudoku_difficulty *max);
+
+bool rate_state_init(rate_state *r, sudoku *s);
+bool rate_state_place(rate_state *r, int idx, sudoku_value v);
+void rate_state_erase(rate_state *r, int idx);
+bool rate_next_step(rate_state *r, rate_step *step);
+void rate_apply_step(rate_state *r, const rate_step *step);
+void rate_format_step(const rate_step *step, char *text);
+
+#endif
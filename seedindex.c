@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include "util.h"
+#include "parallel.h"
+#include "rate.h"
+#include "seedindex.h"
+
+// An index of what each seed of a range generates, so puzzles can be
+// kept as their seeds and found by their properties without
+// generating them again.
+//
+// The sweep hands out blocks of seeds to the threads, each of which
+// writes the entries of its block in place, so the threads share
+// nothing but the counter of the next block. The entries are then
+// sorted by clues, difficulty and seed, so a lookup by clues is a
+// binary search of the file.
+//
+// A seed's puzzle has to be the same whenever it is generated, so the
+// grids tried for a difficulty range are bounded by a count of
+// attempts, kept in the file, rather than by the time limit, which
+// would depend on the speed of the machine.
+//
+// The file is a 20 byte header: "SDKI", a version byte (2), the grid
+// size (9), the options the seeds were generated with (extra hints,
+// symmetry, minimum and maximum difficulty and whether only singles
+// are needed, a byte each), a zero byte, the number of entries, and
+// the most grids tried for a seed, each as a 32 bit little endian
+// integer. Each entry follows in 8 bytes: the seed as a 32 bit little
+// endian integer, the clues, the difficulty, and the time as a 16 bit
+// little endian integer.
+
+// Seeds a thread takes at a time
+#define SWEEP_BLOCK 64
+// Grids tried for a seed with a difficulty range, unless the options
+// give a number
+#define SWEEP_ATTEMPTS 1000
+
+#define HEADER_SIZE 20
+#define ENTRY_SIZE 8
+#define VERSION 2
+
+typedef struct {
+  sudoku_options opts;
+  unsigned int seed;
+  size_t count;
+  size_t next;     // The first seed of the next block, from seed
+  seedindex_entry *entries;
+} sweep_ctx;
+
+static void sweep_options(const sudoku_options *opts, sudoku_options *sweep);
+static void sweep_worker(int id, void *arg);
+static int compare_entries(const void *a, const void *b);
+
+// Generate the puzzles of the count seeds from seed on, with the given
+// number of threads, and record what each gives in entries, in seed
+// order
+void seedindex_sweep(const sudoku_options *opts, unsigned int seed, size_t count,
+                     int threads, seedindex_entry *entries)
+{
+  assert(opts);
+  assert(entries || count == 0);
+  assert(threads > 0);
+
+  sweep_ctx ctx = { *opts, seed, count, 0, entries };
+  sweep_options(opts, &ctx.opts);
+  parallel_run(threads, sweep_worker, &ctx);
+}
+
+// Sort the entries and write them to the file at path. Return false
+// if it can't be written.
+bool seedindex_write(const char *path, const sudoku_options *opts,
+                     seedindex_entry *entries, size_t count)
+{
+  assert(path);
+  assert(opts);
+  assert(entries || count == 0);
+
+  if (count > UINT32_MAX) {
+    warn("too many seeds for an index: %zu", count);
+    return false;
+  }
+  qsort(entries, count, sizeof(seedindex_entry), compare_entries);
+  sudoku_options sweep;
+  sweep_options(opts, &sweep);
+
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) {
+    warn("unable to write %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  uint8_t header[HEADER_SIZE] = {
+    'S', 'D', 'K', 'I', VERSION, SUDOKU_SIZE, opts->extra_hints, opts->symmetry,
+    opts->min_difficulty, opts->max_difficulty, opts->singles_only,
+  };
+  for (int i = 0; i < 4; i++) {
+    header[12+i] = count >> 8*i;
+    header[16+i] = sweep.max_attempts >> 8*i;
+  }
+  fwrite(header, 1, HEADER_SIZE, fp);
+  for (size_t i = 0; i < count; i++) {
+    const seedindex_entry *e = &entries[i];
+    uint8_t packed[ENTRY_SIZE] = {
+      e->seed, e->seed >> 8, e->seed >> 16, e->seed >> 24, e->clues, e->difficulty,
+      e->time, e->time >> 8,
+    };
+    fwrite(packed, 1, ENTRY_SIZE, fp);
+  }
+
+  bool failed = ferror(fp);
+  if (fclose(fp) != 0 || failed) {
+    warn("unable to write %s", path);
+    return false;
+  }
+  return true;
+}
+
+// Open the index file at path and read its header. Return false if it
+// can't be read or isn't an index.
+bool seedindex_open(seedindex *idx, const char *path)
+{
+  assert(idx);
+  assert(path);
+
+  idx->fp = fopen(path, "rb");
+  if (idx->fp == NULL) {
+    warn("unable to read %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  uint8_t header[HEADER_SIZE];
+  if (fread(header, 1, HEADER_SIZE, idx->fp) != HEADER_SIZE ||
+      memcmp(header, "SDKI", 4) != 0) {
+    warn("%s is not a seed index", path);
+    seedindex_close(idx);
+    return false;
+  }
+  if (header[4] != VERSION || header[5] != SUDOKU_SIZE) {
+    warn("unsupported seed index version %d or grid size %d", header[4], header[5]);
+    seedindex_close(idx);
+    return false;
+  }
+  memset(&idx->opts, 0, sizeof(idx->opts));
+  idx->opts.extra_hints = header[6];
+  idx->opts.symmetry = header[7];
+  idx->opts.min_difficulty = header[8];
+  idx->opts.max_difficulty = header[9];
+  idx->opts.singles_only = header[10];
+  idx->count = 0;
+  for (int i = 0; i < 4; i++) {
+    idx->count |= (size_t) header[12+i] << 8*i;
+    idx->opts.max_attempts |= (size_t) header[16+i] << 8*i;
+  }
+  if (idx->opts.max_attempts == 0) {
+    warn("%s has no limit on the grids tried for a seed", path);
+    seedindex_close(idx);
+    return false;
+  }
+  return true;
+}
+
+// Find the position of the first entry with at least the given number
+// of clues, or the number of entries if there is none
+size_t seedindex_find(seedindex *idx, int clues)
+{
+  assert(idx);
+
+  size_t lo = 0, hi = idx->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    seedindex_entry e;
+    if (!seedindex_read(idx, mid, &e)) {
+      return idx->count;
+    }
+    if (e.clues < clues) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Read the entry at a position of the index. Return false if it is
+// past the end or can't be read.
+bool seedindex_read(seedindex *idx, size_t pos, seedindex_entry *entry)
+{
+  assert(idx);
+  assert(entry);
+
+  uint8_t packed[ENTRY_SIZE];
+  if (pos >= idx->count) {
+    return false;
+  }
+  if (fseek(idx->fp, HEADER_SIZE + (long) pos*ENTRY_SIZE, SEEK_SET) != 0 ||
+      fread(packed, 1, ENTRY_SIZE, idx->fp) != ENTRY_SIZE) {
+    warn("seed index ends before entry %zu", pos);
+    return false;
+  }
+  entry->seed = packed[0] | packed[1] << 8 | packed[2] << 16 | (uint32_t) packed[3] << 24;
+  entry->clues = packed[4];
+  entry->difficulty = packed[5];
+  entry->time = packed[6] | packed[7] << 8;
+  return true;
+}
+
+void seedindex_close(seedindex *idx)
+{
+  assert(idx);
+  fclose(idx->fp);
+  idx->fp = NULL;
+}
+
+// Get the options seeds are generated with for an index: those given,
+// with the grids tried bounded by a count instead of the time limit
+static void sweep_options(const sudoku_options *opts, sudoku_options *sweep)
+{
+  *sweep = *opts;
+  sweep->time_limit = 0;
+  if (sweep->max_attempts == 0) {
+    sweep->max_attempts = SWEEP_ATTEMPTS;
+  }
+}
+
+static void sweep_worker(int id, void *arg)
+{
+  sweep_ctx *ctx = arg;
+
+  for (;;) {
+    size_t start = __atomic_fetch_add(&ctx->next, SWEEP_BLOCK, __ATOMIC_RELAXED);
+    if (start >= ctx->count) {
+      break;
+    }
+    size_t end = start + SWEEP_BLOCK < ctx->count ? start + SWEEP_BLOCK : ctx->count;
+    for (size_t i = start; i < end; i++) {
+      sudoku puzzle, solution;
+      unsigned int seed = ctx->seed + i;
+      rng_seed(seed);
+      uint64_t begin = get_time_ns();
+      sudoku_generate(&puzzle, &solution, &ctx->opts, NULL);
+      uint64_t units = (get_time_ns() - begin) / SEEDINDEX_TIME_NS;
+
+      seedindex_entry *e = &ctx->entries[i];
+      e->seed = seed;
+      e->clues = sudoku_count_hints(&puzzle);
+      e->difficulty = rate_puzzle(&puzzle, DIFFICULTY_ANY);
+      e->time = units < UINT16_MAX ? units : UINT16_MAX;
+    }
+  }
+}
+
+// Order entries by clues, then difficulty, then seed
+static int compare_entries(const void *a, const void *b)
+{
+  const seedindex_entry *x = a, *y = b;
+  if (x->clues != y->clues) {
+    return x->clues - y->clues;
+  }
+  if (x->difficulty != y->difficulty) {
+    return x->difficulty - y->difficulty;
+  }
+  return (x->seed > y->seed) - (x->seed < y->seed);
+}
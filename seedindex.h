@@ -0,0 +1,37 @@
+#ifndef __SEEDINDEX_H__
+#define __SEEDINDEX_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sudoku.h"
+
+// Nanoseconds in a unit of seedindex_entry's time
+#define SEEDINDEX_TIME_NS 10000
+
+// What a seed generates, as kept in an index
+typedef struct {
+  uint32_t seed;
+  uint8_t clues;
+  uint8_t difficulty; // See rate.h
+  uint16_t time;      // Generation time in SEEDINDEX_TIME_NS units, saturating
+} seedindex_entry;
+
+// An index file open for lookups, which read the entries they need
+// from the file rather than loading it
+typedef struct {
+  FILE *fp;
+  size_t count;
+  sudoku_options opts; // The options the seeds were generated with
+} seedindex;
+
+void seedindex_sweep(const sudoku_options *opts, unsigned int seed, size_t count,
+                     int threads, seedindex_entry *entries);
+bool seedindex_write(const char *path, const sudoku_options *opts,
+                     seedindex_entry *entries, size_t count);
+bool seedindex_open(seedindex *idx, const char *path);
+size_t seedindex_find(seedindex *idx, int clues);
+bool seedindex_read(seedindex *idx, size_t pos, seedindex_entry *entry);
+void seedindex_close(seedindex *idx);
+
+#endif
@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <assert.h>
+#include <pthread.h>
+#include "util.h"
+#include "rate.h"
+#include "slowlog.h"
+
+// A log of the generations and solves that took longer than a
+// threshold, one record per line, so the rare outliers of a long run
+// can be looked at after it.
+//
+// A record holds what is needed to redo the work: a generation is
+// fully determined by its seed and options, and a solve by its puzzle
+// and the backend that answered it. A generation for a difficulty
+// range may have stopped at the time limit, so it is redone with the
+// grids it tried as the limit instead, and no time limit. The rest of the record, the phase
+// times and search counts and the grids, is there to read, and to
+// check a replay against:
+//
+//   generate seed=5 add-hints=0 symmetry=none difficulty=any..any
+//     singles-only=0 ms=41.2 slowest=unique solve-ms=1.3 deduce-ms=0.0
+//     unique-ms=39.8 extra-ms=0.0 attempts=1 probes=44 nodes=3115
+//     grid=... puzzle=...
+//   solve backend=bitset ms=12.5 puzzle=...
+//
+// Records are written whole and flushed under a lock, so the log can
+// be shared by the workers of a batch and read while it runs.
+
+// Longest record written: the fields, and two grids
+#define RECORD_SIZE (512 + 2*GRID_SIZE)
+
+static FILE *log_fp = NULL;
+static uint64_t threshold;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void write_record(const char *record);
+static void format_grid(const sudoku *s, char *line);
+
+// Start logging the work that takes at least threshold_ns to the file
+// at path, appending to it. Return false if it can't be opened.
+bool slowlog_open(const char *path, uint64_t threshold_ns)
+{
+  assert(path);
+  assert(log_fp == NULL);
+
+  if ((log_fp = fopen(path, "a")) == NULL) {
+    warn("unable to open slow log %s: %s", path, strerror(errno));
+    return false;
+  }
+  threshold = threshold_ns;
+  return true;
+}
+
+void slowlog_close(void)
+{
+  if (log_fp != NULL) {
+    fclose(log_fp);
+    log_fp = NULL;
+  }
+}
+
+// Whether work that took ns should be logged
+bool slowlog_is_slow(uint64_t ns)
+{
+  return log_fp != NULL && ns >= threshold;
+}
+
+// Log a generation if it was slow. grid is the solved grid the hints
+// were removed from.
+void slowlog_generate(const sudoku_options *opts, unsigned int seed, const sudoku *grid,
+                      const sudoku *puzzle, const sudoku_stats *stats, uint64_t ns)
+{
+  assert(opts);
+  assert(grid);
+  assert(puzzle);
+  assert(stats);
+
+  if (!slowlog_is_slow(ns)) {
+    return;
+  }
+
+  int slowest = 0;
+  for (int i = 1; i < SUDOKU_PHASES; i++) {
+    if (stats->phase_ns[i] > stats->phase_ns[slowest]) {
+      slowest = i;
+    }
+  }
+
+  char record[RECORD_SIZE], grid_line[GRID_SIZE+2], puzzle_line[GRID_SIZE+2];
+  format_grid(grid, grid_line);
+  format_grid(puzzle, puzzle_line);
+  int len = snprintf(record, sizeof(record),
+                     "generate seed=%u add-hints=%d symmetry=%s difficulty=%s..%s "
+                     "singles-only=%d ms=%.3f slowest=%s",
+                     seed, opts->extra_hints, sudoku_symmetry_name(opts->symmetry),
+                     rate_name(opts->min_difficulty), rate_name(opts->max_difficulty),
+                     opts->singles_only, ns / 1e6, sudoku_phase_name(slowest));
+  for (int i = 0; i < SUDOKU_PHASES; i++) {
+    len += snprintf(record + len, sizeof(record) - len, " %s-ms=%.3f",
+                    sudoku_phase_name(i), stats->phase_ns[i] / 1e6);
+  }
+  snprintf(record + len, sizeof(record) - len,
+           " attempts=%zu probes=%zu nodes=%zu grid=%s puzzle=%s\n", stats->attempts,
+           stats->probes, stats->fill.nodes + stats->probe.nodes, grid_line, puzzle_line);
+  write_record(record);
+}
+
+// Log a solve if it was slow. puzzle is the puzzle before it was solved.
+void slowlog_solve(portfolio_backend backend, const sudoku *puzzle, uint64_t ns)
+{
+  assert(puzzle);
+
+  if (!slowlog_is_slow(ns)) {
+    return;
+  }
+
+  char record[RECORD_SIZE], puzzle_line[GRID_SIZE+2];
+  format_grid(puzzle, puzzle_line);
+  snprintf(record, sizeof(record), "solve backend=%s ms=%.3f puzzle=%s\n",
+           portfolio_backend_name(backend), ns / 1e6, puzzle_line);
+  write_record(record);
+}
+
+// Parse a record of the slow log. Fields that aren't needed to redo the
+// work may be left out. The attempts of a generation are kept as its
+// limit, and are needed if it has a difficulty range. Return false if
+// the record is malformed.
+bool slowlog_parse(const char *line, slowlog_record *rec)
+{
+  assert(line);
+  assert(rec);
+
+  char *buf = strdup(line), *save, *token;
+  if (buf == NULL) {
+    fatal("failed to allocate memory for slow log record");
+  }
+  memset(rec, 0, sizeof(*rec));
+
+  bool ok = true, have_seed = false, have_backend = false, have_puzzle = false;
+  bool have_attempts = false;
+  token = strtok_r(buf, " \t\r\n", &save);
+  if (token != NULL && strcmp(token, "generate") == 0) {
+    rec->kind = SLOW_GENERATE;
+  } else if (token != NULL && strcmp(token, "solve") == 0) {
+    rec->kind = SLOW_SOLVE;
+  } else {
+    ok = false;
+  }
+
+  while (ok && (token = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+    char *value = strchr(token, '=');
+    if (value == NULL) {
+      ok = false;
+      break;
+    }
+    *value++ = '\0';
+
+    char *end;
+    if (strcmp(token, "seed") == 0) {
+      errno = 0;
+      unsigned long seed = strtoul(value, &end, 10);
+      ok = *end == '\0' && errno == 0 && seed <= UINT_MAX;
+      rec->seed = seed;
+      have_seed = true;
+    } else if (strcmp(token, "add-hints") == 0) {
+      rec->opts.extra_hints = strtol(value, &end, 10);
+      ok = *end == '\0' && rec->opts.extra_hints >= 0;
+    } else if (strcmp(token, "symmetry") == 0) {
+      ok = sudoku_parse_symmetry(value, &rec->opts.symmetry);
+    } else if (strcmp(token, "difficulty") == 0) {
+      sudoku_difficulty min = DIFFICULTY_ANY, max = DIFFICULTY_ANY;
+      ok = rate_parse_range(value, &min, &max);
+      rec->opts.min_difficulty = min;
+      rec->opts.max_difficulty = max;
+    } else if (strcmp(token, "singles-only") == 0) {
+      ok = (value[0] == '0' || value[0] == '1') && value[1] == '\0';
+      rec->opts.singles_only = value[0] == '1';
+    } else if (strcmp(token, "attempts") == 0) {
+      errno = 0;
+      unsigned long long attempts = strtoull(value, &end, 10);
+      ok = *end == '\0' && errno == 0 && attempts > 0 && attempts <= SIZE_MAX &&
+        value[0] != '-';
+      rec->opts.max_attempts = attempts;
+      have_attempts = true;
+    } else if (strcmp(token, "backend") == 0) {
+      portfolio_strategy strategy;
+      ok = portfolio_parse_strategy(value, &strategy) && strategy <= STRATEGY_SINGLES;
+      rec->backend = (portfolio_backend) strategy;
+      have_backend = true;
+    } else if (strcmp(token, "ms") == 0) {
+      rec->ms = strtod(value, &end);
+      ok = *end == '\0';
+    } else if (strcmp(token, "grid") == 0) {
+      ok = strlen(value) == GRID_SIZE && sudoku_parse(value, &rec->grid);
+    } else if (strcmp(token, "puzzle") == 0) {
+      ok = strlen(value) == GRID_SIZE && sudoku_parse(value, &rec->puzzle);
+      have_puzzle = true;
+    }
+  }
+  free(buf);
+
+  if (rec->kind == SLOW_GENERATE) {
+    bool ranged = rec->opts.min_difficulty != DIFFICULTY_ANY ||
+      rec->opts.max_difficulty != DIFFICULTY_ANY;
+    return ok && have_seed && have_puzzle && (have_attempts || !ranged);
+  }
+  return ok && have_backend && have_puzzle;
+}
+
+static void write_record(const char *record)
+{
+  pthread_mutex_lock(&log_lock);
+  fputs(record, log_fp);
+  fflush(log_fp);
+  pthread_mutex_unlock(&log_lock);
+}
+
+// Format a grid as one line, without the newline
+static void format_grid(const sudoku *s, char *line)
+{
+  sudoku copy = *s;
+  sudoku_format_line(&copy, line);
+  line[GRID_SIZE] = '\0';
+}
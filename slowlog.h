@@ -0,0 +1,33 @@
+#ifndef __SLOWLOG_H__
+#define __SLOWLOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sudoku.h"
+#include "portfolio.h"
+
+typedef enum {
+  SLOW_GENERATE,
+  SLOW_SOLVE,
+} slowlog_kind;
+
+// A record of the slow log, with what is needed to redo the work
+typedef struct {
+  slowlog_kind kind;
+  unsigned int seed;         // The seed a puzzle was generated from
+  sudoku_options opts;       // The options to generate it again with
+  portfolio_backend backend; // The backend that solved a puzzle
+  double ms;                 // The time the work took when recorded
+  sudoku grid;               // The grid the hints were removed from
+  sudoku puzzle;             // The puzzle generated, or solved
+} slowlog_record;
+
+bool slowlog_open(const char *path, uint64_t threshold_ns);
+void slowlog_close(void);
+bool slowlog_is_slow(uint64_t ns);
+void slowlog_generate(const sudoku_options *opts, unsigned int seed, const sudoku *grid,
+                      const sudoku *puzzle, const sudoku_stats *stats, uint64_t ns);
+void slowlog_solve(portfolio_backend backend, const sudoku *puzzle, uint64_t ns);
+bool slowlog_parse(const char *line, slowlog_record *rec);
+
+#endif
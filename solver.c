@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include "util.h"
 #include "solver.h"
 
@@ -13,17 +14,33 @@ struct node {
 struct solver {
   node *root;
   node *nodes;
+  node **rows; // The first node of each row, or NULL for empty rows
   int *solution;
   size_t solution_count;
   size_t solution_size;
   dlx_mode mode;
+  size_t inuse;
   size_t nrows;
   size_t ncols;
+  size_t nprimary;  // Columns from here on are secondary
+  solver_fn callback;
+  void *callback_arg;
+  double deadline;  // When to give up searching, or 0 for never
+  const int *cancel; // Give up once this is set, if not NULL
+  bool timed_out;
+  size_t ticks;     // Search steps, to check the deadline every so often
+  solver_stats stats; // Totals over every run
 };
 
+// Search steps between checks of the deadline
+#define DEADLINE_TICKS 1024
+
 static bool search(solver *s, int k);
-static void cover(node *column);
-static void uncover(node *column);
+static inline node *choose_column(solver *s);
+static inline int gather_rows(node *column, node **rows);
+static inline void shuffle_rows(node **rows, int count);
+static void cover(solver *s, node *column);
+static void uncover(solver *s, node *column);
 
 // Create a new dancing links (DLX) solver. In order to allocate
 // memory, this needs to know some information about the exact cover
@@ -36,13 +53,18 @@ solver *solver_create(size_t inuse, size_t ncols, size_t nrows)
     fatal("failed to allocate memory for solver");
   }
 
+  s->inuse = inuse;
   s->ncols = ncols;
   s->nrows = nrows;
+  s->nprimary = ncols;
 
   size_t needed = inuse + ncols + 1;
   if ((s->nodes = calloc(needed, sizeof(node))) == NULL) {
     fatal("failed to allocate memory for solver nodes");
   }
+  if ((s->rows = calloc(nrows, sizeof(node *))) == NULL) {
+    fatal("failed to allocate memory for solver rows");
+  }
 
   return s;
 }
@@ -51,100 +73,247 @@ void solver_destroy(solver *s)
 {
   assert(s);
   free(s->nodes);
+  free(s->rows);
   free(s);
 }
 
+// Build the graph from a dense matrix of nrows x ncols cells, in row
+// major order. If strict is false, columns that no row covers are left
+// out, so that a search can still succeed without them.
 void solver_init_graph(solver *s, bool *cells, bool strict)
 {
   assert(s);
   assert(cells);
 
-  node *nodes = s->nodes;
-
-  // Link together column headers 1 through ncols-2
-  int nodes_used = s->ncols;
-  for (int col = 1; col < s->ncols-1; col++) {
-    nodes[col].left = &nodes[col-1];
-    nodes[col].right = &nodes[col+1];
-  }
-
-  // Link root in and create circular list for column headers
-  s->root = &nodes[nodes_used++];
-  s->root->right = &nodes[0];
-  nodes[0].left = s->root;
-  nodes[0].right = &nodes[1];
-  nodes[s->ncols-1].left = &nodes[s->ncols-2];
-  nodes[s->ncols-1].right = s->root;
-  s->root->left = &nodes[s->ncols-1];
-
-  // Build a circular list for each column. Store the nodes used so
-  // that the rows can also be made into a circular list on another
-  // pass.
-  node **used = calloc(s->ncols*s->nrows, sizeof(node *));
-  if (used == NULL) {
-    fatal("failed to allocate memory for solver used nodes");
+  // Gather the cells that are on into the sparse form
+  size_t *starts = malloc((s->nrows+1)*sizeof(size_t));
+  int *cols = malloc((s->inuse > 0 ? s->inuse : 1)*sizeof(int));
+  if (starts == NULL || cols == NULL) {
+    fatal("failed to allocate memory for solver rows");
   }
-  for (int col = 0; col < s->ncols; col++) {
-    // Set current to the column header
-    node *current = &nodes[col];
-    for (int row = 0; row < s->nrows; row++) {
+  size_t n = 0;
+  for (size_t row = 0; row < s->nrows; row++) {
+    starts[row] = n;
+    for (size_t col = 0; col < s->ncols; col++) {
       if (cells[row*s->ncols+col]) {
-        node *n = &nodes[nodes_used++];
-        current->down = n;
-        n->up = current;
-        n->column = &nodes[col];
-        // Increment the column header's total count
-        nodes[col].count++;
-        // Set the row number for this node
-        n->rownum = row;
-        current = n;
-        // There's no way to determine what n->left and n->right should
-        // be from here; store a pointer to n so this can be done later.
-        used[row*s->ncols+col] = n;
+        assert(n < s->inuse);
+        cols[n++] = col;
       }
     }
-    // Make circular by pointing to the column header
-    current->down = &nodes[col];
-    nodes[col].up = current;
   }
+  starts[s->nrows] = n;
 
-  // Build the circular lists for each row
-  for (int row = 0; row < s->nrows; row++) {
-    node *current = NULL;
-    node *first = NULL;
-    for (int col = 0; col < s->ncols; col++) {
-      node *n = used[row*s->ncols+col];
-      if (n != NULL) {
-        if (first == NULL) {
-          first = n;
-          current = first;
-        } else {
-          current->right = n;
-          n->left = current;
-          current = n;
-        }
+  solver_init_rows(s, starts, cols, strict);
+  free(starts);
+  free(cols);
+}
+
+// Build the graph from a sparse matrix: the columns of row r are
+// cols[starts[r]] up to cols[starts[r+1]-1], in increasing order.
+// starts has nrows+1 entries, and the solver should have been created
+// with room for starts[nrows] cells. Only the cells that are on take
+// any memory, so this suits matrices far too big to hold densely.
+void solver_init_rows(solver *s, const size_t *starts, const int *cols, bool strict)
+{
+  assert(s);
+  assert(starts);
+  assert(cols);
+  assert(starts[s->nrows] <= s->inuse);
+
+  node *nodes = s->nodes;
+
+  // Create a circular list of the root and the primary column headers.
+  // Secondary columns are left out of it, so a search never has to
+  // cover them, and each is a list of its own so that covering it
+  // still works.
+  size_t nodes_used = s->ncols;
+  s->root = &nodes[nodes_used++];
+  node *last = s->root;
+  for (size_t col = 0; col < s->ncols; col++) {
+    if (col < s->nprimary) {
+      last->right = &nodes[col];
+      nodes[col].left = last;
+      last = &nodes[col];
+    } else {
+      nodes[col].left = nodes[col].right = &nodes[col];
+    }
+  }
+  last->right = s->root;
+  s->root->left = last;
+
+  // Append each row's nodes to the bottom of their columns, keeping
+  // track of the bottom node of each column, and link them into a
+  // circular list for the row
+  node **bottom = malloc(s->ncols*sizeof(node *));
+  if (bottom == NULL) {
+    fatal("failed to allocate memory for solver columns");
+  }
+  for (size_t col = 0; col < s->ncols; col++) {
+    nodes[col].count = 0;
+    bottom[col] = &nodes[col];
+  }
+  for (size_t row = 0; row < s->nrows; row++) {
+    node *first = NULL, *current = NULL;
+    for (size_t i = starts[row]; i < starts[row+1]; i++) {
+      int col = cols[i];
+      assert(col >= 0 && col < s->ncols);
+      node *n = &nodes[nodes_used++];
+      bottom[col]->down = n;
+      n->up = bottom[col];
+      n->column = &nodes[col];
+      n->rownum = row;
+      nodes[col].count++;
+      bottom[col] = n;
+      if (first == NULL) {
+        first = n;
+      } else {
+        current->right = n;
+        n->left = current;
       }
+      current = n;
     }
     // Make the row list circular if there's 1 or more element
+    s->rows[row] = first;
     if (first != NULL) {
       current->right = first;
       first->left = current;
     }
   }
 
+  // Make the columns circular by pointing back to the column headers
+  for (size_t col = 0; col < s->ncols; col++) {
+    bottom[col]->down = &nodes[col];
+    nodes[col].up = bottom[col];
+  }
+  free(bottom);
+
   if (!strict) {
     // If a column header's count is 0, i.e., there are no
     // intersecting rows, and DLX won't find a solution. Remove the
     // column.
-    for (int col = 0; col < s->ncols; col++) {
+    for (size_t col = 0; col < s->ncols; col++) {
       if (nodes[col].count == 0) {
         nodes[col].left->right = nodes[col].right;
         nodes[col].right->left = nodes[col].left;
       }
     }
   }
+}
+
+// Make only the first nprimary columns of the matrix primary, i.e.
+// columns that a solution has to cover exactly once. The rest are
+// secondary columns, which a solution may cover at most once. Call
+// this before building the graph.
+void solver_set_primary(solver *s, size_t nprimary)
+{
+  assert(s);
+  assert(nprimary <= s->ncols);
+  s->nprimary = nprimary;
+}
 
-  free(used);
+// Call fn with each solution found, which can stop the search early.
+// In DLX_ALL mode this is how the solutions are seen.
+void solver_set_callback(solver *s, solver_fn fn, void *arg)
+{
+  assert(s);
+  s->callback = fn;
+  s->callback_arg = arg;
+}
+
+// Give up searching once get_time passes deadline. A search that gives
+// up fails, and solver_timed_out tells it apart from one that found no
+// solution. A deadline of 0 removes the limit.
+void solver_set_deadline(solver *s, double deadline)
+{
+  assert(s);
+  s->deadline = deadline;
+}
+
+// Give up searching once *cancel is set, which another thread may do
+// to stop a search whose result it no longer needs. The search is
+// treated as timed out. A NULL flag removes the check.
+void solver_set_cancel(solver *s, const int *cancel)
+{
+  assert(s);
+  s->cancel = cancel;
+}
+
+// Whether the last run gave up at the deadline or was cancelled
+bool solver_timed_out(solver *s)
+{
+  assert(s);
+  return s->timed_out;
+}
+
+// Put a row of the matrix into the solution set before searching,
+// e.g. to place a hint in a persistent sudoku graph. This covers the
+// columns the row satisfies, the same way search does. The row must
+// not conflict with the rows already selected, and rows must be
+// unselected in the reverse order they were selected in.
+void solver_select_row(solver *s, size_t row)
+{
+  assert(s);
+  assert(row < s->nrows);
+  assert(s->rows[row]);
+
+  node *r = s->rows[row];
+  cover(s, r->column);
+  for (node *c = r->right; c != r; c = c->right) {
+    cover(s, c->column);
+  }
+}
+
+// Undo solver_select_row. This must be called in the opposite order
+// from the selections.
+void solver_unselect_row(solver *s, size_t row)
+{
+  assert(s);
+  assert(row < s->nrows);
+  assert(s->rows[row]);
+
+  node *r = s->rows[row];
+  for (node *c = r->left; c != r; c = c->left) {
+    uncover(s, c->column);
+  }
+  uncover(s, r->column);
+}
+
+// Take a row out of the matrix, so that searches can't use it. This
+// is how a search is made to look for solutions other than a known
+// one. The row must be in the graph, i.e. not removed by a selected
+// row, and rows must be included in the reverse order they were
+// excluded in.
+void solver_exclude_row(solver *s, size_t row)
+{
+  assert(s);
+  assert(row < s->nrows);
+  assert(s->rows[row]);
+
+  node *r = s->rows[row];
+  node *n = r;
+  do {
+    n->up->down = n->down;
+    n->down->up = n->up;
+    n->column->count--;
+    n = n->right;
+  } while (n != r);
+}
+
+// Undo solver_exclude_row
+void solver_include_row(solver *s, size_t row)
+{
+  assert(s);
+  assert(row < s->nrows);
+  assert(s->rows[row]);
+
+  node *r = s->rows[row];
+  node *n = r->left;
+  do {
+    n->up->down = n;
+    n->down->up = n;
+    n->column->count++;
+    n = n->left;
+  } while (n != r->left);
 }
 
 // Search for a solution to the exact cover problem specified in the
@@ -156,6 +325,12 @@ void solver_init_graph(solver *s, bool *cells, bool strict)
 // In dlx_unique mode, check for more than one solution. Return true
 // only if there is exactly one solution.
 //
+// In dlx_first mode, find the first solution in the order of the
+// matrix rows. Return true if the puzzle can be solved.
+//
+// In dlx_all mode, find every solution, passing each to the callback.
+// Return true if there is at least one.
+//
 // The caller should provide the solution array. It will be filled
 // with the row indices of the DLX matrix. If the solution set is
 // smaller than the size provided, the remanining elements will be set
@@ -173,57 +348,179 @@ bool solver_run(solver *s, dlx_mode search_mode, int *solution, size_t size)
   s->solution = solution;
   s->solution_size = size;
   s->solution_count = 0;
+  s->timed_out = false;
+  s->stats.runs++;
 
   for (int i = 0; i < size; i++) {
     s->solution[i] = -1;
   }
 
   bool found = search(s, 0);
-  if (s->mode == DLX_RANDOM) {
-    return found;
-  } else {
+  if (s->timed_out) {
+    return false;
+  } else if (s->mode == DLX_UNIQUE) {
     return (s->solution_count == 1);
+  } else if (s->mode == DLX_ALL) {
+    return s->solution_count > 0;
+  } else {
+    return found;
   }
 
   return false;
 }
 
+// Get the number of solutions the last run found. In dlx_unique mode
+// this is at most 2.
+size_t solver_solutions(solver *s)
+{
+  assert(s);
+  return s->solution_count;
+}
+
+// Get the counters of the work done by every run of the solver so far
+void solver_get_stats(solver *s, solver_stats *stats)
+{
+  assert(s);
+  assert(stats);
+  *stats = s->stats;
+}
+
+// Zero the counters of the solver, to count the work of the runs that
+// follow on their own
+void solver_reset_stats(solver *s)
+{
+  assert(s);
+  memset(&s->stats, 0, sizeof(s->stats));
+}
+
+// Add the counters in stats to total, keeping the larger max depth
+void solver_stats_add(solver_stats *total, const solver_stats *stats)
+{
+  assert(total);
+  assert(stats);
+
+  total->runs += stats->runs;
+  total->nodes += stats->nodes;
+  total->backtracks += stats->backtracks;
+  total->links += stats->links;
+  total->solutions += stats->solutions;
+  if (stats->max_depth > total->max_depth) {
+    total->max_depth = stats->max_depth;
+  }
+}
+
+// Get the rows of the column a search would branch on first, the
+// primary column with the fewest rows. Every solution uses exactly one
+// of them, so searching with each one selected in turn splits the
+// search into independent parts. Up to size rows are stored in rows.
+// Return the number of rows in the column, or -1 if every primary
+// column is already covered.
+int solver_branch_rows(solver *s, int *rows, size_t size)
+{
+  assert(s);
+  assert(rows || size == 0);
+
+  if (s->root->right == s->root) {
+    return -1;
+  }
+  node *column = choose_column(s);
+
+  int n = 0;
+  for (node *row = column->down; row != column; row = row->down) {
+    if (n < size) {
+      rows[n] = row->rownum;
+    }
+    n++;
+  }
+  return n;
+}
+
+// The functions below run the steps of a search on their own, so that
+// microbenchmarks can time them on real graphs. They change the graph
+// the same way a search does, and leave it as it was once undone.
+
+// Get the column a search would branch on, the primary column with
+// the fewest rows, or -1 if every primary column is covered
+int solver_choose_column(solver *s)
+{
+  assert(s);
+  if (s->root->right == s->root) {
+    return -1;
+  }
+  return choose_column(s) - s->nodes;
+}
+
+// Gather the rows of a column and put them in a random order, the way a
+// search in DLX_RANDOM mode does before trying them. Up to size of the
+// row indices are stored in rows. Return the number of rows.
+int solver_shuffle_rows(solver *s, size_t col, int *rows, size_t size)
+{
+  assert(s);
+  assert(col < s->ncols);
+  assert(rows || size == 0);
+
+  node *column = &s->nodes[col];
+  int count = column->count;
+  if (count == 0) {
+    return 0;
+  }
+  node *shuffled[count];
+  gather_rows(column, shuffled);
+  shuffle_rows(shuffled, count);
+  for (int i = 0; i < count && i < size; i++) {
+    rows[i] = shuffled[i]->rownum;
+  }
+  return count;
+}
+
 bool search(solver *s, int k)
 {
   assert(s);
   assert(s->root);
-  assert(k >= 0 && k < s->solution_size);
+  // A solution may fill the whole set, so k only has to be in range
+  // once a row is added at it
+  assert(k >= 0 && k <= s->solution_size);
+
+  // Unwind the search as if a solution was found once past the
+  // deadline or cancelled, which restores the graph
+  if ((s->deadline > 0 || s->cancel != NULL) && ++s->ticks % DEADLINE_TICKS == 0 &&
+      ((s->cancel != NULL && __atomic_load_n(s->cancel, __ATOMIC_RELAXED)) ||
+       (s->deadline > 0 && get_time() > s->deadline))) {
+    s->timed_out = true;
+  }
+  if (s->timed_out) {
+    return true;
+  }
+
+  s->stats.nodes++;
+  if (k > s->stats.max_depth) {
+    s->stats.max_depth = k;
+  }
 
   if (s->root->right == s->root) {
     // If there's no more columns (constraints) left, we've found a
     // solution. This implicitly assumes that the same solution won't
     // be found twice.
     s->solution_count++;
-    return (s->mode == DLX_RANDOM || (s->mode == DLX_UNIQUE && s->solution_count > 1));
+    s->stats.solutions++;
+    if (s->callback != NULL && s->callback(s->solution, k, s->callback_arg)) {
+      return true;
+    }
+    return s->mode == DLX_ALL ? false : (s->mode != DLX_UNIQUE || s->solution_count > 1);
   }
 
   // Choose a column. It's presence indicates that the solution set
   // does not yet satisfy the constraint corresponding to this
-  // column. Pick the column (constraint) that has the least number of
-  // rows satisfying it, to minimize the branching factor of this
-  // algorithm.
-  node *column = s->root->right;
-  int min = column->count;
-  node *c = column->right;
-  while (c != s->root) {
-    if (c->count < min) {
-      column = c;
-      min = c->count;
-    }
-    c = c->right;
-  }
+  // column.
+  node *column = choose_column(s);
+  node *c;
 
   // Cover the column. This unlinks the column from the graph, as well
   // as all rows that intersect this column. The rows aren't needed
   // because one of the rows will be part of the solution set, and
   // since only one row should satisfy the constraint, the others are
   // unnecessary.
-  cover(column);
+  cover(s, column);
 
   // Store the rows in an array so that they can be ordered randomly.
   int count = column->count;
@@ -232,25 +529,14 @@ bool search(solver *s, int k)
     // recursively, it needs to be allocated here. Rather than many
     // small allocations on the heap, use a VLA.
     node *rows[count];
-    int i = 0;
-    node *row = column->down;
-    while (row != column) {
-      rows[i++] = row;
-      row = row->down;
-    }
-    
+    gather_rows(column, rows);
     if (s->mode == DLX_RANDOM) {
-      // Shuffle rows in random mode
-      for (i = count - 1; i >= 1; i--) {
-        int j = rand() % (i+1);
-        row = rows[i];
-        rows[i] = rows[j];
-        rows[j] = row;
-      }
+      shuffle_rows(rows, count);
     }
 
-    for (i = 0; i < count; i++) {
-      row = rows[i];
+    assert(k < s->solution_size);
+    for (int i = 0; i < count; i++) {
+      node *row = rows[i];
       s->solution[k] = row->rownum;
       
       // Remove all others rows that satisfy any of the constraints that
@@ -259,34 +545,83 @@ bool search(solver *s, int k)
       // set that satisfies a constraint that is already satisifed here.
       c = row->right;
       while (c != row) {
-        cover(c->column);
+        cover(s, c->column);
         c = c->right;
       }
 
       // Recursively search for a solution, with one less constraint.
-      if (search(s, k+1)) {
-        return true;
-      }
+      bool found = search(s, k+1);
 
-      // Putting this row in the solution didn't work, backtrack by
-      // uncovering the columns that were previously covered. Do this in
-      // reverse order.
+      // Either putting this row in the solution didn't work, or the
+      // search is over. Backtrack by uncovering the columns that were
+      // previously covered. Do this in reverse order. The graph is
+      // restored even when returning early so that it can be searched
+      // again.
       c = row->left;
       while (c != row) {
-        uncover(c->column);
+        uncover(s, c->column);
         c = c->left;
       }
+
+      if (found) {
+        uncover(s, column);
+        return true;
+      }
+      s->stats.backtracks++;
     }
   }
 
   // Since a solution could not be found with any of the rows, this
   // constraint could not be satisfied. Backtrack.
-  uncover(column);
+  uncover(s, column);
   return false;
 }
 
-void cover(node *column)
+// Pick the column (constraint) that has the least number of rows
+// satisfying it, to minimize the branching factor of the search. There
+// has to be a primary column left.
+static inline node *choose_column(solver *s)
 {
+  node *column = s->root->right;
+  size_t min = column->count;
+  node *c = column->right;
+  while (c != s->root) {
+    if (c->count < min) {
+      column = c;
+      min = c->count;
+    }
+    c = c->right;
+  }
+  return column;
+}
+
+// Store the rows of a column in rows, from the top, and return the
+// number of them
+static inline int gather_rows(node *column, node **rows)
+{
+  int n = 0;
+  for (node *row = column->down; row != column; row = row->down) {
+    rows[n++] = row;
+  }
+  return n;
+}
+
+// Put the rows in a random order
+static inline void shuffle_rows(node **rows, int count)
+{
+  for (int i = count - 1; i >= 1; i--) {
+    int j = rng_int(i+1);
+    node *row = rows[i];
+    rows[i] = rows[j];
+    rows[j] = row;
+  }
+}
+
+// Cover a column, counting the nodes unlinked in the solver's stats
+void cover(solver *s, node *column)
+{
+  size_t links = 0;
+
   // Change the column header list to point around this column
   column->left->right = column->right;
   column->right->left = column->left;
@@ -302,13 +637,18 @@ void cover(node *column)
       n->down->up = n->up;
       n->column->count--;
       n = n->right;
+      links++;
     }
     row = row->down;
   }
+  s->stats.links += links;
 }
 
-void uncover(node *column)
+// Undo cover, counting the nodes linked back in
+void uncover(solver *s, node *column)
 {
+  size_t links = 0;
+
   // For each row that this column intersects, restore the row into
   // the other columns' lists. This has to be done in the oppposite
   // order from the cover operation.
@@ -320,9 +660,11 @@ void uncover(node *column)
       n->down->up = n;
       n->column->count++;
       n = n->left;
+      links++;
     }
     row = row->up;
   }
+  s->stats.links += links;
 
   // Restore the column into the column header list
   column->left->right = column;
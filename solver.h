@@ -1,19 +1,57 @@
 #ifndef __SOLVER_H__
 #define __SOLVER_H__
 
+#include <stddef.h>
 #include <stdbool.h>
 
 typedef enum {
   DLX_RANDOM, // Find a random solution
   DLX_UNIQUE, // Check that there is exactly one solution
+  DLX_FIRST,  // Find the first solution, without randomizing
+  DLX_ALL,    // Find every solution, without randomizing
 } dlx_mode;
 
+// Called with each solution found: the rows of the matrix that make it
+// up. Return true to stop the search.
+typedef bool (*solver_fn)(const int *rows, size_t n, void *arg);
+
+// Counters of the work a solver has done. They are kept by each solver
+// as it searches, and can be added up across solvers and threads
+// afterwards.
+typedef struct {
+  size_t runs;       // Calls to solver_run
+  size_t nodes;      // Steps of the search
+  size_t backtracks; // Rows tried that didn't end the search
+  size_t max_depth;  // Most rows in a partial solution
+  size_t links;      // Nodes unlinked or relinked by cover and uncover
+  size_t solutions;
+} solver_stats;
+
 typedef struct node node;
 typedef struct solver solver;
 
 solver *solver_create(size_t inuse, size_t ncols, size_t nrows);
 void solver_destroy(solver *s);
 void solver_init_graph(solver *s, bool *cells, bool strict);
+void solver_init_rows(solver *s, const size_t *starts, const int *cols, bool strict);
+void solver_set_primary(solver *s, size_t nprimary);
+void solver_set_callback(solver *s, solver_fn fn, void *arg);
+void solver_set_deadline(solver *s, double deadline);
+void solver_set_cancel(solver *s, const int *cancel);
+bool solver_timed_out(solver *s);
+void solver_select_row(solver *s, size_t row);
+void solver_unselect_row(solver *s, size_t row);
+void solver_exclude_row(solver *s, size_t row);
+void solver_include_row(solver *s, size_t row);
 bool solver_run(solver *s, dlx_mode search_mode, int *solution, size_t size);
+size_t solver_solutions(solver *s);
+int solver_branch_rows(solver *s, int *rows, size_t size);
+void solver_get_stats(solver *s, solver_stats *stats);
+void solver_reset_stats(solver *s);
+void solver_stats_add(solver_stats *total, const solver_stats *stats);
+
+// The steps of a search, to time on their own
+int solver_choose_column(solver *s);
+int solver_shuffle_rows(solver *s, size_t col, int *rows, size_t size);
 
 #endif
@@ -1,30 +1,58 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "util.h"
 #include "sudoku.h"
 #include "solver.h"
+#include "grid.h"
+#include "rate.h"
+#include "perf.h"
+#include "trace.h"
+
+struct sudoku_checker {
+  solver *slvr;
+};
+
+// A set of cells that map onto each other under a symmetry. With no
+// symmetry every orbit is a single cell.
+typedef struct {
+  int cells[4];
+  int size;
+} orbit;
 
 static void seed(sudoku *s);
 static void init_shuffled_array(int *numbers, size_t n, int start);
-static bool *get_dlx_cells(sudoku *s, size_t *count, size_t *ncols, size_t *nrows);
-static void get_masks(sudoku *s, int *rows, int *cols, int *secs);
-static void get_section_idxs(int sec_idx, int *array);
 static void fill_solution(sudoku *s, int *set, size_t n);
-static void remove_deduced_hints(sudoku *s, int *order, size_t n);
-static void remove_non_unique_hints(sudoku *s, int *order, size_t n);
-static void add_extra_hints(sudoku *s, sudoku *solution, int extra_hints);
-
-// Get the index into the sudoku grid array
-#define GRID_IDX(x, y) ((y)*(SUDOKU_SIZE) + (x))
-
-// Get the grid x and y position from the sudoku grid index
-#define GRID_X(idx) ((idx)%(SUDOKU_SIZE))
-#define GRID_Y(idx) ((idx)/(SUDOKU_SIZE))
-
-// Get the section index given the sudoku cell position
-#define SEC_IDX(x, y) (((y)/3)*3 + (x)/3)
+static int get_orbit(int idx, sudoku_symmetry symmetry, int *cells);
+static size_t get_orbits(sudoku_symmetry symmetry, int *order, size_t n, orbit *orbits);
+static bool solve_grid(sudoku *s, solver_stats *stats);
+static size_t remove_deduced_hints(sudoku_state *st, orbit *orbits, size_t n);
+static bool remove_non_unique_hints(sudoku_state *st, orbit *orbits, size_t n,
+                                    int max_difficulty, size_t *probes,
+                                    solver_stats *search);
+static void remove_propagated_hints(sudoku_state *st, orbit *orbits, size_t n,
+                                    size_t *propagations);
+static void add_extra_hints(sudoku *s, sudoku *solution, int extra_hints,
+                            sudoku_symmetry symmetry);
+static bool checker_run(sudoku_checker *c, sudoku *s, dlx_mode mode);
+static sudoku_checker *get_probe_checker(void);
+static void make_probe_key(void);
+static void free_probe_checker(void *checker);
+static int get_hint_rows(sudoku *s, int *rows);
+static void audit_hints(solver *slvr, int *hints, int lo, int hi, bool *redundant);
+
+// Most solution grids tried for a difficulty range
+#define MAX_ATTEMPTS 10000
+
+// Hints removed between ratings of a puzzle that has a difficulty limit
+#define RATE_REMOVALS 2
+
+// Each thread that generates puzzles runs its uniqueness probes on a
+// checker of its own, made on first use and freed when the thread exits
+static pthread_key_t probe_key;
+static pthread_once_t probe_once = PTHREAD_ONCE_INIT;
 
 // The size of the DLX array
 #define DLX_MAX_ROWS (GRID_SIZE*SUDOKU_SIZE)
@@ -46,11 +74,45 @@ static void add_extra_hints(sudoku *s, sudoku *solution, int extra_hints);
 #define DLX_Y(r) (((r)/9)/9)
 #define DLX_V(r) (((r)%9)+1)
 
+// Set up the state of a grid. Return false if the grid holds values
+// that conflict, or that are out of range and left out. The masks hold
+// every value used either way.
+bool sudoku_state_init(sudoku_state *st, const sudoku *s)
+{
+  assert(st);
+  assert(s);
+
+  bool valid = true;
+  memset(st, 0, sizeof(*st));
+  st->empty = GRID_SIZE;
+  for (int i = 0; i < GRID_SIZE; i++) {
+    sudoku_value v = s->grid[i];
+    if (v > SUDOKU_SIZE) {
+      valid = false;
+    } else if (v != 0) {
+      valid = valid && (sudoku_state_candidates(st, i) & (1 << v)) != 0;
+      sudoku_state_place(st, i, v);
+    }
+  }
+  return valid;
+}
+
 // Solve the sudoku puzzle and fill in the solution
 bool sudoku_solve(sudoku *s)
+{
+  assert(s);
+  return solve_grid(s, NULL);
+}
+
+// Solve the puzzle like sudoku_solve, adding the solver's counters to
+// stats if it isn't NULL
+static bool solve_grid(sudoku *s, solver_stats *stats)
 {
   size_t count, ncols, nrows;
-  bool *cells = get_dlx_cells(s, &count, &ncols, &nrows);
+  sudoku_state st;
+  perf_begin(PERF_BUILD);
+  sudoku_state_init(&st, s);
+  bool *cells = sudoku_dlx_cells(&st, &count, &ncols, &nrows);
   solver *slvr = solver_create(count, ncols, nrows);
   bool solved = false;
 
@@ -60,10 +122,18 @@ bool sudoku_solve(sudoku *s)
   int set[GRID_SIZE];
 
   solver_init_graph(slvr, cells, false);
+  perf_end();
+  perf_begin(PERF_SEARCH);
   solved = solver_run(slvr, DLX_RANDOM, set, GRID_SIZE);
+  perf_end();
   if (solved) {
     fill_solution(s, set, GRID_SIZE);
   }
+  if (stats != NULL) {
+    solver_stats run;
+    solver_get_stats(slvr, &run);
+    solver_stats_add(stats, &run);
+  }
 
   free(cells);
   solver_destroy(slvr);
@@ -71,34 +141,175 @@ bool sudoku_solve(sudoku *s)
 }
 
 // Initialize a sudoku object to contain an unsolved puzzle, while
-// filling in the solution into another sudoku object.
-void sudoku_generate(sudoku *s, sudoku *solution, int extra_hints)
+// filling in the solution into another sudoku object. If stats is not
+// NULL, it is filled in with counters describing the work done.
+//
+// If a difficulty range is given, new solution grids are tried until
+// one gives a puzzle in the range, for at most opts->max_attempts
+// grids (MAX_ATTEMPTS if 0) or opts->time_limit seconds. Return false
+// if none did, leaving the last puzzle tried in s.
+bool sudoku_generate(sudoku *s, sudoku *solution, const sudoku_options *opts,
+                     sudoku_stats *stats)
 {
   assert(s);
   assert(solution);
+  assert(opts);
+
+  size_t probes = 0, deduced = 0, propagations = 0, attempts = 0, abandoned = 0;
+  solver_stats fill, probe;
+  uint64_t phase_ns[SUDOKU_PHASES];
+  bool done = false;
+  bool ranged = opts->min_difficulty != DIFFICULTY_ANY || opts->max_difficulty != DIFFICULTY_ANY;
+  double deadline = opts->time_limit > 0 ? get_time() + opts->time_limit : 0;
+  size_t max_attempts = opts->max_attempts > 0 ? opts->max_attempts : MAX_ATTEMPTS;
+  memset(&fill, 0, sizeof(fill));
+  memset(&probe, 0, sizeof(probe));
+  memset(phase_ns, 0, sizeof(phase_ns));
+
+  // Removing hints never makes a puzzle easier, so once a puzzle is
+  // too hard part way through removing hints there is no point in
+  // going on. Extra hints added at the end can make it easier again,
+  // so in that case only the finished puzzle can be checked.
+  int early_limit = opts->extra_hints > 0 ? DIFFICULTY_ANY : opts->max_difficulty;
+
+  while (!done && (attempts == 0 || (attempts < max_attempts &&
+                                      (deadline == 0 || get_time() < deadline)))) {
+    attempts++;
+
+    // Partially prefill an empty grid (to speed up generation) and
+    // solve it.
+    uint64_t start = get_time_ns();
+    trace_begin("solve", -1);
+    seed(s);
+    if (!solve_grid(s, &fill)) {
+      trace_end();
+      warn("could not generate sudoku puzzle");
+      return false;
+    }
 
-  // Partially prefill an empty grid (to speed up generation) and
-  // solve it.
-  seed(s);
-  if (!sudoku_solve(s)) {
-    warn("could not generate sudoku puzzle");
-    return;
+    // Copy the solution before removing hints. The hints are removed
+    // from a state that keeps the masks of the grid up to date.
+    memcpy(solution, s, sizeof(sudoku));
+    sudoku_state st;
+    sudoku_state_init(&st, s);
+
+    // Go through the hints in random order, grouped into orbits of the
+    // requested symmetry. If the hints can be deduced from the other
+    // hints, remove them.
+    int hints[GRID_SIZE];
+    orbit orbits[GRID_SIZE];
+    init_shuffled_array(hints, GRID_SIZE, 0);
+    size_t norbits = get_orbits(opts->symmetry, hints, GRID_SIZE, orbits);
+    trace_end();
+    uint64_t deduce_start = get_time_ns();
+    phase_ns[PHASE_SOLVE] += deduce_start - start;
+    perf_begin(PERF_MINIMIZE);
+    trace_begin("deduce", -1);
+    deduced += remove_deduced_hints(&st, orbits, norbits);
+    trace_end();
+    uint64_t unique_start = get_time_ns();
+    phase_ns[PHASE_DEDUCE] += unique_start - deduce_start;
+    trace_begin("unique", -1);
+
+    bool kept = true;
+    if (opts->singles_only) {
+      // Remove hints that singles can do without. A puzzle that singles
+      // solve is unique, so the solver isn't needed.
+      remove_propagated_hints(&st, orbits, norbits, &propagations);
+    } else {
+      // Remove hints that lead to multiple solutions
+      kept = remove_non_unique_hints(&st, orbits, norbits, early_limit, &probes, &probe);
+    }
+    trace_end();
+    uint64_t extra_start = get_time_ns();
+    phase_ns[PHASE_UNIQUE] += extra_start - unique_start;
+    if (!kept) {
+      perf_end();
+      abandoned++;
+      continue;
+    }
+    memcpy(s, &st.grid, sizeof(sudoku));
+
+    // Add back in some hints to make it easier
+    trace_begin("extra", -1);
+    add_extra_hints(s, solution, opts->extra_hints, opts->symmetry);
+    trace_end();
+    phase_ns[PHASE_EXTRA] += get_time_ns() - extra_start;
+    perf_end();
+
+    // The finished puzzle is rated whether or not it was rated on the
+    // way, as it may be too easy, or too hard without having been
+    // rated since the last hints were removed
+    done = true;
+    if (ranged) {
+      sudoku_difficulty level = rate_puzzle(s, opts->max_difficulty);
+      done = level >= opts->min_difficulty &&
+        (opts->max_difficulty == DIFFICULTY_ANY || level <= opts->max_difficulty);
+      abandoned += !done;
+    }
   }
 
-  // Copy the solution before removing hints
-  memcpy(solution, s, sizeof(sudoku));
+  if (stats != NULL) {
+    stats->probes = probes;
+    stats->deduced = deduced;
+    stats->propagations = propagations;
+    stats->attempts = attempts;
+    stats->abandoned = abandoned;
+    stats->fill = fill;
+    stats->probe = probe;
+    memcpy(stats->phase_ns, phase_ns, sizeof(phase_ns));
+  }
+  return done;
+}
 
-  // Go through the hints in random order. If the hint can be deduced
-  // from the other hints, remove it.
-  int hints[GRID_SIZE];
-  init_shuffled_array(hints, GRID_SIZE, 0);
-  remove_deduced_hints(s, hints, GRID_SIZE);
-  
-  // Remove hints that lead to multiple solutions
-  remove_non_unique_hints(s, hints, GRID_SIZE);
+// Add the counters in stats to total
+void sudoku_stats_add(sudoku_stats *total, const sudoku_stats *stats)
+{
+  assert(total);
+  assert(stats);
+
+  total->probes += stats->probes;
+  total->deduced += stats->deduced;
+  total->propagations += stats->propagations;
+  total->attempts += stats->attempts;
+  total->abandoned += stats->abandoned;
+  solver_stats_add(&total->fill, &stats->fill);
+  solver_stats_add(&total->probe, &stats->probe);
+  for (int i = 0; i < SUDOKU_PHASES; i++) {
+    total->phase_ns[i] += stats->phase_ns[i];
+  }
+}
 
-  // Add back in some hints to make it easier
-  add_extra_hints(s, solution, extra_hints);
+// Get the name of a phase of generation
+const char *sudoku_phase_name(sudoku_phase phase)
+{
+  static const char *names[] = { "solve", "deduce", "unique", "extra" };
+  assert(phase >= 0 && phase < SUDOKU_PHASES);
+  return names[phase];
+}
+
+static const char *symmetry_names[] = { "none", "rot180", "rot90", "diag", "mirror" };
+
+// Get the name of a symmetry, as sudoku_parse_symmetry takes it
+const char *sudoku_symmetry_name(sudoku_symmetry symmetry)
+{
+  assert(symmetry >= SYMMETRY_NONE && symmetry <= SYMMETRY_MIRROR);
+  return symmetry_names[symmetry];
+}
+
+// Parse the name of a symmetry: none, rot180, rot90, diag or mirror
+bool sudoku_parse_symmetry(const char *name, sudoku_symmetry *symmetry)
+{
+  assert(name);
+  assert(symmetry);
+
+  for (int i = 0; i <= SYMMETRY_MIRROR; i++) {
+    if (strcmp(name, symmetry_names[i]) == 0) {
+      *symmetry = i;
+      return true;
+    }
+  }
+  return false;
 }
 
 void sudoku_print(sudoku *s, FILE *fp)
@@ -124,6 +335,265 @@ void sudoku_print(sudoku *s, FILE *fp)
   }
 }
 
+// Print the puzzle on a single line, one character per cell in row
+// major order, with '.' for empty cells
+void sudoku_print_line(sudoku *s, FILE *fp)
+{
+  assert(s);
+  assert(fp);
+
+  char line[GRID_SIZE+2];
+  sudoku_format_line(s, line);
+  fputs(line, fp);
+}
+
+// Format the puzzle the way sudoku_print_line prints it, including
+// the newline. The line should have room for GRID_SIZE+2 characters.
+void sudoku_format_line(sudoku *s, char *line)
+{
+  assert(s);
+  assert(line);
+
+  for (int i = 0; i < GRID_SIZE; i++) {
+    line[i] = s->grid[i] == 0 ? '.' : '0' + s->grid[i];
+  }
+  line[GRID_SIZE] = '\n';
+  line[GRID_SIZE+1] = '\0';
+}
+
+// Parse a puzzle in the format written by sudoku_print_line. Empty
+// cells may be written as '.' or '0', and anything after the 81 cells
+// is ignored. Return false if the line doesn't start with a puzzle.
+bool sudoku_parse(const char *line, sudoku *s)
+{
+  assert(line);
+  assert(s);
+
+  for (int i = 0; i < GRID_SIZE; i++) {
+    if (line[i] >= '1' && line[i] <= '9') {
+      s->grid[i] = line[i] - '0';
+    } else if (line[i] == '.' || line[i] == '0') {
+      s->grid[i] = 0;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Count the number of hints (filled in cells) in the puzzle
+int sudoku_count_hints(sudoku *s)
+{
+  assert(s);
+
+  int count = 0;
+  for (int i = 0; i < GRID_SIZE; i++) {
+    count += (s->grid[i] != 0);
+  }
+  return count;
+}
+
+// Create a checker holding the DLX graph of an empty grid
+sudoku_checker *sudoku_checker_create(void)
+{
+  sudoku_checker *c = calloc(1, sizeof(sudoku_checker));
+  if (c == NULL) {
+    fatal("failed to allocate memory for sudoku checker");
+  }
+  c->slvr = grid_solver_create(SUDOKU_SIZE, 3, 3);
+  return c;
+}
+
+void sudoku_checker_destroy(sudoku_checker *c)
+{
+  assert(c);
+  solver_destroy(c->slvr);
+  free(c);
+}
+
+// Check that the puzzle has exactly one solution. The hints are
+// selected in the checker's graph for the search and unselected
+// afterwards, leaving the graph ready for the next check.
+bool sudoku_checker_unique(sudoku_checker *c, sudoku *s)
+{
+  assert(c);
+  assert(s);
+
+  return checker_run(c, s, DLX_UNIQUE);
+}
+
+// Fill in a random solution to the puzzle using the checker's
+// graph. Return false if the puzzle has no solution.
+bool sudoku_checker_solve(sudoku_checker *c, sudoku *s)
+{
+  assert(c);
+  assert(s);
+
+  return checker_run(c, s, DLX_RANDOM);
+}
+
+// Make the checker's searches give up, and fail, once *cancel is set
+void sudoku_checker_set_cancel(sudoku_checker *c, const int *cancel)
+{
+  assert(c);
+  solver_set_cancel(c->slvr, cancel);
+}
+
+// Make the checker's searches give up, and fail, at deadline, unless
+// it is 0
+void sudoku_checker_set_deadline(sudoku_checker *c, double deadline)
+{
+  assert(c);
+  solver_set_deadline(c->slvr, deadline);
+}
+
+// Whether the checker's last search gave up, at its deadline or on
+// being cancelled
+bool sudoku_checker_timed_out(sudoku_checker *c)
+{
+  assert(c);
+  return solver_timed_out(c->slvr);
+}
+
+// Fill the grid with a random solved sudoku, the same way
+// sudoku_generate starts out, but without building a new graph
+void sudoku_checker_fill(sudoku_checker *c, sudoku *s)
+{
+  assert(c);
+  assert(s);
+
+  seed(s);
+  checker_run(c, s, DLX_RANDOM);
+}
+
+// Select the puzzle's hints in the checker's graph, search it in the
+// given mode, and unselect the hints. In random mode the solution is
+// filled in.
+static bool checker_run(sudoku_checker *c, sudoku *s, dlx_mode mode)
+{
+  int hints[GRID_SIZE];
+  int nhints = get_hint_rows(s, hints);
+  if (nhints < 0) {
+    return false;
+  }
+
+  // The search recurses once more after the last cell is filled
+  int set[GRID_SIZE+1];
+  bool found = grid_solver_run(c->slvr, hints, nhints, -1, mode, set, GRID_SIZE+1);
+
+  if (found && mode == DLX_RANDOM) {
+    fill_solution(s, set, GRID_SIZE+1);
+  }
+  return found;
+}
+
+// Get the DLX rows of the puzzle's hints in grid order. Return the
+// number of hints, or -1 if the puzzle repeats a value in a row,
+// column or section. Selecting two rows that conflict would corrupt a
+// checker's graph, so those puzzles have to be rejected up front.
+static int get_hint_rows(sudoku *s, int *rows)
+{
+  int row_masks[SUDOKU_SIZE], col_masks[SUDOKU_SIZE], sec_masks[SUDOKU_SIZE];
+  int nhints = 0;
+  memset(row_masks, 0, sizeof(row_masks));
+  memset(col_masks, 0, sizeof(col_masks));
+  memset(sec_masks, 0, sizeof(sec_masks));
+  for (int i = 0; i < GRID_SIZE; i++) {
+    if (s->grid[i] != 0) {
+      int x = GRID_X(i), y = GRID_Y(i), sec = SEC_IDX(x, y);
+      int bit = 1 << s->grid[i];
+      if ((row_masks[y] | col_masks[x] | sec_masks[sec]) & bit) {
+        return -1;
+      }
+      row_masks[y] |= bit;
+      col_masks[x] |= bit;
+      sec_masks[sec] |= bit;
+      rows[nhints++] = DLX_ROW(s->grid[i]-1, x, y);
+    }
+  }
+  return nhints;
+}
+
+// Count the solutions of a puzzle (up to 2) and, if it is unique and
+// find_redundant is set, find the hints it would still be unique
+// without. The results are stored in audit. Return false if the hints
+// break the rules, in which case the puzzle has no solutions.
+bool sudoku_checker_audit(sudoku_checker *c, sudoku *s, bool find_redundant,
+                          sudoku_audit *audit)
+{
+  assert(c);
+  assert(s);
+  assert(audit);
+
+  int hints[GRID_SIZE], set[GRID_SIZE+1];
+  memset(audit, 0, sizeof(*audit));
+  audit->hints = get_hint_rows(s, hints);
+  if (audit->hints < 0) {
+    audit->hints = sudoku_count_hints(s);
+    return false;
+  }
+
+  for (int i = 0; i < audit->hints; i++) {
+    solver_select_row(c->slvr, hints[i]);
+  }
+  solver_run(c->slvr, DLX_UNIQUE, set, GRID_SIZE+1);
+  audit->solutions = solver_solutions(c->slvr);
+  for (int i = audit->hints-1; i >= 0; i--) {
+    solver_unselect_row(c->slvr, hints[i]);
+  }
+
+  if (find_redundant && audit->solutions == 1 && audit->hints > 0) {
+    bool redundant[GRID_SIZE];
+    audit_hints(c->slvr, hints, 0, audit->hints, redundant);
+    for (int i = 0; i < audit->hints; i++) {
+      if (redundant[i]) {
+        audit->redundant[audit->nredundant++] =
+          GRID_IDX(DLX_X(hints[i]), DLX_Y(hints[i]));
+      }
+    }
+  }
+  return true;
+}
+
+// Find which of the hints lo to hi-1 in a unique puzzle can be
+// removed, with all of the puzzle's other hints selected in the
+// graph. Checking each hint on its own would select every other hint
+// once per hint. Instead the range is split in half, and each half is
+// checked with the other half selected, so a hint is selected
+// O(log n) times in all.
+//
+// With all the other hints selected, a hint is redundant if no
+// solution puts a different value in its cell. Excluding the hint's
+// row looks for exactly those solutions, and only has to find one.
+static void audit_hints(solver *slvr, int *hints, int lo, int hi, bool *redundant)
+{
+  int set[GRID_SIZE+1];
+
+  if (hi - lo == 1) {
+    solver_exclude_row(slvr, hints[lo]);
+    redundant[lo] = !solver_run(slvr, DLX_FIRST, set, GRID_SIZE+1);
+    solver_include_row(slvr, hints[lo]);
+    return;
+  }
+
+  int mid = (lo + hi) / 2;
+  for (int i = mid; i < hi; i++) {
+    solver_select_row(slvr, hints[i]);
+  }
+  audit_hints(slvr, hints, lo, mid, redundant);
+  for (int i = hi-1; i >= mid; i--) {
+    solver_unselect_row(slvr, hints[i]);
+  }
+
+  for (int i = lo; i < mid; i++) {
+    solver_select_row(slvr, hints[i]);
+  }
+  audit_hints(slvr, hints, mid, hi, redundant);
+  for (int i = mid-1; i >= lo; i--) {
+    solver_unselect_row(slvr, hints[i]);
+  }
+}
+
 // Seed an empty sudoku grid by filling in the first row randomly
 void seed(sudoku *s)
 {
@@ -166,9 +636,10 @@ void init_shuffled_array(int *numbers, size_t n, int start)
 // there are 9 rows and each must have the numbers 1-9, which adds to
 // another 81 constraints. In total, there are 324 constraints.
 //
-bool *get_dlx_cells(sudoku *s, size_t *count, size_t *ncols, size_t *nrows)
+bool *sudoku_dlx_cells(const sudoku_state *st, size_t *count, size_t *ncols,
+                       size_t *nrows)
 {
-  assert(s);
+  assert(st);
   assert(count);
   assert(ncols);
   assert(nrows);
@@ -181,18 +652,14 @@ bool *get_dlx_cells(sudoku *s, size_t *count, size_t *ncols, size_t *nrows)
   *ncols = DLX_MAX_COLS;
   *nrows = DLX_MAX_ROWS;
 
-  int row_masks[SUDOKU_SIZE], col_masks[SUDOKU_SIZE], sec_masks[SUDOKU_SIZE];
-  get_masks(s, row_masks, col_masks, sec_masks);
-
   for (int x = 0; x < SUDOKU_SIZE; x++) {
     for (int y = 0; y < SUDOKU_SIZE; y++) {
-      if (s->grid[GRID_IDX(x, y)] == 0) {
-        int sec = SEC_IDX(x, y);
-        int net_mask = row_masks[y] | col_masks[x] | sec_masks[sec];
+      if (st->grid.grid[GRID_IDX(x, y)] == 0) {
+        int candidates = sudoku_state_candidates(st, GRID_IDX(x, y));
         for (int v = 0; v < 9; v++) {
           // Skip over rows if they would lead to duplicates in a row,
           // column, or section.
-          if ((net_mask & (1<<(v+1))) == 0) {
+          if (candidates & (1<<(v+1))) {
             int row = DLX_ROW(v, x, y);
             cells[DLX_CELL_IDX(row, DLX_COL1(v, x, y))] = true;
             cells[DLX_CELL_IDX(row, DLX_COL2(v, x, y))] = true;
@@ -208,126 +675,251 @@ bool *get_dlx_cells(sudoku *s, size_t *count, size_t *ncols, size_t *nrows)
   return cells;
 }
 
-// Compute masks of which values are in use for each row, column, and
-// section of the sudoku grid. The masks are stored in passed in
-// arrays, each whose size is SUDOKU_SIZE.
-static void get_masks(sudoku *s, int *rows, int *cols, int *secs)
+// Fill in the sudoku grid based on the solution set produced by the
+// DLX algorithm.
+static void fill_solution(sudoku *s, int *set, size_t n)
 {
   assert(s);
-  assert(rows);
-  assert(cols);
-  assert(secs);
+  assert(set);
 
-  int sec_idxs[SUDOKU_SIZE] = { 0 };
-  for (int i = 0; i < SUDOKU_SIZE; i++) {
-    rows[i] = 0;
-    cols[i] = 0;
-    secs[i] = 0;
-    get_section_idxs(i, sec_idxs);
-    for (int j = 0; j < SUDOKU_SIZE; j++) {
-      rows[i] |= (1 << s->grid[GRID_IDX(j, i)]);
-      cols[i] |= (1 << s->grid[GRID_IDX(i, j)]);
-      secs[i] |= (1 << s->grid[sec_idxs[j]]);
+  for (int i = 0; i < n; i++) {
+    int r = set[i];
+    if (r != -1) {
+      s->grid[GRID_IDX(DLX_X(r), DLX_Y(r))] = DLX_V(r);
     }
   }
 }
 
-// Fill the provided array with the sudoku grid indices for the given
-// numbered section. The array should be SUDOKU_SIZE in length.
-static void get_section_idxs(int sec_idx, int *array)
+// Get the cells that the cell at idx maps onto under the symmetry,
+// including idx itself. The cells array should have room for 4
+// cells. Return the number of distinct cells in the orbit.
+static int get_orbit(int idx, sudoku_symmetry symmetry, int *cells)
 {
-  for (int i = 0; i < SUDOKU_SIZE; i++) {
-    int sx = (sec_idx%3)*3 + i%3;
-    int sy = (sec_idx/3)*3 + i/3;
-    array[i] = GRID_IDX(sx, sy);
+  assert(cells);
+
+  int x = GRID_X(idx), y = GRID_Y(idx), m = SUDOKU_SIZE-1;
+  int images[4] = { idx, idx, idx, idx };
+  switch (symmetry) {
+  case SYMMETRY_NONE:
+    break;
+  case SYMMETRY_ROT180:
+    images[1] = GRID_IDX(m-x, m-y);
+    break;
+  case SYMMETRY_ROT90:
+    images[1] = GRID_IDX(m-y, x);
+    images[2] = GRID_IDX(m-x, m-y);
+    images[3] = GRID_IDX(y, m-x);
+    break;
+  case SYMMETRY_DIAG:
+    images[1] = GRID_IDX(y, x);
+    break;
+  case SYMMETRY_MIRROR:
+    images[1] = GRID_IDX(m-x, y);
+    break;
   }
+
+  // Cells on an axis or at the center map onto themselves, so drop
+  // the duplicates
+  int size = 0;
+  for (int i = 0; i < 4; i++) {
+    bool seen = false;
+    for (int j = 0; j < size; j++) {
+      seen = seen || (cells[j] == images[i]);
+    }
+    if (!seen) {
+      cells[size++] = images[i];
+    }
+  }
+  return size;
 }
 
-// Fill in the sudoku grid based on the solution set produced by the
-// DLX algorithm.
-static void fill_solution(sudoku *s, int *set, size_t n)
+// Split the n grid indices in order into orbits of the symmetry. The
+// orbits are stored in the order their first cell appears in the
+// order array, so a randomized order gives randomly ordered
+// orbits. Return the number of orbits.
+static size_t get_orbits(sudoku_symmetry symmetry, int *order, size_t n, orbit *orbits)
 {
-  assert(s);
-  assert(set);
+  assert(order);
+  assert(orbits);
 
+  bool taken[GRID_SIZE] = { false };
+  size_t count = 0;
   for (int i = 0; i < n; i++) {
-    int r = set[i];
-    if (r != -1) {
-      s->grid[GRID_IDX(DLX_X(r), DLX_Y(r))] = DLX_V(r);
+    if (!taken[order[i]]) {
+      orbit *o = &orbits[count++];
+      o->size = get_orbit(order[i], symmetry, o->cells);
+      for (int j = 0; j < o->size; j++) {
+        taken[o->cells[j]] = true;
+      }
     }
   }
+  return count;
 }
 
 // From a completely solved puzzle, remove hints that can be deduced
-// from other hints. The order the hints should be processed in is
-// specified in the order array of size n. The order array should be
-// randomized by the caller.
-static void remove_deduced_hints(sudoku *s, int *order, size_t n)
+// from other hints. The hints are processed an orbit at a time in
+// the order of the orbits array of size n, which should be randomized
+// by the caller. An orbit is only removed if every one of its hints
+// can be deduced. Return the number of orbits removed.
+static size_t remove_deduced_hints(sudoku_state *st, orbit *orbits, size_t n)
 {
-  assert(s);
-  assert(order);
+  assert(st);
+  assert(orbits);
 
-  int row_masks[SUDOKU_SIZE], col_masks[SUDOKU_SIZE], sec_masks[SUDOKU_SIZE];
+  size_t removed_orbits = 0;
+  // Go through each orbit and remove its hints if they can be deduced
+  // from the other hints
+  for (int i = 0; i < n; i++) {
+    sudoku_value values[4];
+    int removed = 0;
+    for (; removed < orbits[i].size; removed++) {
+      // If every other number is used in this row, column, and
+      // section, the hint's value is the only candidate left once it
+      // is removed, so it can be deduced and is not needed.
+      int idx = orbits[i].cells[removed];
+      values[removed] = sudoku_state_remove(st, idx);
+      if (sudoku_state_candidates(st, idx) != (1 << values[removed])) {
+        sudoku_state_place(st, idx, values[removed]);
+        break;
+      }
+    }
 
-  // Since the sudoku is initially solved, set the masks to have all
-  // bits on
-  int all_on = (1 << (SUDOKU_SIZE+1)) - 2;
-  for ( int i = 0; i < SUDOKU_SIZE; i++ ) {
-    row_masks[i] = col_masks[i] = sec_masks[i] = all_on;
+    // If part of the orbit can't be deduced, put back the hints that
+    // were already taken out
+    if (removed < orbits[i].size) {
+      while (removed-- > 0) {
+        sudoku_state_place(st, orbits[i].cells[removed], values[removed]);
+      }
+    } else {
+      removed_orbits++;
+    }
   }
+  return removed_orbits;
+}
 
-  // Go through each hint and remove it if it can be deduced from the
-  // other hints
-  for (int i = 0; i < n; i++) {
-    int x = GRID_X(order[i]), y = GRID_Y(order[i]), sec = SEC_IDX(x, y);
-    // Compute which numbers are used in this row, column, and
-    // section. If all numbers are used then removing the hint at this
-    // position, then it can be deduced and is not needed.
-    int used = row_masks[y] | col_masks[x] | sec_masks[sec];
-    if (used == all_on) {
-      int remove = ~ (1 << s->grid[GRID_IDX(x, y)]);
-      row_masks[y] &= remove;
-      col_masks[x] &= remove;
-      sec_masks[sec] &= remove;
-      s->grid[GRID_IDX(x, y)] = 0;
+// Remove hints that lead to multiple solutions. The hints are
+// processed an orbit at a time in the order of the orbits array of
+// size n, which should be randomized by the caller. A single
+// uniqueness check decides all of the hints in an orbit. The number of
+// uniqueness checks run is added to probes, and their counters to
+// search.
+//
+// If max_difficulty is given, the puzzle is rated after every
+// RATE_REMOVALS orbits removed, and the removal stops as soon as the
+// puzzle is harder than max_difficulty. Return false in that case.
+//
+// The probes run on the thread's checker, which holds the graph of the
+// empty grid: each selects the remaining hints, searches, and
+// unselects them, rather than building a graph for the grid.
+static bool remove_non_unique_hints(sudoku_state *st, orbit *orbits, size_t n,
+                                    int max_difficulty, size_t *probes,
+                                    solver_stats *search)
+{
+  assert(st);
+  assert(orbits);
+  assert(probes);
+  assert(search);
+
+  sudoku_checker *checker = get_probe_checker();
+  solver_reset_stats(checker->slvr);
+  bool kept = true;
+  size_t removals = 0;
+
+  for (int i = 0; i < n && kept; i++) {
+    orbit *o = &orbits[i];
+    // remove_deduced_hints removes whole orbits, so either all or none
+    // of the orbit's cells still hold hints
+    if (st->grid.grid[o->cells[0]] != 0) {
+      // Tentatively remove the hints, and then search for a unique
+      // solution
+      sudoku_value values[4];
+      for (int j = 0; j < o->size; j++) {
+        values[j] = sudoku_state_remove(st, o->cells[j]);
+      }
+      trace_begin("probe", o->cells[0]);
+      perf_begin(PERF_SEARCH);
+      bool unique = checker_run(checker, &st->grid, DLX_UNIQUE);
+      perf_end();
+      (*probes)++;
+      // Add the hints back in if a unique solution was found
+      if (!unique) {
+        for (int j = 0; j < o->size; j++) {
+          sudoku_state_place(st, o->cells[j], values[j]);
+        }
+      }
+      trace_end();
+
+      if (unique && max_difficulty != DIFFICULTY_ANY && ++removals % RATE_REMOVALS == 0 &&
+          rate_puzzle(&st->grid, max_difficulty) > max_difficulty) {
+        kept = false;
+      }
     }
   }
+
+  solver_stats run;
+  solver_get_stats(checker->slvr, &run);
+  solver_stats_add(search, &run);
+  return kept;
 }
 
-// Remove hints that lead to multiple solutions. The order the hints
-// should be processed in is specified in the order array of size
-// n. The order array should be randomized by the caller.
-static void remove_non_unique_hints(sudoku *s, int *order, size_t n)
+// Get the calling thread's checker for uniqueness probes
+static sudoku_checker *get_probe_checker(void)
 {
-  assert(s);
-  assert(order);
+  pthread_once(&probe_once, make_probe_key);
+  sudoku_checker *checker = pthread_getspecific(probe_key);
+  if (checker == NULL) {
+    checker = sudoku_checker_create();
+    pthread_setspecific(probe_key, checker);
+  }
+  return checker;
+}
 
-  size_t count, ncols, nrows;
-  int set[GRID_SIZE];
+static void make_probe_key(void)
+{
+  if (pthread_key_create(&probe_key, free_probe_checker) != 0) {
+    fatal("failed to create the probe checker key");
+  }
+}
+
+// Free a thread's probe checker when the thread exits
+static void free_probe_checker(void *checker)
+{
+  sudoku_checker_destroy(checker);
+}
+
+// Remove hints that aren't needed to solve the puzzle with naked and
+// hidden singles alone. The hints are processed an orbit at a time in
+// the order of the orbits array of size n, which should be randomized
+// by the caller. The number of propagation checks is added to
+// propagations.
+static void remove_propagated_hints(sudoku_state *st, orbit *orbits, size_t n,
+                                    size_t *propagations)
+{
+  assert(st);
+  assert(orbits);
+  assert(propagations);
 
   for (int i = 0; i < n; i++) {
-    int x = GRID_X(order[i]), y = GRID_Y(order[i]);
-    sudoku_value v = s->grid[GRID_IDX(x, y)];
-    if (v != 0) {
-      // Tentatively remove the hint, and then search for a unique
-      // solution
-      s->grid[GRID_IDX(x, y)] = 0;
-      bool *cells = get_dlx_cells(s, &count, &ncols, &nrows);
-      solver *checker = solver_create(count, ncols, nrows);
-      solver_init_graph(checker, cells, false);
-      free(cells);
-      bool unique = solver_run(checker, DLX_UNIQUE, set, GRID_SIZE);
-      // Add the hint back in if a unique solution was found
-      if (!unique) {
-        s->grid[GRID_IDX(x, y)] = v;
+    orbit *o = &orbits[i];
+    if (st->grid.grid[o->cells[0]] != 0) {
+      sudoku_value values[4];
+      for (int j = 0; j < o->size; j++) {
+        values[j] = sudoku_state_remove(st, o->cells[j]);
+      }
+      (*propagations)++;
+      if (rate_puzzle(&st->grid, DIFFICULTY_SINGLES) != DIFFICULTY_SINGLES) {
+        for (int j = 0; j < o->size; j++) {
+          sudoku_state_place(st, o->cells[j], values[j]);
+        }
       }
-      solver_destroy(checker);
     }
   }
 }
 
-// Copy num hints from the solution to make the puzzle easier
-void add_extra_hints(sudoku *s, sudoku *solution, int num)
+// Copy num hints from the solution to make the puzzle easier. Hints
+// are added a whole orbit of the symmetry at a time, so with a
+// symmetry a few more than num hints may be added.
+void add_extra_hints(sudoku *s, sudoku *solution, int num, sudoku_symmetry symmetry)
 {
   assert(s);
   assert(solution);
@@ -336,20 +928,23 @@ void add_extra_hints(sudoku *s, sudoku *solution, int num)
     return;
   }
 
-  // Find all possible hints and randomize their order
-  int hints[GRID_SIZE] = { 0 };
-  size_t num_choices = 0;
+  // Find all possible orbits of hints and randomize their order
+  int empty[GRID_SIZE], hints[GRID_SIZE];
+  orbit orbits[GRID_SIZE];
+  size_t num_empty = 0;
   for (int i = 0; i < GRID_SIZE; i++) {
     if (s->grid[i] == 0) {
-      hints[num_choices++] = i;
+      empty[num_empty++] = i;
     }
   }
-  shuffle(hints, num_choices);
+  size_t num_choices = get_orbits(symmetry, empty, num_empty, orbits);
+  init_shuffled_array(hints, num_choices, 0);
 
-  if (num > num_choices) {
-    num = num_choices;
-  }
-  for (int i = 0; i < num; i++) {
-    s->grid[hints[i]] = solution->grid[hints[i]];
+  for (int i = 0; i < num_choices && num > 0; i++) {
+    orbit *o = &orbits[hints[i]];
+    for (int j = 0; j < o->size; j++) {
+      s->grid[o->cells[j]] = solution->grid[o->cells[j]];
+    }
+    num -= o->size;
   }
 }
@@ -4,27 +4,161 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include "solver.h"
 
 typedef uint8_t sudoku_value;
 
 #define SUDOKU_SIZE 9
 #define GRID_SIZE (SUDOKU_SIZE*SUDOKU_SIZE)
 
-// TODO: to support the sudoku size being set at runtime, the grid
-// needs to be created on the heap. In this case sudoku_create/destroy
-// should be created, and this struct should be defined in the .c
-// file. Also, there are several macros/functions, specifically
-// dealing with sections, that would need to somehow be
-// defined/provided. These are: SEC_IDX, sudoku_print,
-// get_section_idx. These assume sections are 3x3 boxes in a 9x9 grid,
-// which won't be the case for a 7x7 sudoku for example.
+// The code here is specialized for 9x9 grids with 3x3 sections. Other
+// grid sizes have their own generators, compiled from kernel.c with
+// the size as a constant, see grid.h.
 
 typedef struct {
   sudoku_value grid[GRID_SIZE];
 } sudoku;
 
+// Get the index into the sudoku grid array
+#define GRID_IDX(x, y) ((y)*(SUDOKU_SIZE) + (x))
+
+// Get the grid x and y position from the sudoku grid index
+#define GRID_X(idx) ((idx)%(SUDOKU_SIZE))
+#define GRID_Y(idx) ((idx)/(SUDOKU_SIZE))
+
+// Get the section index given the sudoku cell position
+#define SEC_IDX(x, y) (((y)/3)*3 + (x)/3)
+
+// A mask with the bits of all the values 1 to SUDOKU_SIZE set
+#define SUDOKU_ALL_VALUES (((1 << SUDOKU_SIZE) - 1) << 1)
+
+// A grid along with masks of the values used in each row, column and
+// section, which are kept up to date as values are placed and removed.
+// The candidates of an empty cell are the values none of its units
+// use, so both the updates and the candidates are O(1).
+typedef struct {
+  sudoku grid;
+  uint16_t rows[SUDOKU_SIZE]; // Bit v set if the value v is used
+  uint16_t cols[SUDOKU_SIZE];
+  uint16_t secs[SUDOKU_SIZE];
+  int empty;                  // Number of empty cells
+} sudoku_state;
+
+// Symmetries the clue layout of a generated puzzle can be made to
+// follow. Cells that map onto each other form an orbit of 1, 2 or 4
+// cells, and hints are removed or added an orbit at a time.
+typedef enum {
+  SYMMETRY_NONE,
+  SYMMETRY_ROT180, // Rotation by 180 degrees about the center
+  SYMMETRY_ROT90,  // Rotation by 90 degrees about the center
+  SYMMETRY_DIAG,   // Reflection about the main diagonal
+  SYMMETRY_MIRROR, // Reflection about the vertical center line
+} sudoku_symmetry;
+
+typedef struct {
+  int extra_hints;
+  sudoku_symmetry symmetry;
+  int min_difficulty; // Range of difficulties to generate, see rate.h.
+  int max_difficulty; // 0 means no limit.
+  bool singles_only;  // Only keep hints needed to solve with singles
+  double time_limit;  // Seconds to try grids for a difficulty range, 0 for no limit
+  size_t max_attempts; // Grids to try for a difficulty range, 0 for MAX_ATTEMPTS
+} sudoku_options;
+
+// The phases of generating a puzzle, which are timed separately
+typedef enum {
+  PHASE_SOLVE,  // Seeding and solving the grid
+  PHASE_DEDUCE, // Removing hints that can be deduced
+  PHASE_UNIQUE, // Removing hints that aren't needed for uniqueness
+  PHASE_EXTRA,  // Adding extra hints back
+  SUDOKU_PHASES,
+} sudoku_phase;
+
+typedef struct {
+  size_t probes;    // Uniqueness checks run with the DLX solver
+  size_t deduced;   // Orbits removed by deduction, each a probe avoided
+  size_t propagations; // Checks that singles still solve the puzzle
+  size_t attempts;  // Solution grids tried
+  size_t abandoned; // Puzzles outside the difficulty range
+  solver_stats fill;   // Search work of solving the seeded grids
+  solver_stats probe;  // Search work of the uniqueness checks
+  uint64_t phase_ns[SUDOKU_PHASES]; // Nanoseconds spent in each phase
+} sudoku_stats;
+
+// A DLX graph of the whole (empty) sudoku grid that is built once and
+// reused for many uniqueness checks. Hints are placed by selecting
+// their rows in the graph, rather than rebuilding the graph for every
+// check.
+typedef struct sudoku_checker sudoku_checker;
+
+// The result of checking a puzzle with sudoku_checker_audit
+typedef struct {
+  int hints;
+  int solutions;                  // 0, 1 or 2 for two or more
+  int nredundant;                 // Number of hints that can be removed
+  int redundant[GRID_SIZE];       // Grid indices of those hints
+} sudoku_audit;
+
+bool sudoku_state_init(sudoku_state *st, const sudoku *s);
+
+// Get the candidates of the empty cell at the grid index idx, with bit
+// v set if the value v isn't used in its row, column or section
+static inline int sudoku_state_candidates(const sudoku_state *st, int idx)
+{
+  int x = GRID_X(idx), y = GRID_Y(idx);
+  return ~(st->rows[y] | st->cols[x] | st->secs[SEC_IDX(x, y)]) & SUDOKU_ALL_VALUES;
+}
+
+// Put the value v in the empty cell at the grid index idx. The value
+// should be one of the cell's candidates.
+static inline void sudoku_state_place(sudoku_state *st, int idx, sudoku_value v)
+{
+  int x = GRID_X(idx), y = GRID_Y(idx), bit = 1 << v;
+  st->grid.grid[idx] = v;
+  st->rows[y] |= bit;
+  st->cols[x] |= bit;
+  st->secs[SEC_IDX(x, y)] |= bit;
+  st->empty--;
+}
+
+// Empty the filled cell at the grid index idx, returning its value
+static inline sudoku_value sudoku_state_remove(sudoku_state *st, int idx)
+{
+  int x = GRID_X(idx), y = GRID_Y(idx);
+  sudoku_value v = st->grid.grid[idx];
+  int bit = 1 << v;
+  st->grid.grid[idx] = 0;
+  st->rows[y] &= ~bit;
+  st->cols[x] &= ~bit;
+  st->secs[SEC_IDX(x, y)] &= ~bit;
+  st->empty++;
+  return v;
+}
+
+bool *sudoku_dlx_cells(const sudoku_state *st, size_t *count, size_t *ncols,
+                       size_t *nrows);
 bool sudoku_solve(sudoku *s);
-void sudoku_generate(sudoku *s, sudoku *solution, int extra_hints);
+void sudoku_stats_add(sudoku_stats *total, const sudoku_stats *stats);
+const char *sudoku_phase_name(sudoku_phase phase);
+const char *sudoku_symmetry_name(sudoku_symmetry symmetry);
+bool sudoku_parse_symmetry(const char *name, sudoku_symmetry *symmetry);
+bool sudoku_generate(sudoku *s, sudoku *solution, const sudoku_options *opts,
+                     sudoku_stats *stats);
 void sudoku_print(sudoku *s, FILE *fp);
+void sudoku_print_line(sudoku *s, FILE *fp);
+void sudoku_format_line(sudoku *s, char *line);
+bool sudoku_parse(const char *line, sudoku *s);
+int sudoku_count_hints(sudoku *s);
+
+sudoku_checker *sudoku_checker_create(void);
+void sudoku_checker_destroy(sudoku_checker *c);
+bool sudoku_checker_unique(sudoku_checker *c, sudoku *s);
+bool sudoku_checker_solve(sudoku_checker *c, sudoku *s);
+void sudoku_checker_set_cancel(sudoku_checker *c, const int *cancel);
+void sudoku_checker_set_deadline(sudoku_checker *c, double deadline);
+bool sudoku_checker_timed_out(sudoku_checker *c);
+void sudoku_checker_fill(sudoku_checker *c, sudoku *s);
+bool sudoku_checker_audit(sudoku_checker *c, sudoku *s, bool find_redundant,
+                          sudoku_audit *audit);
 
 #endif
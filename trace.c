@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+#include "util.h"
+#include "trace.h"
+
+// Traces of the work done, in the Chrome trace event format, which
+// chrome://tracing and Perfetto load.
+//
+// An event covers the time from trace_begin to the matching trace_end
+// on one thread. Each thread writes its finished events to a ring
+// buffer of its own, and a writer thread drains the rings into the
+// file. A ring has one producer and one consumer, so the two only
+// share its head and tail indices; a thread never waits to record an
+// event, and if its ring is full the event is dropped and counted.
+//
+// Event names must be string constants, since they are only written
+// out later.
+
+// Events each thread's ring holds
+#define RING_SIZE 8192
+// Events a thread can be inside at once
+#define MAX_DEPTH 16
+// Nanoseconds the writer sleeps between draining the rings
+#define WRITER_SLEEP_NS 1000000
+
+typedef struct {
+  const char *name;
+  int64_t arg;       // Shown in the viewer, unless it is -1
+  uint64_t start_ns;
+  uint64_t end_ns;
+} trace_event;
+
+typedef struct ring {
+  trace_event events[RING_SIZE];
+  uint64_t head;     // Events recorded, written by the thread
+  uint64_t tail;     // Events written out, written by the writer
+  uint64_t dropped;
+  int tid;
+  bool named;        // Whether the thread's name was written out
+  struct ring *next;
+} ring;
+
+static bool enabled = false;
+static FILE *trace_fp;
+static uint64_t trace_start;
+static pthread_t writer;
+static bool writer_stop;
+static bool first_event;
+
+// The rings of every thread that has recorded an event. Threads add
+// their ring once; the list is only freed by trace_close.
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static ring *rings;
+static int nrings;
+
+static __thread ring *thread_ring;
+static __thread trace_event stack[MAX_DEPTH];
+static __thread int depth;
+
+static void *writer_main(void *arg);
+static void drain(void);
+static ring *get_ring(void);
+
+// Start tracing to the file at path. Return false if it can't be
+// opened.
+bool trace_open(const char *path)
+{
+  assert(path);
+  assert(!enabled);
+
+  if ((trace_fp = fopen(path, "w")) == NULL) {
+    warn("unable to open trace file %s", path);
+    return false;
+  }
+  fprintf(trace_fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  first_event = true;
+  trace_start = get_time_ns();
+  writer_stop = false;
+  if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+    fatal("failed to create trace writer thread");
+  }
+  enabled = true;
+  return true;
+}
+
+// Write out the events left in the rings and close the file. Threads
+// should be done recording by now.
+void trace_close(void)
+{
+  if (!enabled) {
+    return;
+  }
+  __atomic_store_n(&writer_stop, true, __ATOMIC_RELEASE);
+  pthread_join(writer, NULL);
+  drain();
+
+  uint64_t dropped = 0;
+  while (rings != NULL) {
+    ring *r = rings;
+    rings = r->next;
+    dropped += r->dropped;
+    free(r);
+  }
+  nrings = 0;
+  fprintf(trace_fp, "\n]}\n");
+  fclose(trace_fp);
+  enabled = false;
+  if (dropped > 0) {
+    warn("dropped %llu trace events with full buffers", (unsigned long long) dropped);
+  }
+}
+
+// Start an event on the calling thread, to be ended by trace_end
+void trace_begin(const char *name, int64_t arg)
+{
+  if (!enabled) {
+    return;
+  }
+  if (depth < MAX_DEPTH) {
+    stack[depth].name = name;
+    stack[depth].arg = arg;
+    stack[depth].start_ns = get_time_ns();
+  }
+  depth++;
+}
+
+// End the event started last on the calling thread and record it
+void trace_end(void)
+{
+  if (!enabled) {
+    return;
+  }
+  assert(depth > 0);
+  if (--depth >= MAX_DEPTH) {
+    return;
+  }
+
+  ring *r = thread_ring != NULL ? thread_ring : get_ring();
+  uint64_t head = r->head;
+  if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == RING_SIZE) {
+    r->dropped++;
+    return;
+  }
+  trace_event *e = &r->events[head % RING_SIZE];
+  *e = stack[depth];
+  e->end_ns = get_time_ns();
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void *writer_main(void *arg)
+{
+  struct timespec pause = { 0, WRITER_SLEEP_NS };
+  while (!__atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE)) {
+    drain();
+    nanosleep(&pause, NULL);
+  }
+  return NULL;
+}
+
+// Write out the events recorded in every ring since the last drain.
+// Only one thread drains at a time: the writer, or trace_close once
+// the writer is done.
+static void drain(void)
+{
+  pthread_mutex_lock(&rings_lock);
+  ring *list = rings;
+  pthread_mutex_unlock(&rings_lock);
+
+  for (ring *r = list; r != NULL; r = r->next) {
+    if (!r->named) {
+      fprintf(trace_fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+              "\"args\":{\"name\":\"thread %d\"}}", first_event ? "" : ",", r->tid, r->tid);
+      first_event = false;
+      r->named = true;
+    }
+
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    for (uint64_t t = r->tail; t < head; t++) {
+      const trace_event *e = &r->events[t % RING_SIZE];
+      fprintf(trace_fp, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+              "\"ts\":%.3f,\"dur\":%.3f", first_event ? "" : ",", e->name, r->tid,
+              (e->start_ns - trace_start) / 1e3, (e->end_ns - e->start_ns) / 1e3);
+      if (e->arg >= 0) {
+        fprintf(trace_fp, ",\"args\":{\"n\":%lld}", (long long) e->arg);
+      }
+      fputc('}', trace_fp);
+      first_event = false;
+    }
+    __atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+  }
+}
+
+// Create the calling thread's ring and add it to the list
+static ring *get_ring(void)
+{
+  ring *r = calloc(1, sizeof(ring));
+  if (r == NULL) {
+    fatal("failed to allocate memory for trace events");
+  }
+  pthread_mutex_lock(&rings_lock);
+  r->tid = nrings++;
+  r->next = rings;
+  rings = r;
+  pthread_mutex_unlock(&rings_lock);
+  thread_ring = r;
+  return r;
+}
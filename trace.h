@@ -0,0 +1,12 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool trace_open(const char *path);
+void trace_close(void);
+void trace_begin(const char *name, int64_t arg);
+void trace_end(void);
+
+#endif
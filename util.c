@@ -1,7 +1,23 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
 #include <assert.h>
 #include "util.h"
 
+// Each thread has its own random number generator so that worker
+// threads neither contend on a lock nor disturb each other's
+// sequences. The generator is PCG32 (XSH RR), written out here rather
+// than taken from libc, so a seed gives the same puzzle with any libc.
+#define RNG_MULTIPLIER 6364136223846793005ULL
+#define RNG_INCREMENT 1442695040888963407ULL
+
+static __thread uint64_t rng_state;
+static __thread bool rng_ready = false;
+
+static uint32_t rng_next(void);
+
 void log_msg(const char *file, int line, const char *fmt, ...)
 {
   va_list lst;
@@ -19,9 +35,64 @@ void shuffle(int *a, size_t n)
 {
   assert(a);
   for (int i = n-1; i >= 1; i--) {
-    int j = rand() % (i+1);
+    int j = rng_int(i+1);
     int tmp = a[i];
     a[i] = a[j];
     a[j] = tmp;
   }
 }
+
+// Seed the calling thread's random number generator
+void rng_seed(unsigned int seed)
+{
+  rng_state = 0;
+  rng_next();
+  rng_state += seed;
+  rng_next();
+  rng_ready = true;
+}
+
+// Get a random integer in the range [0, n) from the calling thread's
+// random number generator. An unseeded generator behaves as if it was
+// seeded with 1.
+int rng_int(int n)
+{
+  assert(n > 0);
+  if (!rng_ready) {
+    rng_seed(1);
+  }
+  // Outputs below the threshold are redrawn, so that every result is
+  // equally likely
+  uint32_t threshold = -(uint32_t) n % n, r;
+  do {
+    r = rng_next();
+  } while (r < threshold);
+  return r % n;
+}
+
+// Step the calling thread's generator and get its next 32 bits
+static uint32_t rng_next(void)
+{
+  uint64_t old = rng_state;
+  rng_state = old*RNG_MULTIPLIER + RNG_INCREMENT;
+  uint32_t shifted = ((old >> 18) ^ old) >> 27;
+  int rot = old >> 59;
+  return (shifted >> rot) | (shifted << (-rot & 31));
+}
+
+// Get the time in seconds from a monotonic clock
+double get_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Get the time in nanoseconds from a monotonic clock, for timing short
+// intervals without the rounding of a double
+uint64_t get_time_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -3,9 +3,14 @@
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 void log_msg(const char *file, int line, const char *fmt, ...);
 void shuffle(int *a, size_t n);
+void rng_seed(unsigned int seed);
+int rng_int(int n);
+double get_time(void);
+uint64_t get_time_ns(void);
 
 #define debug(...) log_msg(__FILE__, __LINE__, __VA_ARGS__);
 #define warn(...) log_msg(NULL, 0, __VA_ARGS__);